@@ -0,0 +1,347 @@
+// Microbenchmarks for the matching engine, agent strategies and MPI phases
+// Usage: mpirun -np N ./bench_trading_sim [--quick] [--out results.json]
+#include <mpi.h>
+#include <omp.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include "exchange.h"
+#include "agent.h"
+#include "agent_engine.h"
+#include "continuous.h"
+#include "marketdata.h"
+#include "utils.h"
+#include "counting_allocator.h"
+
+struct BenchResult {
+    std::string name;
+    std::string param_name;
+    long long param;
+    long long iterations;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+static std::vector<BenchResult> results;
+static int world_rank = 0;
+static int world_size = 1;
+
+static void record(const std::string &name, const std::string &param_name, long long param,
+                   long long iterations, double elapsed_ms, long long allocs)
+{
+    BenchResult r;
+    r.name = name;
+    r.param_name = param_name;
+    r.param = param;
+    r.iterations = iterations;
+    r.ns_per_op = elapsed_ms * 1e6 / iterations;
+    r.allocs_per_op = (double)allocs / iterations;
+    results.push_back(r);
+    if (world_rank == 0)
+    {
+        std::cout << std::left << std::setw(28) << name
+                  << std::setw(22) << (param_name + "=" + std::to_string(param))
+                  << std::right << std::setw(12) << std::fixed << std::setprecision(1)
+                  << r.ns_per_op << " ns/op" << std::setw(10) << std::setprecision(3)
+                  << r.allocs_per_op << " allocs/op\n";
+    }
+}
+
+static Order bench_order(int agent_id, double price, int volume, bool is_buy)
+{
+    Order o;
+    o.agent_id = agent_id;
+    o.price = price;
+    o.volume = volume;
+    o.is_buy = is_buy;
+    return o;
+}
+
+// Rest depth orders on both sides across 200 levels without crossing
+static void prefill(OrderBook &ob, int depth)
+{
+    for (int i = 0; i < depth; ++i)
+    {
+        bool buy = i % 2 == 0;
+        double offset = 0.01 * (1 + (i / 2) % 200);
+        ob.add_order(bench_order(i, buy ? 99.99 - offset : 100.01 + offset, 5, buy));
+    }
+}
+
+// ---------------- Order book -----------------
+
+static void bench_add_order(int depth, int iterations)
+{
+    OrderBook ob;
+    prefill(ob, depth);
+    long long allocs = allocation_count;
+    Timer timer;
+    for (int i = 0; i < iterations; ++i)
+    {
+        bool buy = i % 2 == 0;
+        double offset = 0.01 * (1 + i % 200);
+        ob.add_order(bench_order(i, buy ? 99.99 - offset : 100.01 + offset, 5, buy));
+    }
+    record("order_book_add", "depth", depth, iterations, timer.elapsed_ms(), allocation_count - allocs);
+}
+
+static void bench_match_orders(int depth, int iterations)
+{
+    // Each iteration crosses one resting ask and replaces it, so the book
+    // stays at the requested depth
+    OrderBook ob;
+    prefill(ob, depth);
+    std::vector<Trade> trades;
+    trades.reserve(16);
+    ob.reserve_history(iterations);
+    long long fills = 0;
+    long long allocs = allocation_count;
+    Timer timer;
+    for (int i = 0; i < iterations; ++i)
+    {
+        double best_ask = 0.0;
+        ob.get_best_ask(best_ask);
+        ob.add_order(bench_order(i, best_ask, 5, true));
+        trades.clear();
+        fills += ob.match_orders(i, trades);
+        ob.add_order(bench_order(i, 100.01 + 0.01 * (1 + i % 200), 5, false));
+    }
+    double ms = timer.elapsed_ms();
+    record("order_book_match", "depth", depth, fills > 0 ? fills : 1, ms, allocation_count - allocs);
+}
+
+// Time per order with matching on arrival, submitted from one lane across
+// four instruments; also reports the submit-to-matched latency
+static void bench_continuous_match(int matchers, int iterations)
+{
+    Exchange ex(0, 4, DEFAULT_TICK_SIZE, 1);
+    ex.set_history_options(1, false);
+    ContinuousEngine engine(ex, matchers);
+    long long allocs = allocation_count;
+    Timer timer;
+    const int per_tick = 1000;
+    for (int tick = 0; tick * per_tick < iterations; ++tick)
+    {
+        for (int i = tick * per_tick; i < (tick + 1) * per_tick && i < iterations; ++i)
+        {
+            bool buy = i % 2 == 0;
+            Order o = bench_order(i, buy ? 100.0 + 0.01 * (i % 5) : 100.02 - 0.01 * (i % 5), 5, buy);
+            o.instrument_id = i % 4;
+            ex.submit_order(o, 0);
+        }
+        ex.process_orders(tick);
+    }
+    double ms = timer.elapsed_ms();
+    record("continuous_match", "matchers", matchers, iterations, ms, allocation_count - allocs);
+    MatchLatency l = engine.get_latency();
+    if (world_rank == 0)
+        std::cout << "  latency p50 " << std::setprecision(0) << l.p50_ns << " ns, p99 " << l.p99_ns << " ns\n";
+}
+
+// ---------------- Agent strategies -----------------
+
+static const char *strategy_name(int s)
+{
+    static const char *names[NUM_STRATEGIES] = {"random_walk", "momentum", "mean_reversion", "market_maker"};
+    return names[s];
+}
+
+static void bench_engine_strategy(int strategy, int agents, int ticks)
+{
+    std::vector<int> mix(NUM_STRATEGIES, 0);
+    mix[strategy] = agents;
+    const int instruments = 8;
+    Exchange ex(0, instruments);
+    AgentEngine engine(0, mix, instruments);
+
+    // Warm-up tick sizes the lanes and scratch buffers
+    engine.generate_orders(ex, 0);
+    ex.process_orders(0);
+
+    double ms = 0.0;
+    long long allocs = 0;
+    for (int tick = 1; tick <= ticks; ++tick)
+    {
+        long long a = allocation_count;
+        Timer timer;
+        engine.generate_orders(ex, tick);
+        ms += timer.elapsed_ms();
+        allocs += allocation_count - a;
+        ex.process_orders(tick); // untimed, drains the lanes
+    }
+    record(std::string("engine_") + strategy_name(strategy), "agents", agents,
+           (long long)agents * ticks, ms, allocs);
+}
+
+static void bench_object_strategy(int strategy, int agents, int ticks)
+{
+    std::vector<Agent> pool;
+    pool.reserve(agents);
+    for (int i = 0; i < agents; ++i)
+        pool.emplace_back(0, i, static_cast<AgentStrategy>(strategy));
+    std::vector<Order> orders;
+    orders.reserve(2);
+
+    double ms = 0.0;
+    long long allocs = 0;
+    long long emitted = 0;
+    for (int tick = 0; tick < ticks; ++tick)
+    {
+        long long a = allocation_count;
+        Timer timer;
+        for (int i = 0; i < agents; ++i)
+        {
+            orders.clear();
+            emitted += pool[i].generate_orders(i % 8, 100.0 + 0.01 * (tick % 7), 100.0, tick, orders);
+        }
+        ms += timer.elapsed_ms();
+        allocs += allocation_count - a;
+    }
+    if (emitted == 0)
+        std::cerr << "no orders emitted\n";
+    record(std::string("agent_") + strategy_name(strategy), "agents", agents,
+           (long long)agents * ticks, ms, allocs);
+}
+
+// ---------------- MPI market data -----------------
+
+static void bench_broadcast(int instruments, int iterations)
+{
+    MarketDataManager md(world_rank, world_size);
+    std::vector<double> local(instruments, 100.0 + world_rank), global;
+    md.broadcast_prices(local, global); // warm-up
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    long long allocs = allocation_count;
+    Timer timer;
+    for (int i = 0; i < iterations; ++i)
+        md.broadcast_prices(local, global);
+    double ms = timer.elapsed_ms();
+    allocs = allocation_count - allocs;
+
+    // The slowest rank defines the latency of a collective
+    double max_ms = 0.0;
+    MPI_Allreduce(&ms, &max_ms, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    record("broadcast_prices", "instruments", instruments, iterations, max_ms, allocs);
+}
+
+static void bench_exchange_async(int instruments, int iterations)
+{
+    // Posting cost of the non-blocking path; completion of each reduction
+    // is paid one iteration later, as in the simulator with staleness 1
+    MarketDataManager md(world_rank, world_size);
+    md.set_staleness(1);
+    std::vector<double> local(instruments, 100.0 + world_rank), global;
+    md.exchange_prices(local, global); // warm-up sizes the ring
+    md.exchange_prices(local, global);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    long long allocs = allocation_count;
+    Timer timer;
+    for (int i = 0; i < iterations; ++i)
+        md.exchange_prices(local, global);
+    double ms = timer.elapsed_ms();
+    allocs = allocation_count - allocs;
+    md.drain(global);
+
+    double max_ms = 0.0;
+    MPI_Allreduce(&ms, &max_ms, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    record("exchange_prices_async", "instruments", instruments, iterations, max_ms, allocs);
+}
+
+static void bench_publish_deltas(int instruments, int iterations)
+{
+    // One instrument in a hundred moves per tick; snapshots every 100 ticks
+    MarketDataManager md(world_rank, world_size);
+    std::vector<double> local(instruments, 100.0 + world_rank), global;
+    std::vector<int> volumes;
+    md.publish_deltas(local, volumes, global); // initial snapshot sizes buffers
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    long long allocs = allocation_count;
+    Timer timer;
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = i % 100; j < instruments; j += 100)
+            local[j] += 0.01;
+        md.publish_deltas(local, volumes, global);
+    }
+    double ms = timer.elapsed_ms();
+    allocs = allocation_count - allocs;
+
+    double max_ms = 0.0;
+    MPI_Allreduce(&ms, &max_ms, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    record("publish_deltas", "instruments", instruments, iterations, max_ms, allocs);
+}
+
+static void write_json(const std::string &path)
+{
+    std::ofstream ofs(path);
+    ofs << "{\n  \"ranks\": " << world_size << ",\n  \"threads\": " << omp_get_max_threads()
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult &r = results[i];
+        ofs << "    {\"name\": \"" << r.name << "\", \"" << r.param_name << "\": " << r.param
+            << ", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << std::setprecision(6) << r.ns_per_op
+            << ", \"allocs_per_op\": " << r.allocs_per_op << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    ofs << "  ]\n}\n";
+}
+
+int main(int argc, char **argv)
+{
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+    bool quick = false;
+    std::string out = "bench_results.json";
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--quick") == 0)
+            quick = true;
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            out = argv[++i];
+    }
+    const int scale = quick ? 10 : 1;
+
+    if (world_rank == 0)
+        std::cout << "=== Trading Simulator Benchmarks (" << world_size << " ranks, "
+                  << omp_get_max_threads() << " threads) ===\n";
+
+    for (int depth : {1000, 10000, 100000})
+        bench_add_order(depth, 200000 / scale);
+    for (int depth : {1000, 10000, 100000})
+        bench_match_orders(depth, 200000 / scale);
+    for (int matchers : {1, 2})
+        bench_continuous_match(matchers, 200000 / scale);
+
+    for (int s = 0; s < NUM_STRATEGIES; ++s)
+        bench_engine_strategy(s, 100000 / scale, 20);
+    for (int s = 0; s < NUM_STRATEGIES; ++s)
+        bench_object_strategy(s, 100000 / scale, 20);
+
+    for (int instruments : {3, 100, 1000, 10000})
+        bench_broadcast(instruments, 2000 / scale);
+    for (int instruments : {3, 100, 1000, 10000})
+        bench_exchange_async(instruments, 2000 / scale);
+    for (int instruments : {3, 100, 1000, 10000})
+        bench_publish_deltas(instruments, 2000 / scale);
+
+    if (world_rank == 0)
+    {
+        write_json(out);
+        std::cout << "Results written to " << out << "\n";
+    }
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,81 @@
+// ============================================================================
+// include/affinity.h
+// CPU topology discovery, thread pinning and first-touch memory placement
+// ============================================================================
+
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// CPUs this process may run on and the NUMA node of each
+struct CpuTopology {
+    std::vector<int> cpus;      // Allowed CPUs, grouped by node
+    std::vector<int> node_of;   // Node of cpus[k]
+    int num_nodes;              // Distinct nodes among cpus
+    int online_cpus;            // CPUs on the machine, allowed or not
+};
+
+// Allowed CPUs from the scheduler mask (as it was before pin_threads, so a
+// later run of a sweep sees the whole machine again), nodes from sysfs. Machines (or
+// platforms) that report no NUMA layout come back as a single node.
+CpuTopology detect_topology();
+
+// The CPU each OpenMP thread of one rank runs on
+struct ThreadPlacement {
+    std::vector<int> cpu_of_thread;
+    std::vector<int> node_of_thread;
+};
+
+// Place num_threads threads on the topology. Ranks that share a machine
+// without a launcher binding (every CPU allowed) take disjoint, node-aligned
+// shares of it by local_rank, so they never pin onto the same cores. Within
+// a share, threads are spread evenly in node order, so consecutive threads
+// sit on the same node; more threads than CPUs wrap around.
+ThreadPlacement plan_placement(const CpuTopology& topology, int num_threads, int local_rank,
+                               int local_size);
+
+// Pin each thread of an OpenMP team of the placement's size to its CPU.
+// Later parallel regions of that size reuse the pinned threads. Returns
+// false if pinning is unsupported or refused.
+bool pin_threads(const ThreadPlacement& placement);
+
+// Let the calling thread run on every CPU the process started with. For
+// helper threads (matchers, communication, trade log and checkpoint
+// writers, replay prefetch) spawned by a pinned thread, which otherwise
+// inherit its single CPU. Returns false if nothing was pinned or it is
+// unsupported.
+bool release_thread();
+
+// One line for the startup banner, e.g.
+// "2 nodes, 16 of 16 CPUs; node 0: threads 0-3, node 1: threads 4-7"
+std::string describe_placement(const CpuTopology& topology, const ThreadPlacement& placement);
+
+// Allocator whose default construction leaves trivial elements
+// uninitialized, so resizing a vector does not touch its pages. Filling
+// the elements in a parallel loop then puts each page on the node of the
+// thread that will use it (first-touch placement).
+template <typename T>
+struct FirstTouchAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = FirstTouchAllocator<U>;
+    };
+
+    FirstTouchAllocator() = default;
+    template <typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&) {}
+
+    template <typename U>
+    void construct(U* p) { ::new ((void*)p) U; }
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new ((void*)p) U(std::forward<Args>(args)...); }
+};
+
+template <typename T>
+using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
+
+#endif // AFFINITY_H
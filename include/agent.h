@@ -7,7 +7,8 @@
 #define AGENT_H
 
 #include "exchange.h"
-#include <random>
+#include "rng.h"
+#include "statistics.h"
 #include <vector>
 
 // Different trading strategies
@@ -21,10 +22,11 @@ enum class AgentStrategy {
 // Trading agent that generates orders based on strategy
 class Agent {
 private:
-    int thread_id;                  // OpenMP thread ID
+    int thread_id;                  // OpenMP thread that owns this agent
     int agent_id;                   // Unique agent ID
     AgentStrategy strategy;         // Trading strategy
-    std::mt19937 rng;              // Random number generator
+    PriceStatistic reference_stat;  // Statistic used as "historical average"
+    Philox::Stream rng;             // This agent's stream, seeked to each tick
     
     // Strategy parameters
     double momentum_threshold;
@@ -32,31 +34,84 @@ private:
     int position;                   // Current position in instrument
     
 public:
-    Agent(int thread_id, int agent_id, AgentStrategy strategy);
+    // Draws come from Philox::Stream(seed, agent_id) as in AgentEngine;
+    // seed 0 reproduces the unseeded streams
+    Agent(int thread_id, int agent_id, AgentStrategy strategy,
+          PriceStatistic reference_stat = PriceStatistic::MEAN, uint64_t seed = 0);
     
-    // Generate orders based on current market conditions
-    std::vector<Order> generate_orders(
+    // Statistic the caller should pass as historical_average
+    PriceStatistic get_reference_statistic() const { return reference_stat; }
+    int get_agent_id() const { return agent_id; }
+    AgentStrategy get_strategy() const { return strategy; }
+    int get_position() const { return position; }
+    
+    // Apply an executed trade: buys add to the position, sells subtract
+    void apply_fill(int volume, bool is_buy) { position += is_buy ? volume : -volume; }
+    
+    // Generate orders based on current market conditions, appending them to
+    // out. The caller owns and reuses the buffer, so a warmed-up buffer
+    // never allocates. Returns the number of orders appended.
+    int generate_orders(
         int instrument_id,
         double current_price,
         double historical_average,
-        int timestamp
+        int timestamp,
+        std::vector<Order>& out
     );
     
 private:
     // Strategy-specific order generation
-    std::vector<Order> random_walk_strategy(
-        int instrument_id, double current_price, int timestamp);
+    int random_walk_strategy(
+        int instrument_id, double current_price, int timestamp,
+        std::vector<Order>& out);
     
-    std::vector<Order> momentum_strategy(
+    int momentum_strategy(
         int instrument_id, double current_price, 
-        double historical_average, int timestamp);
+        double historical_average, int timestamp,
+        std::vector<Order>& out);
     
-    std::vector<Order> mean_reversion_strategy(
+    int mean_reversion_strategy(
         int instrument_id, double current_price,
-        double historical_average, int timestamp);
+        double historical_average, int timestamp,
+        std::vector<Order>& out);
+    
+    int market_maker_strategy(
+        int instrument_id, double current_price, int timestamp,
+        std::vector<Order>& out);
+};
+
+// Reusable per-thread order buffer, padded so threads never share a line
+struct alignas(64) ThreadOrderBuffer {
+    std::vector<Order> orders;
+};
+
+// Persistent population of agents for one exchange. Agents are created once
+// and keep their RNG state and position across ticks; the number of agents
+// is independent of the number of OpenMP threads.
+class AgentPool {
+private:
+    std::vector<Agent> agents;
+    std::vector<int> instruments;   // Instrument traded by each agent
+    int base_agent_id;              // Global ID of agents[0]
+    std::vector<ThreadOrderBuffer> thread_orders; // Reused across ticks
+    
+public:
+    // Agents get global IDs rank * num_agents + i, trade instrument
+    // i % num_instruments and strategy i % NUM_STRATEGIES. seed
+    // keys every agent's stream, as AgentEngine::set_seed does.
+    AgentPool(int rank, int num_agents, int num_instruments, int num_threads, uint64_t seed = 0);
+    
+    // Phase 1: every agent observes its instrument and submits orders.
+    // Agents are split into contiguous static blocks over the team, so with
+    // lanes drained in thread order orders reach the books in agent order.
+    // Returns the number of orders submitted.
+    long long generate_orders(Exchange& exchange, int timestamp);
+    
+    // Update positions from the fills of the last process_orders call
+    void apply_fills(const Exchange& exchange);
     
-    std::vector<Order> market_maker_strategy(
-        int instrument_id, double current_price, int timestamp);
+    size_t size() const { return agents.size(); }
+    const Agent& operator[](size_t i) const { return agents[i]; }
 };
 
 #endif // AGENT_H
@@ -0,0 +1,149 @@
+// ============================================================================
+// include/agent_engine.h
+// Batched structure-of-arrays agent engine
+// Agents are grouped by (instrument, strategy) and each group runs one
+// branch-free kernel per tick instead of a per-agent strategy dispatch
+// ============================================================================
+
+#ifndef AGENT_ENGINE_H
+#define AGENT_ENGINE_H
+
+#include "affinity.h"
+#include "agent.h"
+#include "exchange.h"
+#include "offload.h"
+#include "serialize.h"
+#include "statistics.h"
+#include "strategies.h"
+#include <cstdint>
+#include <vector>
+
+// Contiguous run of agents sharing a strategy and an instrument
+struct AgentSegment {
+    int begin;                  // First slot in the SoA arrays
+    int end;                    // One past the last slot
+    AgentStrategy strategy;
+    int instrument_id;
+};
+
+// Per-thread output of the strategy kernels for one block of agents.
+// Every agent emits a primary order and market makers emit a second one
+// (always an ask), so the outputs are fixed-size per slot.
+struct alignas(64) KernelScratch {
+    std::vector<unsigned char> is_buy;
+    std::vector<double> price;
+    std::vector<int> volume;
+    std::vector<double> ask_price;  // Market maker second order
+    std::vector<int> ask_volume;
+};
+
+class AgentEngine {
+private:
+    // Agent state, one entry per slot, sorted by (instrument, strategy).
+    // Pages are first touched by the thread whose kernel blocks use them.
+    FirstTouchVector<int> agent_ids;         // Global agent ID
+    FirstTouchVector<double> thresholds;     // Momentum / reversion threshold
+    FirstTouchVector<int> positions;
+
+    std::vector<AgentSegment> segments;
+    std::vector<int> slot_of;           // Local agent index -> slot
+    int base_agent_id;                  // Global ID of local agent 0
+    int num_instruments;
+    uint64_t seed;                      // Mixed into every Philox draw
+    int order_lifetime;                 // Ticks an order rests, 0 = until filled
+
+    StrategyInfo kernels[NUM_STRATEGIES]; // Loop run for each strategy's segments
+    PriceStatistic reference_stats[NUM_STRATEGIES];
+    std::vector<double> prices;         // Per-instrument snapshot this tick
+    std::vector<double> references;     // Per (strategy, instrument)
+
+    std::vector<KernelScratch> scratch; // One per OpenMP thread, sized by that thread
+
+    bool use_offload;                   // Run built-in kernels on the target device
+    bool offload_stale;                 // Device copy predates the last build or restore
+    AgentOffload offload;
+
+    void build(const std::vector<AgentStrategy>& strategy_of);
+    void run_kernels(int begin, int end, int timestamp, KernelScratch& out, const Exchange* live);
+    long long emit_orders(int begin, int end, const KernelScratch& out,
+                          Exchange& exchange, int timestamp);
+    bool can_offload(const Exchange& exchange) const;
+    long long generate_offloaded(Exchange& exchange, int timestamp);
+
+public:
+    // Same population as AgentPool: global IDs rank * num_agents + i,
+    // instrument i % num_instruments and strategy i % NUM_STRATEGIES
+    AgentEngine(int rank, int num_agents, int num_instruments);
+    // Explicit strategy mix: agents_per_strategy[s] agents of strategy s,
+    // numbered strategy by strategy, instrument i % num_instruments
+    AgentEngine(int rank, const std::vector<int>& agents_per_strategy, int num_instruments);
+
+    // Replace the population in place, reusing the arrays of the previous
+    // one, as for the next run of a sweep. Seed and reference statistics
+    // return to their defaults.
+    void rebuild(int rank, int num_agents, int num_instruments);
+    void rebuild(int rank, const std::vector<int>& agents_per_strategy, int num_instruments);
+
+    // Run-wide seed; 0 reproduces the unseeded streams. Each agent's draws
+    // at a tick are Philox::draw(seed, agent ID, tick), so orders depend on
+    // the seed, the agent and the tick only, never on the thread or rank
+    // that runs the agent or on earlier ticks.
+    void set_seed(uint64_t s) { seed = s; }
+    uint64_t get_seed() const { return seed; }
+
+    // Submit GTD orders that rest for this many ticks, the submitting one
+    // included; 0 (the default) submits GTC orders
+    void set_order_lifetime(int ticks) { order_lifetime = ticks; }
+
+    // Run info.run for every agent of strategy info.id, e.g.
+    // make_strategy<MarketMaker<WideQuotes>>("wide_maker"). The kernel is
+    // chosen once per segment, never per agent. Rebuilding restores the
+    // built-in kernels.
+    void set_strategy_kernel(const StrategyInfo& info);
+    const StrategyInfo& get_strategy_kernel(AgentStrategy strategy) const
+    {
+        return kernels[static_cast<int>(strategy)];
+    }
+
+    // Run the strategy kernels on the OpenMP target device (see offload.h),
+    // the agent state kept resident there between ticks. Needs a
+    // TRADING_OFFLOAD build; without one this returns false and kernels
+    // stay on the host. Orders and their arrival order are the same either
+    // way. Ticks with a ContinuousEngine attached, whose agents re-read
+    // prices as the tick runs, or with a custom kernel installed run on the
+    // host.
+    bool set_offload(bool on);
+    bool get_offload() const { return use_offload; }
+
+    // Statistic a strategy compares the current price against
+    void set_reference_statistic(AgentStrategy strategy, PriceStatistic stat);
+
+    // Phase 1: run every strategy kernel and submit the resulting orders.
+    // Work is split into fixed blocks with a static schedule, so orders reach
+    // the books in slot order for any team size. Returns orders submitted.
+    // Prices come from the exchange's snapshots; with a ContinuousEngine
+    // attached they are re-read as the tick runs instead of once at the start.
+    long long generate_orders(Exchange& exchange, int timestamp);
+
+    // Update positions from the fills of the last process_orders call
+    void apply_fills(const Exchange& exchange);
+    // Apply fills matched on other ranks, e.g. OrderRouter::get_remote_fills
+    void apply_fills(const std::vector<Trade>& trades);
+
+    // Positions and strategy parameters for checkpointing; the RNG needs
+    // no state beyond the seed.
+    // Restoring requires an engine built with the same population and seed.
+    void serialize(ByteWriter& out) const;
+    bool deserialize(ByteReader& in);
+
+    // For each instrument, the thread of a team of num_threads that runs
+    // most of its agents' kernel blocks; see Exchange::place_books
+    std::vector<int> home_threads(int num_threads) const;
+
+    size_t size() const { return agent_ids.size(); }
+    int get_base_agent_id() const { return base_agent_id; }
+    const std::vector<AgentSegment>& get_segments() const { return segments; }
+    int get_position(int local_index) const { return positions[slot_of[local_index]]; }
+};
+
+#endif // AGENT_ENGINE_H
@@ -0,0 +1,74 @@
+// ============================================================================
+// include/balancer.h
+// Periodic migration of order books between ranks to even out matching load
+// ============================================================================
+
+#ifndef BALANCER_H
+#define BALANCER_H
+
+#include <mpi.h>
+#include <vector>
+#include "exchange.h"
+
+// What a book costs its host. Which books migrate, and when, changes the
+// fills: a migrated book books its old host's orders as routed orders,
+// after the local lanes. Only BOOKED_ORDERS keeps sharded runs repeatable.
+enum class LoadMetric {
+    MATCH_CYCLES,   // TSC cycles in process_orders; tracks real cost, but moves vary run to run
+    BOOKED_ORDERS   // Orders booked; timing-independent, so runs repeat exactly
+};
+
+// One planned migration
+struct InstrumentMove {
+    int instrument_id;
+    int from;
+    int to;
+    double cost;
+};
+
+// Measures per-instrument load over an interval of ticks, then moves whole
+// books (resting orders, history and statistics) from the busiest rank to
+// the idlest until they are within tolerance. Every rank plans from the
+// same reduced costs and the same owner table, so all ranks agree on the
+// moves without further coordination.
+class LoadBalancer {
+private:
+    int rank;
+    int size;
+    int interval;           // Ticks between rebalances
+    double tolerance;       // Accepted (max - min) / mean rank load
+    int max_moves;          // Books migrated per rebalance at most
+    LoadMetric metric;
+    
+    std::vector<double> local_cost, cost;
+    std::vector<int> owners;
+    std::vector<InstrumentMove> moves;
+    std::vector<std::vector<char>> outbound;
+    std::vector<char> send, recv;
+    std::vector<int> send_counts, recv_counts, send_displs, recv_displs;
+    long long bytes_sent;
+    
+public:
+    LoadBalancer(int rank, int size, int interval = 100, double tolerance = 0.10,
+                 int max_moves = 4, LoadMetric metric = LoadMetric::BOOKED_ORDERS);
+    
+    // True on the ticks a rebalance should run (every interval ticks)
+    bool due(int tick) const { return interval > 0 && (tick + 1) % interval == 0; }
+    
+    // Reduce the interval's load counters, plan and migrate books, update
+    // the owner table on every rank and reset the counters. Collective;
+    // call between ticks in sharded mode. Returns the number of books moved.
+    // Aborts the job if a received book cannot be loaded, since its old
+    // host no longer holds it.
+    int rebalance(Exchange& exchange);
+    const std::vector<InstrumentMove>& get_last_moves() const { return moves; }
+    long long get_bytes_sent() const { return bytes_sent; }
+    
+    // Greedy plan: repeatedly move the instrument on the busiest rank whose
+    // cost is closest to half the busiest-idlest gap. Updates owners in place.
+    static std::vector<InstrumentMove> plan_moves(const std::vector<double>& cost,
+                                                  std::vector<int>& owners, int size,
+                                                  double tolerance, int max_moves);
+};
+
+#endif // BALANCER_H
@@ -0,0 +1,88 @@
+// ============================================================================
+// include/checkpoint.h
+// Periodic per-rank checkpoints written by a background I/O thread
+// ============================================================================
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Header of a checkpoint file; payload_bytes of serialized state follow
+struct CheckpointHeader {
+    char magic[8];              // "TSCKPT03"
+    int32_t rank;
+    int32_t num_ranks;
+    int32_t tick;               // Last completed tick
+    int32_t reserved;
+    uint64_t payload_bytes;
+    uint64_t checksum;          // FNV-1a over the payload
+};
+
+// Every rank writes its own files, so checkpoint I/O runs in parallel
+// without coordination. The caller serializes into buffer() -- a memory
+// copy -- and commit() hands it to the I/O thread, which works on it while
+// the next ticks run; the caller only waits if the previous checkpoint is
+// still being written. Files alternate between two slots per rank and each
+// is written under a temporary name and renamed into place, so a run
+// killed at any moment leaves at least one complete checkpoint behind.
+class CheckpointWriter {
+private:
+    int rank;
+    int num_ranks;
+    std::string prefix;
+    std::vector<char> buffers[2];
+    int active;                 // Buffer the caller fills next
+    int slot;                   // File slot the next commit goes to
+
+    std::thread io;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool pending;               // The inactive buffer is waiting to be written
+    bool stopping;
+    bool failed;
+    int pending_tick;
+    int pending_slot;
+    int written_tick;           // Tick of the newest complete checkpoint
+
+    void io_loop();
+
+public:
+    // Files are <prefix>_rank_<rank>_<slot>.bin
+    CheckpointWriter(int rank, int num_ranks, const std::string& prefix = "checkpoint");
+    ~CheckpointWriter();
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    // Empty buffer to serialize the next checkpoint into
+    std::vector<char>& buffer();
+    // Write the buffer as the checkpoint taken after `tick`, in the background
+    void commit(int tick);
+    // Wait for the outstanding write. Returns false if any write failed.
+    bool finish();
+    // Newest checkpoint known to be complete on disk, or -1
+    int last_written_tick();
+    // Slot the next commit overwrites. After a restart, point it away from
+    // the slot that was loaded so that checkpoint survives the next write.
+    void set_next_slot(int s) { slot = s & 1; }
+};
+
+// Path of one checkpoint slot
+std::string checkpoint_path(const std::string& prefix, int rank, int slot);
+
+// Read and verify a single checkpoint file
+bool read_checkpoint(const std::string& filename, CheckpointHeader& header,
+                     std::vector<char>& payload);
+
+// Collective over MPI_COMM_WORLD: find the newest tick for which every rank
+// has a valid checkpoint and load this rank's payload for it, reporting the
+// slot it came from. Returns false on every rank if there is no such tick.
+bool load_latest_checkpoint(const std::string& prefix, int rank, int num_ranks,
+                            int& tick, std::vector<char>& payload, int* loaded_slot = nullptr);
+
+#endif // CHECKPOINT_H
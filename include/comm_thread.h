@@ -0,0 +1,89 @@
+// ============================================================================
+// include/comm_thread.h
+// Dedicated MPI communication thread that owns the market data exchange
+// ============================================================================
+
+#ifndef COMM_THREAD_H
+#define COMM_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "marketdata.h"
+
+// Owns a MarketDataManager and, when dedicated, the only thread that calls
+// MPI during the tick loop (MPI_THREAD_SERIALIZED). publish() hands the
+// tick's prices over and returns at once: the exchange, including the wait
+// for a reduction posted staleness ticks earlier, runs on the thread while
+// the workers generate and match the next tick, and in between the thread
+// keeps in-flight reductions moving with MPI_Test. Other collectives of
+// the tick (order routing, rebalancing, barriers) go through call(), which
+// runs them on the thread and waits, so MPI is never entered from two
+// threads at once.
+//
+// Without a dedicated thread every call runs inline on the caller, which
+// is the original funneled behaviour.
+class CommThread {
+private:
+    MarketDataManager md;
+    int staleness;
+    int snapshot_interval;
+    bool dedicated;
+
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::function<void()> job;      // Queued work for the thread
+    long long posted;               // Jobs queued so far
+    long long done;                 // Jobs finished so far
+    bool stopping;
+
+    // Inputs of the queued exchange and the average it leaves behind
+    std::vector<double> send_prices;
+    std::vector<int> send_volumes;
+    std::vector<double> result;
+    bool result_ready;
+    std::atomic<long long> bytes_sent;
+
+    void loop();
+    // One delta publication or price reduction, on whichever thread runs it
+    void exchange_market_data();
+    // Wait until every queued job has finished
+    void wait_idle(std::unique_lock<std::mutex>& lock);
+
+public:
+    // staleness and snapshot_interval as in MarketDataManager
+    CommThread(int rank, int size, int staleness, int snapshot_interval, bool dedicated);
+    // Finish queued work and stop the thread; drain() reductions first
+    ~CommThread();
+    CommThread(const CommThread&) = delete;
+    CommThread& operator=(const CommThread&) = delete;
+
+    bool is_dedicated() const { return dedicated; }
+
+    // Run fn, which may call MPI, on the communication thread and wait
+    void call(const std::function<void()>& fn);
+    // Start this tick's market data exchange: deltas when snapshot_interval
+    // is set (tick_volumes as for publish_deltas), otherwise the price
+    // reduction. Inline, returns true with the new average in global_prices
+    // (for a stale reduction, only once it is due). Dedicated, the exchange
+    // completes in the background, so global_prices receives the result of
+    // the previous call: averages arrive one tick later than inline.
+    bool publish(const std::vector<double>& local_prices, const std::vector<int>& tick_volumes,
+                 std::vector<double>& global_prices);
+    // Inline: advance in-flight reductions between phases. A dedicated
+    // thread does this by itself.
+    void progress();
+    // End-of-tick barrier across all ranks
+    void synchronize();
+    // Complete everything in flight and leave the newest average not yet
+    // returned in global_prices; false if there is none
+    bool drain(std::vector<double>& global_prices);
+
+    long long get_bytes_sent() const { return bytes_sent.load(std::memory_order_relaxed); }
+};
+
+#endif // COMM_THREAD_H
@@ -0,0 +1,175 @@
+// ============================================================================
+// include/concurrent.h
+// Lock-free building blocks for handing data between threads
+// ============================================================================
+
+#ifndef CONCURRENT_H
+#define CONCURRENT_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Bounded single-producer/single-consumer queue. The producer only writes
+// tail and the consumer only writes head, each on its own cache line, and
+// both keep a cached copy of the other's index so the shared line is only
+// read when the ring looks full or empty.
+template <typename T>
+class SpscRing {
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> head; // Next slot to consume
+    size_t cached_tail;                   // Consumer's last view of tail
+    alignas(64) std::atomic<size_t> tail; // Next slot to fill
+    size_t cached_head;                   // Producer's last view of head
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) : head(0), cached_tail(0), tail(0), cached_head(0)
+    {
+        size_t n = 2;
+        while (n < capacity)
+            n <<= 1;
+        slots.resize(n);
+        mask = n - 1;
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return slots.size(); }
+
+    // Producer: append unless the ring is full
+    bool try_push(const T& value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == slots.size())
+        {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == slots.size())
+                return false;
+        }
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: oldest entry, or nullptr when empty. The entry stays in the
+    // ring, and is not overwritten, until pop().
+    const T* front()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail)
+        {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return nullptr;
+        }
+        return &slots[h & mask];
+    }
+    // Consumer: release the entry returned by front(). Everything the
+    // consumer did before pop() is visible to a thread that sees empty().
+    void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // Either side, or a third thread waiting for the consumer to catch up
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+// Value published by one writer and read by any number of threads without
+// locks. The writer makes the version odd while it stores and even again
+// when done; a reader retries if the version was odd or changed under it.
+// The payload is held as relaxed atomic words, so a torn read is detected
+// rather than being a data race.
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock payload must be trivially copyable");
+    static const size_t WORDS = (sizeof(T) + 7) / 8;
+
+    std::atomic<uint32_t> version;
+    std::atomic<uint64_t> words[WORDS];
+
+public:
+    SeqLock() : version(0)
+    {
+        for (auto &w : words)
+            w.store(0, std::memory_order_relaxed);
+    }
+
+    // Single writer at a time
+    void store(const T& value)
+    {
+        uint64_t buf[WORDS] = {};
+        std::memcpy(buf, &value, sizeof(T));
+        uint32_t v = version.load(std::memory_order_relaxed);
+        version.store(v + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; ++i)
+            words[i].store(buf[i], std::memory_order_relaxed);
+        version.store(v + 2, std::memory_order_release);
+    }
+
+    T load() const
+    {
+        uint64_t buf[WORDS];
+        uint32_t before, after;
+        do
+        {
+            before = version.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; ++i)
+                buf[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = version.load(std::memory_order_relaxed);
+        } while (before != after || (before & 1));
+        T value;
+        std::memcpy(&value, buf, sizeof(T));
+        return value;
+    }
+
+    // Number of completed stores
+    uint32_t get_version() const { return version.load(std::memory_order_acquire) / 2; }
+};
+
+// Single-writer value kept in SLOTS seqlock-protected copies, each on its
+// own cache lines. The writer fills the slot after the published one and
+// only then advances the version, so readers copy a slot nobody is writing
+// and never wait: a read can only be retried if the writer publishes
+// SLOTS - 1 more times during one copy.
+template <typename T, int SLOTS = 4>
+class VersionedBuffer {
+    static_assert(SLOTS >= 2, "VersionedBuffer needs a slot to write besides the published one");
+
+    struct alignas(64) Slot {
+        SeqLock<T> value;
+    };
+    Slot slots[SLOTS];
+    alignas(64) std::atomic<uint64_t> latest;
+
+public:
+    VersionedBuffer() : latest(0) {}
+
+    // Single writer at a time
+    void publish(const T& value)
+    {
+        uint64_t v = latest.load(std::memory_order_relaxed) + 1;
+        slots[v % SLOTS].value.store(value);
+        latest.store(v, std::memory_order_release);
+    }
+
+    // Copy the newest value; returns its version (0 = never published)
+    uint64_t read(T& out) const
+    {
+        uint64_t v = latest.load(std::memory_order_acquire);
+        out = slots[v % SLOTS].value.load();
+        return v;
+    }
+
+    uint64_t version() const { return latest.load(std::memory_order_acquire); }
+};
+
+#endif // CONCURRENT_H
@@ -0,0 +1,71 @@
+// ============================================================================
+// include/config.h
+// Run configuration from the command line and optional config files
+// ============================================================================
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything one simulation run needs to know. Defaults keep the original
+// hardcoded setup of 3 instruments, 8 threads and 1000 ticks with every
+// optional feature off, except that each exchange runs 1000 agents rather
+// than one per thread and threads are pinned to CPUs.
+struct SimConfig {
+    int num_instruments;            // Instruments per exchange
+    int num_agents;                 // Agents per exchange, strategies interleaved
+    std::vector<int> agents_per_strategy; // Explicit mix by AgentStrategy; overrides num_agents
+    int num_threads;                // OpenMP threads and exchange lanes
+    int ticks;
+    uint64_t seed;                  // Agent RNG seed (0 = the unseeded streams)
+    int price_staleness;            // Ticks global prices may lag (0 = blocking + barrier)
+    int snapshot_interval;          // >0: delta market data with a snapshot every N ticks
+    bool shard_instruments;         // One market: instruments hosted round-robin, orders routed
+    int rebalance_interval;         // Sharded only: migrate books every N ticks (0 = never)
+    int history_bar_interval;       // Ticks per OHLC bar in the history file
+    std::string replay_file;        // Recorded feed to replay ("" = none)
+    int replay_speed;               // Recorded ticks per simulation tick
+    int checkpoint_interval;        // 0 = never
+    int continuous_matchers;        // >0: match on arrival with this many threads
+    int order_lifetime;             // >0: agent orders are GTD for this many ticks
+    bool pin_threads;               // Bind OpenMP threads to CPUs, books to their threads
+    bool comm_thread;               // Dedicated MPI thread overlapping market data with the tick
+    bool offload;                   // Agent kernels on the OpenMP target device
+    bool restart;                   // Resume from the newest checkpoint
+    std::string output_prefix;      // Prepended to every output file name
+
+    SimConfig() : num_instruments(3), num_agents(1000), num_threads(8), ticks(1000), seed(0),
+                  price_staleness(0), snapshot_interval(0), shard_instruments(false),
+                  rebalance_interval(100), history_bar_interval(1), replay_speed(1),
+                  checkpoint_interval(0), continuous_matchers(0), order_lifetime(0),
+                  pin_threads(true), comm_thread(false), offload(false), restart(false) {}
+
+    int total_agents() const;
+};
+
+// Set one option by name, as used on the command line and in files.
+// Returns false with a message for an unknown key or a bad value.
+bool set_config_value(SimConfig& config, const std::string& key, const std::string& value,
+                      std::string& error);
+
+// Read a config file of "key = value" lines ('#' starts a comment). Lines
+// before the first "[run]" header set defaults; each "[run]" starts a run
+// from those defaults, so one file can describe a whole sweep. A file
+// without headers describes a single run.
+bool load_config_file(const std::string& filename, const SimConfig& defaults,
+                      std::vector<SimConfig>& runs, std::string& error);
+
+// Parse argv: "--config FILE" loads a file, "--key=value" or "--key value"
+// sets an option on every run (overriding the file), "--restart" resumes.
+// Switches (restart, shard, pin-threads, comm-thread, offload) given
+// without a value are turned on.
+// Returns false with a message on error; "--help" fails with the usage text.
+bool parse_command_line(int argc, char** argv, std::vector<SimConfig>& runs, std::string& error);
+
+// One line per option, for --help
+std::string config_usage();
+
+#endif // CONFIG_H
@@ -0,0 +1,110 @@
+// ============================================================================
+// include/continuous.h
+// Continuous double auction: orders matched as they arrive by per-book
+// matcher threads instead of in one batch per tick
+// ============================================================================
+
+#ifndef CONTINUOUS_H
+#define CONTINUOUS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "concurrent.h"
+#include "exchange.h"
+
+// Submit-to-matched latency over the orders matched since the last reset,
+// from a histogram with eight sub-buckets per power of two (so quantiles
+// are within 12.5%)
+struct MatchLatency {
+    long long orders;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+};
+
+// Attaches to an Exchange and takes over booking and matching of its local
+// instruments. Every instrument belongs to one matcher thread
+// (instrument % num_matchers), which is the only writer of that book, so
+// books need no locks. Each submission lane, plus one for orders routed
+// from other ranks, has an SPSC ring to every matcher; submit_order pushes
+// into it and the matcher books the order and crosses the book at once,
+// then publishes the book's MarketSnapshot. Agents read those snapshots
+// while the tick is still running, so orders later in a tick see the
+// effect of earlier ones.
+//
+// process_orders becomes the end-of-tick barrier: it waits for the rings to
+// drain and collects the tick's fills in the usual per-instrument layout,
+// so fill routing, trade logging and checkpoints work unchanged. Fills
+// depend on thread timing (how lanes interleave and how far the matchers
+// are when a snapshot is read); orders from a single lane, submitted
+// without reading snapshots, match exactly as if booked and crossed one at
+// a time.
+class ContinuousEngine {
+private:
+    struct Entry {
+        Order order;
+        uint64_t submit_tsc;
+    };
+
+    // Matcher-owned state of one instrument, on its own cache lines
+    struct alignas(64) InstrumentState {
+        std::vector<Trade> fills;       // This tick's fills
+        long long booked;
+        unsigned long long cycles;
+    };
+
+    static const int LATENCY_BUCKETS = 496;
+    struct alignas(64) Matcher {
+        std::thread thread;
+        std::vector<long long> histogram; // LATENCY_BUCKETS counts of TSC cycles
+        long long orders;
+        unsigned long long total_cycles;
+        uint64_t max_cycles;
+        std::atomic<bool> sleeping;
+    };
+
+    Exchange& exchange;
+    int num_producers;              // Exchange lanes + inbound
+    std::vector<std::unique_ptr<SpscRing<Entry>>> rings; // [producer * matchers + matcher]
+    std::vector<std::unique_ptr<InstrumentState>> instruments;
+    std::vector<std::unique_ptr<Matcher>> matchers;
+    std::atomic<bool> stopping;
+    std::mutex wake_mtx;
+    std::condition_variable wake_cv;
+
+    void matcher_loop(int m);
+    void wake(Matcher& m);
+
+    friend class Exchange;
+    // Called by Exchange::submit_order and inject_order for a local
+    // instrument; blocks while the ring is full
+    void submit(int producer, const Order& order);
+    // Called by Exchange::process_orders: wait until every submitted order
+    // is matched, move the fills into out[instrument] and the load into
+    // the exchange's counters, and expire GTD orders in books the tick
+    // left idle. Returns the number of fills.
+    int complete_tick(int current_tick, std::vector<std::vector<Trade>>& out);
+
+public:
+    // Attach to exchange, which must have no pending orders, and start
+    // num_matchers threads. ring_capacity is per producer and matcher.
+    ContinuousEngine(Exchange& exchange, int num_matchers, size_t ring_capacity = 4096);
+    // Wait for outstanding orders, stop the threads and detach
+    ~ContinuousEngine();
+    ContinuousEngine(const ContinuousEngine&) = delete;
+    ContinuousEngine& operator=(const ContinuousEngine&) = delete;
+
+    int get_num_matchers() const { return (int)matchers.size(); }
+
+    // Between ticks only
+    MatchLatency get_latency() const;
+    void reset_latency();
+};
+
+#endif // CONTINUOUS_H
@@ -0,0 +1,76 @@
+// ============================================================================
+// include/counting_allocator.h
+// Replacement global operator new/delete that count heap allocations
+// ============================================================================
+//
+// Used by the test suite and the benchmarks to check that steady-state
+// paths do not allocate. The replacements are ordinary (non-inline)
+// definitions, so include this header from exactly one translation unit of
+// an executable.
+
+#ifndef COUNTING_ALLOCATOR_H
+#define COUNTING_ALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// Allocations made through operator new since the program started
+static std::atomic<long long> allocation_count(0);
+
+// Every replacement delete frees through these out-of-line helpers.
+// Calling free directly lets GCC inline a delete next to a new-expression
+// and report -Wmismatched-new-delete, although both sides use malloc here.
+#if defined(_MSC_VER)
+#define COUNTING_NOINLINE __declspec(noinline)
+#else
+#define COUNTING_NOINLINE __attribute__((noinline))
+#endif
+
+COUNTING_NOINLINE static void release_allocation(void *p) noexcept
+{
+    std::free(p);
+}
+
+// Windows has no aligned_alloc, and its aligned blocks need their own free
+COUNTING_NOINLINE static void release_aligned_allocation(void *p) noexcept
+{
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void *operator new(std::size_t n)
+{
+    allocation_count++;
+    if (void *p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t n, std::align_val_t al)
+{
+    allocation_count++;
+    std::size_t a = static_cast<std::size_t>(al);
+#if defined(_WIN32)
+    void *p = _aligned_malloc(n ? n : 1, a);
+#else
+    void *p = std::aligned_alloc(a, (n + a - 1) / a * a);
+#endif
+    if (p)
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { release_allocation(p); }
+void operator delete(void *p, std::size_t) noexcept { release_allocation(p); }
+void operator delete(void *p, std::align_val_t) noexcept { release_aligned_allocation(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { release_aligned_allocation(p); }
+
+#endif // COUNTING_ALLOCATOR_H
@@ -7,91 +7,634 @@
 #ifndef EXCHANGE_H
 #define EXCHANGE_H
 
+#include <cstdint>
 #include <vector>
-#include <queue>
-#include <map>
-#include <mutex>
 #include <string>
 #include <fstream>
+#include <memory>
+#include "concurrent.h"
+#include "price_history.h"
+#include "serialize.h"
+#include "statistics.h"
 
-// Order structure representing a buy or sell order
+// What an order-entry message asks of the book
+enum class OrderAction : uint8_t {
+    NEW,        // Rest a new order
+    CANCEL,     // Remove the resting order order_id
+    REPLACE     // Give order_id a new price and volume
+};
+
+// How long an order may rest
+enum class TimeInForce : uint8_t {
+    GTC,        // Good till cancelled
+    IOC,        // Immediate or cancel: what the next match leaves is cancelled
+    GTD         // Good through expire_tick, then retired before the next match
+};
+
+// Order structure representing a buy or sell order as submitted, or a
+// cancel/replace of one. Wide fields first so the struct has no interior
+// padding; one byte of tail padding rounds it up to 40.
 struct Order {
+    double price;           // Limit price
+    long long order_id;     // Unique order identifier; the target of a cancel/replace
     int agent_id;           // ID of the agent placing the order
     int instrument_id;      // Which instrument to trade
-    double price;           // Limit price
     int volume;             // Number of shares
-    bool is_buy;            // true = buy, false = sell
     int timestamp;          // When order was placed
-    int order_id;           // Unique order identifier
+    int expire_tick;        // GTD only: last tick the order may rest
+    bool is_buy;            // true = buy, false = sell
+    OrderAction action;
+    TimeInForce time_in_force;
     
-    Order() : agent_id(0), instrument_id(0), price(0.0), 
-              volume(0), is_buy(true), timestamp(0), order_id(0) {}
+    Order() : price(0.0), order_id(0), agent_id(0), instrument_id(0),
+              volume(0), timestamp(0), expire_tick(0), is_buy(true),
+              action(OrderAction::NEW), time_in_force(TimeInForce::GTC) {}
 };
 
-// Trade structure representing an executed trade
+// Messages for Exchange::submit_order acting on a resting order
+Order make_cancel(int instrument_id, long long order_id, int timestamp);
+Order make_replace(int instrument_id, long long order_id, double price, int volume, int timestamp);
+
+// Trade structure representing an executed trade. Trades are append-only
+// records written into reusable buffers and streamed to disk as raw bytes,
+// so every byte is a field: reserved fills what would otherwise be tail
+// padding and is always written as zero.
 struct Trade {
+    double price;
     int buy_agent_id;
     int sell_agent_id;
     int instrument_id;
-    double price;
     int volume;
     int timestamp;
+    int32_t reserved;
+};
+
+// Matching-critical part of a resting order, stored contiguously in the
+// book. Everything matching does not read lives in OrderInfo, reached
+// through handle, so a cache line holds more than two queued orders.
+struct RestingOrder {
+    long long price_ticks;  // Limit price in ticks
+    uint32_t sequence;      // Arrival number within the book (time priority)
+    int32_t volume;         // Remaining volume
+    uint32_t handle;        // Slot of this order's OrderInfo
+    bool is_buy;
+};
+
+// Cold per-order metadata, indexed by RestingOrder::handle. Side, slot
+// and sequence locate the RestingOrder for a cancel.
+struct OrderInfo {
+    long long order_id;
+    uint64_t slot;          // OrderSlab slot of the RestingOrder
+    uint32_t sequence;
+    int agent_id;
+    int timestamp;
+    int expire_tick;
+    TimeInForce time_in_force;
+    bool is_buy;
+};
+
+static_assert(sizeof(RestingOrder) <= 24, "RestingOrder must stay within 24 bytes");
+static_assert(sizeof(Order) == 40 && sizeof(Trade) == 32, "unexpected size of Order/Trade");
+
+// Price levels per side carried in a MarketSnapshot
+const int SNAPSHOT_DEPTH = 5;
+
+// What agents see of one instrument: the book's state after its latest
+// match cycle, or the remote view for an instrument hosted elsewhere. An
+// empty side has best price 0 and levels past the book's depth volume 0.
+struct MarketSnapshot {
+    double last_price;
+    double best_bid;
+    double best_ask;
+    double stats[NUM_PRICE_STATISTICS];     // Indexed by PriceStatistic
+    double bid_price[SNAPSHOT_DEPTH];       // Best first
+    double ask_price[SNAPSHOT_DEPTH];
+    int32_t bid_volume[SNAPSHOT_DEPTH];
+    int32_t ask_volume[SNAPSHOT_DEPTH];
+    int32_t bid_orders;                     // Resting orders per side
+    int32_t ask_orders;
+    long long traded_volume;                // Since the start of the run
+    int32_t tick;                           // Of the publishing match cycle, -1 between ticks
+    int32_t is_local;
+};
+
+// Default minimum price increment used when an instrument sets none
+const double DEFAULT_TICK_SIZE = 0.01;
+
+// Resting orders are stored in fixed-size chunks, and a price level is a
+// linked list of them. An order's slot, chunk * ORDER_CHUNK_SIZE + index,
+// never changes while it rests.
+const int ORDER_CHUNK_SIZE = 32;
+const uint32_t NO_CHUNK = 0xffffffffu;
+
+struct OrderChunk {
+    RestingOrder orders[ORDER_CHUNK_SIZE];
+    uint32_t next;              // Next chunk of the level, or of the free list
+};
+
+// Chunk pool for one side of a book. Pages are only ever added; a chunk a
+// level has drained goes on an intrusive free list and is reused before
+// the pool grows. Pages are allocated untouched, so with first-touch NUMA
+// placement they land on the node of the thread that books into them.
+// reset() empties the pool in O(1) without visiting any chunk.
+class OrderSlab {
+private:
+    static const uint32_t PAGE_CHUNKS = 256; // ~200 KiB, large enough to be mmapped fresh
+    std::vector<std::unique_ptr<OrderChunk[]>> pages;
+    uint32_t free_head;         // First free chunk, NO_CHUNK if none
+    uint32_t used;              // Chunks handed out since reset, free or not
+
+public:
+    OrderSlab() : free_head(NO_CHUNK), used(0) {}
+    OrderSlab(const OrderSlab& other);
+    OrderSlab& operator=(const OrderSlab& other);
+    OrderSlab(OrderSlab&&) = default;
+    OrderSlab& operator=(OrderSlab&&) = default;
+
+    uint32_t allocate();
+    void release(uint32_t chunk) {
+        at(chunk).next = free_head;
+        free_head = chunk;
+    }
+    void reset() {
+        free_head = NO_CHUNK;
+        used = 0;
+    }
+
+    OrderChunk& at(uint32_t chunk) { return pages[chunk / PAGE_CHUNKS][chunk % PAGE_CHUNKS]; }
+    const OrderChunk& at(uint32_t chunk) const { return pages[chunk / PAGE_CHUNKS][chunk % PAGE_CHUNKS]; }
+    RestingOrder& order(uint64_t slot) { return at((uint32_t)(slot / ORDER_CHUNK_SIZE)).orders[slot % ORDER_CHUNK_SIZE]; }
+    const RestingOrder& order(uint64_t slot) const { return at((uint32_t)(slot / ORDER_CHUNK_SIZE)).orders[slot % ORDER_CHUNK_SIZE]; }
+    // Bytes of chunk storage reserved
+    size_t capacity_bytes() const { return pages.size() * PAGE_CHUNKS * sizeof(OrderChunk); }
 };
 
+// All resting orders at one limit price, kept in arrival (time priority)
+// order as a queue of chunks from the side's OrderSlab. Cancelled orders
+// stay queued with volume 0 until they reach the front, which is always a
+// live order.
+struct PriceLevel {
+    uint32_t head_chunk;        // Chunk holding the front order, NO_CHUNK when empty
+    uint32_t tail_chunk;        // Chunk the next order goes into
+    uint32_t head;              // Index of the front order in head_chunk
+    uint32_t tail;              // Next free index in tail_chunk
+    int total_volume;           // Sum of remaining volume at this price
+
+    PriceLevel() : head_chunk(NO_CHUNK), tail_chunk(NO_CHUNK), head(0), tail(0), total_volume(0) {}
+
+    bool empty() const { return head_chunk == NO_CHUNK; }
+    uint64_t front_slot() const { return (uint64_t)head_chunk * ORDER_CHUNK_SIZE + head; }
+};
+
+// One side of the book as a dense array of price levels indexed by tick
+// offset from base_tick. Level lookup is a single array index and nearby
+// prices stay contiguous in memory; the window grows when a price falls
+// outside it, up to a fixed maximum span, and moves to it when the side
+// holds no orders.
+class PriceLadder {
+private:
+    std::vector<PriceLevel> levels;
+    OrderSlab slab;             // Storage of every order on this side
+    long long base_tick;        // Tick price of levels[0]
+    long long best_tick;        // Best non-empty level, valid when !empty()
+    size_t active_levels;       // Number of non-empty levels
+    bool is_bid;                // Bids: best is the highest tick, asks: lowest
+
+    // Move best_tick to the next non-empty level after it emptied
+    void advance_best();
+    // Pop the front order of level and any cancelled ones behind it,
+    // returning drained chunks to the slab
+    void pop_front(PriceLevel& level);
+
+public:
+    explicit PriceLadder(bool is_bid);
+
+    // Empty all levels and centre a window of width ticks on center_tick.
+    // The slab keeps its pages for the next orders.
+    void reset(long long center_tick, size_t width);
+
+    // Grow the window to cover tick, or recentre it there while the side is
+    // empty. Returns false, leaving the window as it was, if that would
+    // exceed the maximum span.
+    bool ensure_range(long long tick);
+
+    bool empty() const { return active_levels == 0; }
+    long long best() const { return best_tick; }
+    PriceLevel& best_level() { return levels[best_tick - base_tick]; }
+    RestingOrder& front(const PriceLevel& level) { return slab.order(level.front_slot()); }
+    size_t level_count() const { return active_levels; }
+    size_t capacity_bytes() const { return slab.capacity_bytes() + levels.capacity() * sizeof(PriceLevel); }
+
+    // Append an order to the back of the level for its price_ticks, which
+    // ensure_range must accept; returns its slot
+    uint64_t push(const RestingOrder& order);
+    // Remove the filled front order of the best level, moving best to the
+    // next non-empty level if this one empties
+    void pop_best_front();
+    // The order in slot if it is still resting there: sequence tells it
+    // apart from a later order reusing the slot
+    const RestingOrder* find(uint64_t slot, uint32_t sequence) const;
+    // Remove the order in slot, wherever it is queued. Returns false if it
+    // has already left the book.
+    bool cancel(uint64_t slot, uint32_t sequence, RestingOrder& removed);
+    // Lower the volume of the order in slot, keeping its priority;
+    // new_volume must be positive and not above the current one
+    bool reduce(uint64_t slot, uint32_t sequence, int new_volume);
+
+    // Up to n non-empty levels from the best outwards; returns how many
+    int top_levels(int n, long long* ticks, int* volumes) const;
+
+    // Visit every resting order from the lowest tick up, each level in
+    // time priority order
+    template <typename F>
+    void for_each(F visit) const {
+        for (const auto &level : levels)
+        {
+            uint32_t chunk = level.head_chunk;
+            uint32_t i = level.head;
+            while (chunk != NO_CHUNK)
+            {
+                const OrderChunk& c = slab.at(chunk);
+                uint32_t end = chunk == level.tail_chunk ? level.tail : ORDER_CHUNK_SIZE;
+                for (; i < end; ++i)
+                    if (c.orders[i].volume > 0)
+                        visit(c.orders[i]);
+                chunk = chunk == level.tail_chunk ? NO_CHUNK : c.next;
+                i = 0;
+            }
+        }
+    }
+};
+
+// order_id -> OrderInfo handle by open addressing with linear probing.
+// Erasing shifts the rest of the probe run back instead of leaving
+// tombstones, so lookups stay short however many orders come and go.
+// Order ID 0 cannot be stored.
+class OrderIndex {
+private:
+    struct Entry {
+        long long key;          // 0 = empty
+        uint32_t value;
+    };
+    std::vector<Entry> table;   // Power-of-two size, at most half full
+    int shift;                  // 64 - log2(table size)
+    size_t count;
+
+    size_t home(long long key) const {
+        return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+    void grow();
+
+public:
+    OrderIndex();
+    // Remove every entry, keeping the table
+    void clear();
+    // Insert or overwrite
+    void insert(long long key, uint32_t value);
+    bool find(long long key, uint32_t& value) const;
+    void erase(long long key);
+    size_t size() const { return count; }
+};
+
+// GTD order or IOC remainder to retire, located by side, slot and sequence
+struct PendingRetire {
+    uint64_t slot;
+    uint32_t sequence;
+    int retire_tick;
+    bool is_buy;
+};
+
+// Ticks covered by the GTD expiry wheel. Orders due further out share a
+// slot and are skipped until their tick comes round.
+const int EXPIRY_WHEEL_SLOTS = 256;
+
 // Order book for a single instrument
 class OrderBook {
 private:
-    // Priority queues for bids (buy orders) and asks (sell orders)
-    // Bids sorted high to low, asks sorted low to high
-    std::vector<Order> bids;
-    std::vector<Order> asks;
+    int instrument_id;          // Stamped on every trade from this book
+
+    // Prices are held as integer ticks of tick_size. Bids are snapped down
+    // and asks up, so snapping never makes an order more aggressive.
+    double tick_size;
+    PriceLadder bids;
+    PriceLadder asks;
+    size_t resting_bids;        // Number of resting buy orders
+    size_t resting_asks;        // Number of resting sell orders
+    
+    // Side table of cold order data; slots of filled orders are reused
+    std::vector<OrderInfo> order_info;
+    std::vector<uint32_t> free_slots;
+    uint32_t next_sequence;
+    
+    OrderIndex index;           // order_id -> handle of resting orders
+    
+    // GTD orders by the tick they retire on, modulo EXPIRY_WHEEL_SLOTS
+    std::vector<std::vector<PendingRetire>> expiry_wheel;
+    int expired_through;        // Every GTD order due by this tick is gone
+    std::vector<PendingRetire> ioc_pending; // IOC orders booked since the last match
+    long long cancelled_orders; // Explicit cancels and IOC remainders
+    long long expired_orders;   // GTD orders retired by the wheel or on arrival
+    
+    uint32_t acquire_slot(const Order& order);
+    void release_slot(uint32_t handle);
+    // Queue an order on its side and record where it went
+    void rest(const RestingOrder& o);
+    bool cancel_at(bool is_buy, uint64_t slot, uint32_t sequence);
+    // Finite and small enough to convert to ticks
+    bool is_bookable(double price) const;
     
     double last_price;
-    std::vector<double> price_history;
+    PriceHistory history;       // Trade columns and OHLC bars
+    PriceStatistics stats;      // Updated as each trade is appended
     
 public:
-    OrderBook() : last_price(100.0) {
-        price_history.push_back(last_price);
-    }
+    explicit OrderBook(double tick_size = DEFAULT_TICK_SIZE, double initial_price = 100.0);
+    // Return to the freshly constructed state, keeping allocated storage
+    void reset(double tick_size, double initial_price = 100.0);
     
-    void add_order(const Order& order);
+    void set_instrument_id(int id) { instrument_id = id; }
+    int get_instrument_id() const { return instrument_id; }
+    
+    // Snap to a tick and append to that price level: O(1) amortized. An
+    // IOC order is cancelled by the next match_orders; a GTD order whose
+    // expire_tick has already passed is dropped. Returns false if the order
+    // was not booked: no volume, already expired, or a price that is not
+    // finite or lies beyond the span the ladder may cover.
+    bool add_order(const Order& order);
+    // Remove a resting order by ID: O(1) through the order index, leaving
+    // a gap in its level that matching skips. Returns false if no order
+    // with that ID is resting.
+    bool cancel_order(long long order_id);
+    // Change a resting order's price and volume. Lowering the volume at
+    // the same price keeps its time priority; anything else requeues it at
+    // the back under the same ID. Volume <= 0 cancels. Returns false if
+    // the order is not resting or the new price cannot be booked, which
+    // leaves it unchanged.
+    bool replace_order(long long order_id, double price, int volume, int timestamp);
+    // Book a submitted message according to its action
+    bool apply(const Order& order);
+    // Retire GTD orders whose expire_tick is before current_tick, for every
+    // tick since the last call. Returns the number retired.
+    int expire_orders(int current_tick);
+    // Cross the book while best bid >= best ask: O(fills). Fills are
+    // appended to trades, which the caller reuses across ticks; returns the
+    // number of fills
+    int match_orders(int current_tick, std::vector<Trade>& trades);
+    // Convenience overload returning this call's fills in a new vector
     std::vector<Trade> match_orders(int current_tick);
     double get_last_price() const { return last_price; }
-    double get_historical_average() const;
-    const std::vector<double>& get_price_history() const { return price_history; }
+    double get_historical_average() const { return stats.mean(); }
+    double get_statistic(PriceStatistic stat) const { return stats.get(stat); }
+    const PriceStatistics& get_statistics() const { return stats; }
+    const PriceHistory& get_price_history() const { return history; }
+    void reserve_history(size_t trades) { history.reserve(trades); }
+    // Bar width in ticks and whether per-trade columns are kept; only
+    // before the first trade
+    bool set_history_options(int bar_interval, bool keep_trades) { return history.configure(bar_interval, keep_trades); }
+
+    // Tick size may only change while the book holds no resting orders
+    bool set_tick_size(double tick);
+    double get_tick_size() const { return tick_size; }
+    long long price_to_ticks(double price, bool is_buy) const;
+    double ticks_to_price(long long ticks) const { return ticks * tick_size; }
+
+    // Top of book queries, O(1). Return false when that side is empty
+    bool get_best_bid(double& price) const;
+    bool get_best_ask(double& price) const;
+    size_t bid_depth() const { return resting_bids; }
+    size_t ask_depth() const { return resting_asks; }
+    size_t bid_levels() const { return bids.level_count(); }
+    size_t ask_levels() const { return asks.level_count(); }
+    // Top of book, depth, last price and statistics for a MarketSnapshot
+    void fill_snapshot(MarketSnapshot& out) const;
+    // Bytes reserved for resting orders and levels on both sides; storage
+    // freed by fills and cancels is reused before this grows
+    size_t capacity_bytes() const { return bids.capacity_bytes() + asks.capacity_bytes(); }
+    const OrderInfo& get_order_info(uint32_t handle) const { return order_info[handle]; }
+    // Remaining volume of a resting order, 0 if it is not resting
+    int get_order_volume(long long order_id) const;
+    long long get_cancelled_count() const { return cancelled_orders; }
+    long long get_expired_count() const { return expired_orders; }
+    
+    // Full book state: resting orders with their priority, last price,
+    // price history and statistics. Restoring yields a book that matches
+    // exactly as the original would; the ladder window and order handles
+    // are rebuilt rather than copied.
+    void serialize(ByteWriter& out) const;
+    bool deserialize(ByteReader& in);
+};
+
+// Order IDs handed to a submission lane at a time
+const long long ORDER_ID_BLOCK = 4096;
+// Order IDs carry the submitting rank above this bit so they stay unique
+// when orders are routed between exchanges
+const int ORDER_ID_RANK_SHIFT = 40;
+
+// Market view of an instrument hosted on another rank
+struct MarketQuote {
+    double price;
+    double mean;
+    double ewma;
+    double sma;
+    double vwap;
 };
 
+// Pending orders from one submitting thread, bucketed by instrument so each
+// book can collect its own orders without a shared routing pass. Only the
+// owning thread appends during order generation and process_orders drains it
+// after the parallel region has joined, so neither side needs a lock or
+// atomics. Each lane sits on its own cache line so neighbouring threads
+// never falsely share.
+struct alignas(64) OrderLane {
+    std::vector<std::vector<Order>> by_instrument; // FIFO per instrument
+    long long next_sequence;    // Orders this lane has numbered so far
+
+    OrderLane() : next_sequence(0) {}
+};
+
+class TradeLogWriter;
+class ContinuousEngine;
+
 // Main exchange class managing multiple instruments
 class Exchange {
 private:
     int rank;                                    // MPI rank of this exchange
     int num_instruments;                         // Number of instruments traded
     std::vector<OrderBook> order_books;         // One order book per instrument
-    std::queue<Order> pending_orders;           // Thread-safe order queue
-    std::mutex order_mutex;                     // Protects pending orders
-    std::vector<Trade> trade_log;               // All executed trades
-    int next_order_id;                          // Counter for unique order IDs
+    std::vector<OrderLane> lanes;               // One submission lane per thread
+    std::vector<std::vector<Trade>> tick_trades; // Per-instrument fills this tick
+    std::vector<Trade> trade_log;               // All executed trades (when not streaming)
+    TradeLogWriter* trade_sink;                 // Streaming destination, if any
+    std::vector<int> owners;                    // Hosting rank per instrument; empty = all local
+    OrderLane inbound;                          // Orders routed in from other ranks
+    std::vector<MarketQuote> remote_quotes;     // Latest view of non-local instruments
+    std::vector<unsigned long long> match_cycles; // TSC cycles booking and matching, per instrument
+    std::vector<long long> booked_orders;       // Orders booked per instrument
+    ContinuousEngine* continuous;               // Matches on arrival when attached
+    // Published view of every instrument; each is written only by the
+    // thread matching that book (or between ticks) and read by anyone
+    std::unique_ptr<VersionedBuffer<MarketSnapshot>[]> snapshots;
+    int snapshot_count;
+    
+    // Home threads from place_books: instruments grouped by the thread
+    // that matches them first, with one claim cursor per group
+    struct alignas(64) HomeCursor {
+        std::atomic<int> next;
+    };
+    std::vector<int> home_order;
+    std::vector<int> home_begin;                // Group t is [home_begin[t], home_begin[t + 1]); empty = unplaced
+    std::unique_ptr<HomeCursor[]> home_cursors;
+    
+    void publish_snapshot(int instrument_id, int tick);
+    // Book one instrument's pending orders and match it; returns the fills
+    int match_book(int instrument_id, int current_tick);
+    
+    friend class ContinuousEngine;
     
 public:
-    Exchange(int rank, int num_instruments);
+    // num_lanes defaults to omp_get_max_threads() and must cover every
+    // thread that will call submit_order
+    Exchange(int rank, int num_instruments, double tick_size = DEFAULT_TICK_SIZE,
+             int num_lanes = 0);
+    
+    // Start over with a new instrument and lane count, as for the next run
+    // of a sweep. Books, lanes and buffers are emptied in place, so storage
+    // allocated by earlier runs is reused. The trade sink is detached. A
+    // ContinuousEngine must be destroyed first.
+    void reset(int num_instruments, double tick_size = DEFAULT_TICK_SIZE, int num_lanes = 0);
+    
+    // Give every instrument a home OpenMP thread (home_thread[i], e.g.
+    // AgentEngine::home_threads). The empty books are rebuilt on their home
+    // threads so their memory is first touched there, and batch matching
+    // then has each thread take its own books before helping with others'.
+    // Call right after reset, outside a parallel region, with pinned
+    // threads (pin_threads) for the placement to stick. Fails on a size
+    // mismatch.
+    bool place_books(const std::vector<int>& home_thread);
+    
+    // Per-instrument tick size; fails once the instrument has resting orders
+    bool set_tick_size(int instrument_id, double tick);
+    
+    // Lock-free order submission into the calling OpenMP thread's lane.
+    // Returns the assigned order ID, or 0 if the instrument or lane does
+    // not exist (the order is dropped). A lane has a single producer: at
+    // any moment at most one thread may submit into it, so a team wider
+    // than get_num_lanes(), or several threads outside OpenMP (which all
+    // map to lane 0), must pass distinct lanes explicitly. IDs come from
+    // per-lane blocks of
+    // ORDER_ID_BLOCK, so they are unique and depend only on the lane and
+    // its submission count, never on thread timing. With a ContinuousEngine
+    // attached, orders for local instruments go straight to their matcher.
+    // Cancel and replace messages (make_cancel, make_replace) keep the
+    // order ID they target and take effect in booking order with the
+    // instrument's other orders, so one for an order that has not been
+    // booked yet, or is already filled, does nothing.
+    long long submit_order(const Order& order);
+    long long submit_order(const Order& order, int lane);
+    int get_num_lanes() const { return (int)lanes.size(); }
     
-    // Thread-safe order submission
-    void submit_order(const Order& order);
+    // Instrument sharding. owners[i] is the rank hosting instrument i; only
+    // hosted instruments are matched here, and orders submitted for the
+    // others wait in the lanes until collect_remote_orders takes them.
+    // Every rank must install the same table. Fails if the size does not
+    // match the instrument count.
+    bool set_instrument_owners(const std::vector<int>& owners);
+    int get_owner(int instrument_id) const { return owners.empty() ? rank : owners[instrument_id]; }
+    bool is_local(int instrument_id) const { return owners.empty() || owners[instrument_id] == rank; }
+    // Move every pending order for a non-local instrument into per_rank
+    // (indexed by owner), in instrument then lane order. per_rank must
+    // have one entry per rank; existing contents are kept.
+    void collect_remote_orders(std::vector<std::vector<Order>>& per_rank);
+    // Queue an order routed from another rank, keeping its order ID. Routed
+    // orders are booked after the local lanes. Returns the order ID, or 0
+    // if the instrument is not hosted here.
+    long long inject_order(const Order& order);
+    // Market view for instruments hosted elsewhere; get_price and
+    // get_statistic answer from it for non-local instruments
+    void set_remote_quotes(const std::vector<MarketQuote>& quotes);
     
-    // Process all pending orders and execute trades
+    // Hand an instrument to another rank. If it was hosted here its book is
+    // replaced by an empty one and its last quote kept as the remote view;
+    // the new host must import_book the serialized state. Call between
+    // ticks, when no orders are pending.
+    bool set_owner(int instrument_id, int owner);
+    // Serialize a hosted book for migration
+    bool export_book(int instrument_id, std::vector<char>& out) const;
+    // Replace a hosted book with migrated state
+    bool import_book(int instrument_id, const char* data, size_t size);
+    
+    // Per-instrument matching load accumulated by process_orders since the
+    // last reset_load_counters
+    unsigned long long get_match_cycles(int instrument_id) const { return match_cycles[instrument_id]; }
+    long long get_booked_orders(int instrument_id) const { return booked_orders[instrument_id]; }
+    void reset_load_counters();
+    
+    // Complete exchange state for checkpointing: every book, the lane
+    // order-ID sequences, the owner table, remote quotes, load counters and
+    // the in-memory trade log. Call between ticks, when no orders are
+    // pending; the restoring exchange must have the same instrument and
+    // lane counts.
+    void serialize(ByteWriter& out) const;
+    bool deserialize(ByteReader& in);
+    
+    // Book all pending orders and execute trades. Instruments are matched in
+    // parallel across the OpenMP team with dynamic scheduling (home thread
+    // first, then work stealing, after place_books); each book takes
+    // its orders lane by lane in lane order and fills are appended to the
+    // trade log in instrument order, so the result is deterministic for a
+    // given seed whatever the thread count. Must be called outside a
+    // parallel region. With a ContinuousEngine attached the orders have
+    // already been matched; this waits for the matchers to finish and
+    // collects the tick's fills.
     int process_orders(int current_tick);
+    ContinuousEngine* get_continuous() const { return continuous; }
     
-    // Market data queries
+    // Wait-free copy of an instrument's latest MarketSnapshot, safe from
+    // any thread while matching runs. Returns the snapshot version, which
+    // advances with every publication (0 for an unknown instrument).
+    uint64_t read_snapshot(int instrument_id, MarketSnapshot& out) const;
+    
+    // Market data queries. These read the books directly, so call them
+    // between match cycles; agents use read_snapshot
     double get_price(int instrument_id) const;
     double get_historical_average(int instrument_id) const;
+    double get_statistic(int instrument_id, PriceStatistic stat) const;
     std::vector<double> get_all_prices() const;
+    void get_all_prices(std::vector<double>& prices) const;
+    // Volume traded per instrument in the most recent process_orders call
+    void get_tick_volumes(std::vector<int>& volumes) const;
     
     // Update with global market information from other exchanges
     void update_global_prices(const std::vector<double>& global_prices, int local_rank);
     
+    int get_num_instruments() const { return num_instruments; }
+    const OrderBook& get_order_book(int instrument_id) const { return order_books[instrument_id]; }
+    const std::vector<Trade>& get_trade_log() const { return trade_log; }
+    // Stream fills to sink instead of keeping them in the trade log, so
+    // memory stays flat on long runs. The sink must outlive the exchange's
+    // use of it; nullptr restores the in-memory log.
+    void set_trade_sink(TradeLogWriter* sink) { trade_sink = sink; }
+    // Resting orders across all books (both sides)
+    size_t total_resting_orders() const;
+    // GTD orders retired across all books
+    long long total_expired_orders() const;
+    // Pre-size the trade log and price histories for a run of known length
+    // so that recording fills never reallocates inside the tick loop
+    void reserve_history(size_t trades_per_instrument);
+    // Apply OrderBook::set_history_options to every book
+    bool set_history_options(int bar_interval, bool keep_trades);
+    // Fills for one instrument from the most recent process_orders call
+    const std::vector<Trade>& get_instrument_trades(int instrument_id) const { return tick_trades[instrument_id]; }
+    
     // Export results
     void export_trade_log(const std::string& filename) const;
+    // One row per bar with the close of every instrument, carried forward
+    // over bars without trades
     void export_price_history(const std::string& filename) const;
+    // Collective over MPI_COMM_WORLD: every rank writes the bars of the
+    // instruments it hosts into one shared file with MPI-IO (format in
+    // price_history.h). Returns false on an I/O error on this rank.
+    bool write_history(const std::string& filename) const;
 };
 
 #endif // EXCHANGE_H
@@ -0,0 +1,90 @@
+// ============================================================================
+// include/instrumentation.h
+// Per-tick, per-rank phase timings and counters for the simulation loop
+// Build with -DTRADING_INSTRUMENTATION=ON to enable; otherwise every
+// INSTRUMENT(...) statement compiles to nothing
+// ============================================================================
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "utils.h"
+
+#ifdef TRADING_INSTRUMENTATION
+#define INSTRUMENT(stmt) stmt
+#else
+#define INSTRUMENT(stmt)
+#endif
+
+// The four phases of one simulation tick
+enum class Phase : int {
+    AGENT_GENERATION,
+    PROCESS_ORDERS,
+    BROADCAST_PRICES,
+    BARRIER
+};
+
+const int NUM_PHASES = 4;
+
+// What happened on one rank during one tick. Fixed-size so timelines can be
+// written and read back as a flat array.
+struct TickRecord {
+    int32_t tick;
+    int32_t rank;
+    uint64_t phase_start[NUM_PHASES];   // TSC cycles since the profiler epoch
+    uint64_t phase_cycles[NUM_PHASES];  // TSC cycles spent in each phase
+    int64_t orders;                     // Orders enqueued this tick
+    int64_t book_depth;                 // Resting orders after matching
+    int64_t fills;                      // Trades executed this tick
+    int64_t bytes;                      // Market data bytes sent this tick
+};
+
+// Phase names as used in timeline output
+const char* phase_name(Phase phase);
+
+// Collects one TickRecord per tick using raw TSC reads, so a phase costs two
+// rdtsc instructions. Records are preallocated for the expected run length.
+class TickProfiler {
+private:
+    int rank;
+    uint64_t epoch;                     // TSC value at construction
+    std::vector<TickRecord> records;
+    TickRecord current;
+
+public:
+    // Construct on every rank right after a barrier so epochs line up
+    TickProfiler(int rank, size_t expected_ticks);
+
+    void begin_tick(int tick);
+    void begin_phase(Phase phase) {
+        current.phase_start[(int)phase] = read_tsc() - epoch;
+    }
+    void end_phase(Phase phase) {
+        current.phase_cycles[(int)phase] = read_tsc() - epoch - current.phase_start[(int)phase];
+    }
+    void set_counters(long long orders, long long book_depth, long long fills, long long bytes);
+    void end_tick() { records.push_back(current); }
+
+    const std::vector<TickRecord>& get_records() const { return records; }
+
+    // Compact binary timeline: a TimelineHeader followed by the records
+    bool write_binary(const std::string& filename) const;
+    // Chrome trace event JSON (chrome://tracing, Perfetto); pid is the rank
+    bool write_chrome_trace(const std::string& filename) const;
+};
+
+// Header of a binary timeline file
+struct TimelineHeader {
+    char magic[8];                      // "TSPROF01"
+    uint32_t record_size;               // sizeof(TickRecord)
+    uint32_t num_phases;
+    double cycles_per_ns;
+    int32_t rank;
+    int32_t reserved;
+    uint64_t num_records;
+};
+
+#endif // INSTRUMENTATION_H
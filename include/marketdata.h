@@ -7,13 +7,57 @@
 #define MARKETDATA_H
 
 #include <mpi.h>
+#include <cstdint>
 #include <vector>
 
+// One changed instrument as published by a rank. The sequence number counts
+// publications of that instrument by its rank, snapshots included.
+struct PriceUpdate {
+    int32_t instrument_id;
+    int32_t volume;             // Volume traded on the publishing rank this tick
+    double price;
+    uint64_t seq;
+};
+
+static_assert(sizeof(PriceUpdate) == 24, "PriceUpdate is sent as raw bytes");
+
+// One non-blocking price reduction in flight
+struct PendingReduction {
+    std::vector<double> send;   // Local prices, kept alive until completion
+    std::vector<double> recv;   // Summed prices
+    MPI_Request request;
+    bool active;
+};
+
 // Manages market data synchronization across MPI ranks
 class MarketDataManager {
 private:
     int rank;           // This process's rank
     int size;           // Total number of processes
+    long long bytes_sent; // Payload bytes contributed to collectives
+    
+    // Asynchronous mode: ring of staleness + 1 reductions, oldest at head
+    int staleness;
+    std::vector<PendingReduction> pending;
+    int head;
+    int in_flight;
+    
+    // Delta mode: last published local prices, and every rank's latest
+    // price and volume per instrument (rank-major)
+    int snapshot_interval;
+    long long publications;
+    std::vector<double> published;
+    std::vector<uint64_t> seqs;
+    std::vector<double> rank_prices;
+    std::vector<int> rank_volumes;
+    std::vector<PriceUpdate> outgoing;
+    std::vector<PriceUpdate> incoming;
+    std::vector<int> counts, displs;
+    std::vector<unsigned char> touched;
+    std::vector<int> touched_ids;
+    
+    // Wait for the reduction at head and write its average out
+    void complete_oldest(std::vector<double>& global_prices);
     
 public:
     MarketDataManager(int rank, int size);
@@ -21,6 +65,55 @@ public:
     // Broadcast local prices to all other exchanges and receive theirs
     // Returns aggregated price information from all exchanges
     std::vector<double> broadcast_prices(const std::vector<double>& local_prices);
+    // Same, writing into a caller-owned buffer that is reused across ticks
+    void broadcast_prices(const std::vector<double>& local_prices,
+                          std::vector<double>& global_prices);
+    
+    // Number of ticks global prices may lag behind local ones. 0 (default)
+    // keeps the blocking exchange; with N > 0 exchange_prices posts an
+    // MPI_Iallreduce and consumes the one posted N ticks earlier, so the
+    // reduction overlaps the next N ticks of agent generation and matching.
+    // Must not be changed while reductions are in flight.
+    void set_staleness(int ticks);
+    int get_staleness() const { return staleness; }
+    
+    // Start reducing this tick's prices. If the reduction posted staleness
+    // ticks ago exists, wait for it, write its average into global_prices
+    // and return true; during the first staleness ticks return false and
+    // leave global_prices untouched. With staleness 0 this is
+    // broadcast_prices and always returns true.
+    bool exchange_prices(const std::vector<double>& local_prices,
+                         std::vector<double>& global_prices);
+    // Give MPI a chance to advance in-flight reductions between phases
+    void progress();
+    int get_in_flight() const { return in_flight; }
+    // Complete every in-flight reduction, leaving the most recent average in
+    // global_prices. Call before MPI_Finalize; returns false if none was
+    // in flight.
+    bool drain(std::vector<double>& global_prices);
+    
+    // Delta mode: every snapshot_interval publications a full snapshot is
+    // sent, otherwise only instruments whose price moved since the last
+    // publication (default 100; the first publication is always a snapshot)
+    void set_snapshot_interval(int ticks);
+    int get_snapshot_interval() const { return snapshot_interval; }
+    // Publish this rank's changed instruments and apply every rank's
+    // updates with one MPI_Allgatherv, so the bytes moved scale with market
+    // activity rather than instrument count. global_prices holds the average
+    // of the latest price from every rank, recomputed only for instruments
+    // that changed, so pass the same buffer every tick. tick_volumes may be
+    // empty; a nonzero volume publishes the instrument even if its price
+    // did not move. Blocking; returns the number
+    // of updates received from all ranks.
+    int publish_deltas(const std::vector<double>& local_prices,
+                       const std::vector<int>& tick_volumes,
+                       std::vector<double>& global_prices);
+    // Latest update of one instrument from one rank as seen by delta mode
+    double get_rank_price(int source_rank, int instrument_id) const;
+    int get_rank_volume(int source_rank, int instrument_id) const;
+    
+    // Running total of payload bytes this rank has sent
+    long long get_bytes_sent() const { return bytes_sent; }
     
     // Synchronize all exchanges at a barrier point
     void synchronize();
@@ -0,0 +1,77 @@
+// ============================================================================
+// include/offload.h
+// Agent strategy kernels on an OpenMP target device
+// Agent state stays resident on the device; each tick uploads the prices,
+// runs every kernel there and copies back only the packed order batch
+// ============================================================================
+
+#ifndef OFFLOAD_H
+#define OFFLOAD_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One order produced on the device
+struct DeviceOrder {
+    double price;
+    int32_t agent_id;
+    int32_t volume;
+    int32_t instrument_id;
+    int32_t is_buy;
+};
+
+// Device-resident copy of an AgentEngine population running the built-in
+// strategy kernels. The batch holds every slot's orders in slot order, the
+// primary order then a two-sided strategy's ask. A strategy's order count
+// is fixed, so each slot's place in the batch is computed once in load()
+// and the device packs the batch without a scan.
+//
+// Only a TRADING_OFFLOAD build maps anything to a device. The device is
+// the OpenMP default device; without one the target regions run on the
+// host, with the same results.
+class AgentOffload {
+private:
+    int device;
+    int num_slots;
+    int num_instruments;
+    int num_orders;
+    // Host copies of the mapped arrays
+    std::vector<int> ids;
+    std::vector<double> thresholds;
+    std::vector<unsigned char> strategy;    // AgentStrategy of each slot
+    std::vector<int> instrument;
+    std::vector<int> first_order;           // Batch index of each slot's first order, plus the total
+    std::vector<double> inputs;             // Prices, then references by (strategy, instrument)
+    std::vector<DeviceOrder> batch;
+    bool mapped;
+
+    void unmap();
+
+public:
+    AgentOffload();
+    ~AgentOffload();
+    AgentOffload(const AgentOffload&) = delete;
+    AgentOffload& operator=(const AgentOffload&) = delete;
+
+    // Built with TRADING_OFFLOAD
+    static bool available();
+    // Banner text: the device used, or why the kernels stay on the host
+    static std::string describe();
+
+    // Copy a population to the device, replacing the previous one. Slot i
+    // has ids[i], thresholds[i], strategy_of[i] and instrument_of[i].
+    void load(const int* ids, const double* thresholds, const std::vector<unsigned char>& strategy_of,
+              const std::vector<int>& instrument_of, int num_instruments);
+    bool is_loaded() const { return mapped; }
+
+    // One tick of every kernel. prices has one entry per instrument and
+    // references one per (strategy, instrument), strategy-major, as in
+    // AgentEngine. Returns the batch.
+    const std::vector<DeviceOrder>& run(uint64_t seed, uint64_t tick, const double* prices,
+                                        const double* references);
+    // Batch index of slot's first order; order_begin(num slots) is the total
+    int order_begin(int slot) const { return first_order[slot]; }
+};
+
+#endif // OFFLOAD_H
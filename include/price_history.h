@@ -0,0 +1,233 @@
+// ============================================================================
+// include/price_history.h
+// Columnar per-instrument trade history with OHLC bars
+// ============================================================================
+
+#ifndef PRICE_HISTORY_H
+#define PRICE_HISTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "serialize.h"
+
+#if defined(_WIN32)
+#include <cstdlib>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Growable array of trivially copyable values backed by an anonymous memory
+// mapping. Pages are committed only when first written and growth remaps
+// instead of copying, so long histories never need one contiguous copy.
+// Falls back to realloc where mmap is unavailable.
+template <typename T>
+class MappedColumn {
+    static_assert(std::is_trivially_copyable<T>::value, "columns hold raw values");
+
+private:
+    T* ptr;
+    size_t count;
+    size_t capacity;            // Elements that fit in the current mapping
+
+    void grow(size_t min_capacity);
+    void release();
+
+public:
+    MappedColumn() : ptr(nullptr), count(0), capacity(0) {}
+    ~MappedColumn() { release(); }
+    MappedColumn(const MappedColumn& other) : ptr(nullptr), count(0), capacity(0) { assign(other.ptr, other.count); }
+    MappedColumn(MappedColumn&& other) noexcept : ptr(other.ptr), count(other.count), capacity(other.capacity) {
+        other.ptr = nullptr;
+        other.count = other.capacity = 0;
+    }
+    MappedColumn& operator=(const MappedColumn& other) {
+        if (this != &other)
+            assign(other.ptr, other.count);
+        return *this;
+    }
+    MappedColumn& operator=(MappedColumn&& other) noexcept {
+        if (this != &other) {
+            release();
+            ptr = other.ptr;
+            count = other.count;
+            capacity = other.capacity;
+            other.ptr = nullptr;
+            other.count = other.capacity = 0;
+        }
+        return *this;
+    }
+
+    void push_back(const T& v) {
+        if (count == capacity)
+            grow(count + 1);
+        ptr[count++] = v;
+    }
+    void reserve(size_t n) {
+        if (n > capacity)
+            grow(n);
+    }
+    // Replace the contents with n raw elements (source may be unaligned)
+    void assign(const void* src, size_t n) {
+        count = 0;
+        reserve(n);
+        if (n)
+            std::memcpy(ptr, src, n * sizeof(T));
+        count = n;
+    }
+    void clear() { count = 0; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T* data() const { return ptr; }
+    T& operator[](size_t i) { return ptr[i]; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    T& back() { return ptr[count - 1]; }
+    const T& back() const { return ptr[count - 1]; }
+};
+
+template <typename T>
+void MappedColumn<T>::grow(size_t min_capacity)
+{
+    size_t want = capacity ? capacity * 2 : 1;
+    if (want < min_capacity)
+        want = min_capacity;
+#if defined(_WIN32)
+    T* p = static_cast<T*>(std::realloc(ptr, want * sizeof(T)));
+    if (!p)
+        throw std::bad_alloc();
+    ptr = p;
+    capacity = want;
+#else
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = (want * sizeof(T) + page - 1) / page * page;
+    void* p;
+    if (ptr) {
+#if defined(__linux__)
+        p = mremap(ptr, (capacity * sizeof(T) + page - 1) / page * page, bytes, MREMAP_MAYMOVE);
+#else
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (p != MAP_FAILED) {
+            std::memcpy(p, ptr, count * sizeof(T));
+            munmap(ptr, (capacity * sizeof(T) + page - 1) / page * page);
+        }
+#endif
+    } else {
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    }
+    if (p == MAP_FAILED)
+        throw std::bad_alloc();
+    ptr = static_cast<T*>(p);
+    capacity = bytes / sizeof(T);
+#endif
+}
+
+template <typename T>
+void MappedColumn<T>::release()
+{
+    if (!ptr)
+        return;
+#if defined(_WIN32)
+    std::free(ptr);
+#else
+    static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    munmap(ptr, (capacity * sizeof(T) + page - 1) / page * page);
+#endif
+    ptr = nullptr;
+    count = capacity = 0;
+}
+
+// Price summary of one bar of bar_interval ticks
+struct OhlcBar {
+    int32_t tick;               // First tick of the bar
+    int32_t trades;
+    int64_t volume;
+    double open;
+    double high;
+    double low;
+    double close;
+};
+
+static_assert(sizeof(OhlcBar) == 48, "OhlcBar is written as raw bytes");
+
+// Executed trades of one instrument as separate tick, price and volume
+// columns, plus OHLC bars. Downsampling: bars can span several ticks, and
+// the per-trade columns can be switched off so only bars are kept.
+class PriceHistory {
+private:
+    double initial_price;
+    int bar_interval;
+    bool keep_trades;
+    MappedColumn<int32_t> ticks;
+    MappedColumn<double> prices;
+    MappedColumn<int32_t> volumes;
+    MappedColumn<OhlcBar> bars;
+
+public:
+    explicit PriceHistory(double initial_price = 100.0, int bar_interval = 1, bool keep_trades = true);
+
+    // Ticks must be non-decreasing
+    void add_trade(int tick, double price, int volume);
+    // Only while empty; returns false otherwise or for interval < 1
+    bool configure(int bar_interval, bool keep_trades);
+    // Back to a fresh history with default options, keeping the mappings
+    void clear(double initial_price);
+    void reserve(size_t trades);
+
+    double get_initial_price() const { return initial_price; }
+    int get_bar_interval() const { return bar_interval; }
+    bool keeps_trades() const { return keep_trades; }
+
+    // Per-trade columns (empty when keep_trades is off)
+    size_t size() const { return prices.size(); }
+    const int32_t* tick_data() const { return ticks.data(); }
+    const double* price_data() const { return prices.data(); }
+    const int32_t* volume_data() const { return volumes.data(); }
+    double price(size_t i) const { return prices[i]; }
+
+    size_t bar_count() const { return bars.size(); }
+    const OhlcBar* bar_data() const { return bars.data(); }
+    const OhlcBar& bar(size_t i) const { return bars[i]; }
+
+    void serialize(ByteWriter& out) const;
+    bool deserialize(ByteReader& in);
+};
+
+// Shared history file written collectively by Exchange::write_history:
+// a HistoryFileHeader, then for each rank in order a HistoryBlockHeader,
+// instrument_count HistoryEntry records and the bars of those instruments
+// back to back.
+struct HistoryFileHeader {
+    char magic[8];              // "TSBARS01"
+    int32_t num_ranks;
+    int32_t bar_size;           // sizeof(OhlcBar)
+};
+
+struct HistoryBlockHeader {
+    int32_t rank;
+    int32_t instrument_count;
+    int64_t bar_count;          // Bars in this block
+};
+
+struct HistoryEntry {
+    int32_t instrument_id;
+    int32_t bar_interval;
+    int64_t bar_count;
+};
+
+// One instrument's bars as read back from a history file
+struct HistorySeries {
+    int rank;
+    int instrument_id;
+    int bar_interval;
+    std::vector<OhlcBar> bars;
+};
+
+bool read_history_file(const std::string& filename, std::vector<HistorySeries>& series);
+
+#endif // PRICE_HISTORY_H
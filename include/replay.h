@@ -0,0 +1,115 @@
+// ============================================================================
+// include/replay.h
+// Replays recorded order and trade feeds from memory-mapped binary files
+// ============================================================================
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "exchange.h"
+
+// One recorded limit order. Files hold these sorted by tick.
+struct ReplayEvent {
+    double price;
+    int32_t tick;               // Recorded tick the order arrived in
+    int32_t instrument_id;
+    int32_t volume;
+    uint8_t is_buy;
+    uint8_t reserved[3];
+};
+
+// Header of a binary order feed; sizeof(ReplayEvent) records follow
+struct ReplayFileHeader {
+    char magic[8];              // "TSEVENT1"
+    uint32_t record_size;       // sizeof(ReplayEvent)
+    int32_t reserved;
+};
+
+// Write events as an order feed. Returns false on any I/O error.
+bool write_replay_file(const std::string& filename, const std::vector<ReplayEvent>& events);
+
+// Streams a recorded feed into an Exchange, one simulation tick at a time.
+// Two inputs are understood: order feeds (TSEVENT1) and the binary trade
+// logs the simulator writes (TSTRADE1), where each trade becomes a buy and
+// a sell at the traded price and volume, re-creating the recorded
+// liquidity (one trade per instrument and tick executes exactly as
+// recorded; several are re-auctioned together). The file is
+// mapped read-only and a background thread faults in the region just ahead
+// of the cursor, so feed() reads resident pages even for feeds far larger
+// than memory.
+//
+// Orders are submitted into the exchange lane of the thread that handles
+// their instrument, so each instrument's orders keep their recorded order;
+// instruments this rank does not host are skipped, which partitions a
+// sharded market's feed across ranks. Synthetic agents may submit in the
+// same tick. Replayed orders carry one agent ID no agent owns, so their
+// fills never touch agent positions.
+class ReplayEngine {
+private:
+    const char* base;           // Start of the mapping (or buffer)
+    size_t file_bytes;
+    std::vector<char> buffer;   // Whole file where mmap is unavailable
+    bool trade_format;          // Records are Trade rather than ReplayEvent
+    size_t data_offset;         // Header bytes before the first record
+    size_t record_size;
+    size_t record_count;
+    size_t cursor;              // Next record to replay
+    int first_tick;             // Recorded tick of the first record
+    int speed;                  // Recorded ticks replayed per simulation tick
+    int agent_id;
+    long long submitted;
+
+    size_t prefetch_bytes;      // Read-ahead window
+    std::thread prefetcher;
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t prefetch_goal;       // Byte offset to fault in up to
+    size_t prefetched;          // Byte offset faulted in so far
+    bool stopping;
+
+    void prefetch_loop();
+    void request_prefetch();
+    int record_tick(size_t i) const;
+    // Decode record i into up to two orders; returns how many
+    int decode(size_t i, Order out[2]) const;
+
+public:
+    explicit ReplayEngine(size_t prefetch_bytes = 8u << 20);
+    ~ReplayEngine();
+    ReplayEngine(const ReplayEngine&) = delete;
+    ReplayEngine& operator=(const ReplayEngine&) = delete;
+
+    // Map a feed and start the prefetch thread. Fails on a missing or
+    // unrecognised file, or a record layout from a different build.
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return base != nullptr; }
+
+    // Replay speed as recorded ticks per simulation tick (>= 1), so 10 runs
+    // a recorded session ten times faster than real time
+    void set_speed(int recorded_ticks_per_tick);
+    // Agent ID stamped on every replayed order (default -1)
+    void set_agent_id(int id) { agent_id = id; }
+
+    // Submit every record belonging to simulation tick `tick`, stamped with
+    // that tick. Records the feed has already passed are submitted late
+    // rather than dropped. Returns the number of orders submitted.
+    int feed(Exchange& exchange, int tick);
+    // Skip every record belonging to simulation ticks before `tick`, as
+    // when resuming a run from a checkpoint
+    void seek(int tick);
+
+    size_t get_record_count() const { return record_count; }
+    // Every record has been replayed
+    bool done() const { return cursor >= record_count; }
+    long long get_orders_submitted() const { return submitted; }
+};
+
+#endif // REPLAY_H
@@ -0,0 +1,127 @@
+// ============================================================================
+// include/rng.h
+// Counter-based random number generation (Philox4x32-10)
+// Stateless: each draw is a pure function of a key and a counter, so loops
+// over agents vectorize and a draw can be computed anywhere without state
+// ============================================================================
+
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+namespace Philox {
+
+// Round multipliers and Weyl key increments from Salmon et al., SC'11
+const uint32_t M0 = 0xD2511F53u;
+const uint32_t M1 = 0xCD9E8D57u;
+const uint32_t W0 = 0x9E3779B9u;
+const uint32_t W1 = 0xBB67AE85u;
+
+// Four 32-bit outputs of one Philox block
+struct Block {
+    uint32_t v[4];
+};
+
+// Philox4x32-10 bijection of the counter (c0..c3) under key (k0, k1)
+inline Block generate(uint32_t k0, uint32_t k1,
+                      uint32_t c0, uint32_t c1, uint32_t c2, uint32_t c3)
+{
+    for (int round = 0; round < 10; ++round)
+    {
+        uint64_t p0 = (uint64_t)M0 * c0;
+        uint64_t p1 = (uint64_t)M1 * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c1 = (uint32_t)p1;
+        c3 = (uint32_t)p0;
+        c0 = n0;
+        c2 = n2;
+        k0 += W0;
+        k1 += W1;
+    }
+    Block b;
+    b.v[0] = c0;
+    b.v[1] = c1;
+    b.v[2] = c2;
+    b.v[3] = c3;
+    return b;
+}
+
+// Map a 32-bit draw onto [0, n) by multiply-shift (no division)
+inline uint32_t below(uint32_t r, uint32_t n)
+{
+    return (uint32_t)(((uint64_t)r * n) >> 32);
+}
+
+// Map a 32-bit draw onto [0, 1)
+inline double unit(uint32_t r)
+{
+    return r * (1.0 / 4294967296.0);
+}
+
+// Block `index` of one agent's draws at one tick. The key is (agent, low
+// seed word) and the counter (tick, high seed word, index), so a draw
+// depends only on (seed, agent, tick, index): not on which thread or rank
+// runs the agent, the scheduling, or how many draws came before it.
+inline Block draw(uint64_t seed, uint32_t agent, uint64_t tick, uint32_t index = 0)
+{
+    return generate(agent, (uint32_t)seed, (uint32_t)tick, (uint32_t)(tick >> 32), (uint32_t)(seed >> 32), index);
+}
+
+// Sequential view of one (seed, agent) stream for scalar code. Blocks
+// are taken in counter order, block (tick, index) after (tick, index - 1),
+// four draws each. seek() and discard() jump ahead in O(1). Also a
+// UniformRandomBitGenerator, though the std distributions are not
+// specified bit for bit, so reproducible code maps draws with below() and
+// unit().
+class Stream {
+private:
+    uint64_t seed;
+    uint32_t agent;
+    uint64_t tick;
+    uint32_t index;             // Block the next refill produces
+    Block block;
+    int used;                   // Draws taken from block (4 = refill)
+
+public:
+    typedef uint32_t result_type;
+
+    Stream(uint64_t seed_ = 0, uint32_t agent_ = 0) : seed(seed_), agent(agent_), tick(0), index(0), used(4) {}
+
+    // Next draw is the first of block (tick, index)
+    void seek(uint64_t tick_, uint32_t index_ = 0)
+    {
+        tick = tick_;
+        index = index_;
+        used = 4;
+    }
+    // Skip n draws within the current tick
+    void discard(uint64_t n)
+    {
+        uint64_t pos = (uint64_t)index * 4 + n - (used == 4 ? 0 : 4 - used);
+        index = (uint32_t)(pos / 4);
+        used = 4;
+        if (pos % 4)
+        {
+            block = draw(seed, agent, tick, index++);
+            used = (int)(pos % 4);
+        }
+    }
+    uint32_t operator()()
+    {
+        if (used == 4)
+        {
+            block = draw(seed, agent, tick, index++);
+            used = 0;
+        }
+        return block.v[used++];
+    }
+
+    static constexpr uint32_t min() { return 0; }
+    static constexpr uint32_t max() { return 0xffffffffu; }
+};
+
+} // namespace Philox
+
+#endif // RNG_H
@@ -0,0 +1,69 @@
+// ============================================================================
+// include/router.h
+// Cross-rank order routing for instruments sharded across MPI ranks
+// ============================================================================
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <mpi.h>
+#include <vector>
+#include "exchange.h"
+
+// Moves orders to the rank hosting their instrument and fills back to the
+// ranks hosting the agents. Each exchange is batched per destination and
+// sent with one MPI_Alltoall of byte counts plus one MPI_Alltoallv, so a
+// tick costs O(ranks) messages whatever the order flow. All calls except
+// home_rank are collective over MPI_COMM_WORLD.
+class OrderRouter {
+private:
+    int rank;
+    int size;
+    std::vector<int> agent_starts;      // First global agent ID per rank
+    std::vector<int> agent_counts;      // Agents hosted per rank
+    std::vector<std::vector<Order>> outbound_orders; // Per destination rank
+    std::vector<std::vector<Trade>> outbound_fills;
+    std::vector<Order> send_orders, recv_orders;
+    std::vector<Trade> send_fills, recv_fills;
+    std::vector<int> send_counts, recv_counts, send_displs, recv_displs;
+    std::vector<double> quote_local, quote_global;
+    std::vector<MarketQuote> quotes;
+    long long bytes_sent;
+    
+    // Flatten per-rank batches into send and run the count and data
+    // exchanges; recv is resized to what arrived
+    template <typename T>
+    void exchange_batches(std::vector<std::vector<T>>& batches,
+                          std::vector<T>& send, std::vector<T>& recv);
+    
+public:
+    OrderRouter(int rank, int size);
+    
+    // Owner table assigning instrument i to rank i % size
+    static std::vector<int> round_robin_owners(int num_instruments, int size);
+    
+    // Publish the contiguous block of agent IDs hosted by this rank so fills
+    // can be sent home. Collective.
+    void register_agents(int first_agent_id, int num_agents);
+    // Rank hosting an agent, or -1 if no rank registered it
+    int home_rank(int agent_id) const;
+    
+    // Send pending orders for non-local instruments to their owners and
+    // inject the orders routed here. Call between order generation and
+    // process_orders. Returns the number of orders received.
+    int route_orders(Exchange& exchange);
+    // Send fills from this tick's local matching to every other rank that
+    // hosts one of the counterparties. Call after process_orders. Returns
+    // the number of fills received; they stay valid until the next call.
+    int return_fills(const Exchange& exchange);
+    const std::vector<Trade>& get_remote_fills() const { return recv_fills; }
+    
+    // Share each owner's price and statistics for its instruments with all
+    // ranks (one MPI_Allreduce) and install them as remote quotes
+    void exchange_quotes(Exchange& exchange);
+    
+    // Running total of payload bytes this rank has sent
+    long long get_bytes_sent() const { return bytes_sent; }
+};
+
+#endif // ROUTER_H
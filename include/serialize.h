@@ -0,0 +1,113 @@
+// ============================================================================
+// include/serialize.h
+// Minimal binary writer/reader for moving simulator state between ranks
+// Values are copied as raw bytes, so the format is for same-build peers only
+// ============================================================================
+
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Appends trivially copyable values to a caller-owned byte buffer
+class ByteWriter {
+private:
+    std::vector<char>& buf;
+
+public:
+    explicit ByteWriter(std::vector<char>& out) : buf(out) {}
+
+    template <typename T>
+    void put(const T& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "raw copy only");
+        size_t at = buf.size();
+        buf.resize(at + sizeof(T));
+        std::memcpy(buf.data() + at, &v, sizeof(T));
+    }
+
+    // Element count followed by the elements
+    template <typename T>
+    void put_array(const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "raw copy only");
+        put((unsigned long long)count);
+        size_t at = buf.size();
+        buf.resize(at + count * sizeof(T));
+        if (count)
+            std::memcpy(buf.data() + at, data, count * sizeof(T));
+    }
+
+    template <typename T, typename A>
+    void put_vector(const std::vector<T, A>& v) { put_array(v.data(), v.size()); }
+
+    // Grow by n bytes and return where they start, for records that are
+    // built in place rather than staged in a temporary array
+    char* extend(size_t n) {
+        size_t at = buf.size();
+        buf.resize(at + n);
+        return buf.data() + at;
+    }
+};
+
+// Reads values back in the order they were written. Reading past the end
+// clears ok() and yields zeroed values instead of touching out-of-range memory.
+class ByteReader {
+private:
+    const char* pos;
+    const char* end;
+    bool good;
+
+public:
+    ByteReader(const char* data, size_t size) : pos(data), end(data + size), good(true) {}
+
+    template <typename T>
+    bool get(T& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "raw copy only");
+        if (!good || (size_t)(end - pos) < sizeof(T)) {
+            good = false;
+            std::memset(&v, 0, sizeof(T));
+            return false;
+        }
+        std::memcpy(&v, pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    template <typename T, typename A>
+    bool get_vector(std::vector<T, A>& v) {
+        unsigned long long n = 0;
+        if (!get(n) || n > (size_t)(end - pos) / sizeof(T)) {
+            good = false;
+            v.clear();
+            return false;
+        }
+        v.resize(n);
+        if (n)
+            std::memcpy(v.data(), pos, n * sizeof(T));
+        pos += n * sizeof(T);
+        return true;
+    }
+
+    // Counterpart of put_array: returns count elements in place (unaligned,
+    // copy out with memcpy) or nullptr if the data is short
+    template <typename T>
+    const char* get_array(size_t& count) {
+        unsigned long long n = 0;
+        if (!get(n) || n > (size_t)(end - pos) / sizeof(T)) {
+            good = false;
+            count = 0;
+            return nullptr;
+        }
+        const char* at = pos;
+        count = (size_t)n;
+        pos += n * sizeof(T);
+        return at;
+    }
+
+    bool ok() const { return good; }
+    size_t remaining() const { return (size_t)(end - pos); }
+};
+
+#endif // SERIALIZE_H
@@ -0,0 +1,71 @@
+// ============================================================================
+// include/statistics.h
+// Incremental price statistics maintained per instrument
+// Every statistic is updated in O(1) per trade and read in O(1)
+// ============================================================================
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <cstddef>
+#include <vector>
+#include "serialize.h"
+
+// Which statistic a strategy compares the current price against
+enum class PriceStatistic {
+    MEAN,       // Mean of every price since the start of the run
+    EWMA,       // Exponentially weighted moving average
+    SMA,        // Simple moving average over the last window prices
+    VWAP        // Volume weighted average trade price
+};
+const int NUM_PRICE_STATISTICS = 4;
+
+// Running statistics over the trade price series of one instrument
+class PriceStatistics {
+private:
+    double ewma_alpha;          // Weight of the newest price in the EWMA
+    size_t window;              // Length of the SMA window
+
+    long long count;            // Prices observed, including the seed price
+    double mean_price;          // Running mean (Welford)
+    double m2_price;            // Sum of squared deviations from the mean
+    double ewma_price;
+
+    std::vector<double> ring;   // Last window prices for the SMA
+    size_t ring_pos;            // Next slot to overwrite
+    double window_sum;          // Sum of the prices currently in ring
+
+    double last_price;
+    long long return_count;     // Log returns observed
+    double mean_return;         // Running mean of log returns
+    double m2_return;           // Sum of squared deviations of log returns
+
+    double notional;            // Sum of price * volume over all trades
+    long long traded_volume;    // Sum of volume over all trades
+
+public:
+    PriceStatistics(double initial_price, size_t window = 50, double ewma_alpha = 0.05);
+
+    // Record one executed trade
+    void add_trade(double price, int volume);
+
+    double mean() const { return mean_price; }
+    double ewma() const { return ewma_price; }
+    double sma() const;
+    double vwap() const;
+    // Population variance of the price series
+    double variance() const;
+    // Standard deviation of per-trade log returns
+    double volatility() const;
+    long long observations() const { return count; }
+    long long volume() const { return traded_volume; }
+
+    double get(PriceStatistic stat) const;
+
+    // Full state, including the SMA ring, so a restored copy continues
+    // bit-identically
+    void serialize(ByteWriter& out) const;
+    bool deserialize(ByteReader& in);
+};
+
+#endif // STATISTICS_H
@@ -0,0 +1,189 @@
+// ============================================================================
+// include/strategies.h
+// Compile-time strategy kernels and the runtime registry that picks them
+// Each strategy and its parameters are types; one branch-free loop is
+// instantiated per strategy and selected once per batch of agents
+// ============================================================================
+
+#ifndef STRATEGIES_H
+#define STRATEGIES_H
+
+#include "agent.h"
+#include "rng.h"
+#include <cstdint>
+#include <string>
+
+// Number of AgentStrategy values
+const int NUM_STRATEGIES = 4;
+
+// Slot arrays one kernel call reads and writes. Outputs are pre-offset so
+// slot i writes element i; every agent emits a primary order and two-sided
+// strategies also fill the ask arrays.
+struct KernelArgs {
+    const int* ids;             // Global agent IDs (Philox key)
+    const double* thresholds;
+    uint64_t seed;              // Run seed
+    uint64_t tick;              // Every agent draws block (tick, 0) of its stream
+    double price;               // Instrument's last price
+    double reference;           // Strategy's reference statistic
+    unsigned char* is_buy;
+    double* order_price;
+    int* volume;
+    double* ask_price;
+    int* ask_volume;
+};
+
+// One agent's decision. The ask fields are used by two-sided strategies
+struct KernelQuote {
+    bool is_buy;
+    double price;
+    int volume;
+    double ask_price;
+    int ask_volume;
+};
+
+// CRTP loop shared by every strategy: one Philox block per agent, then
+// Derived::quote on its first two draws, which the compiler inlines into the vectorized loop.
+// Strategies only decide; the loop does all loads and stores.
+template <typename Derived>
+struct StrategyKernel {
+    static void run(const KernelArgs& args, int lo, int hi)
+    {
+        const int* ids = args.ids;
+        const double* thr = args.thresholds;
+        const uint64_t seed = args.seed, tick = args.tick;
+        const double px = args.price, ref = args.reference;
+        unsigned char* is_buy = args.is_buy;
+        double* price = args.order_price;
+        int* volume = args.volume;
+        double* ask_price = args.ask_price;
+        int* ask_volume = args.ask_volume;
+#pragma omp simd
+        for (int i = lo; i < hi; ++i)
+        {
+            Philox::Block r = Philox::draw(seed, (uint32_t)ids[i], tick);
+            KernelQuote q = Derived::quote(r.v[0], r.v[1], px, ref, thr[i]);
+            is_buy[i] = q.is_buy;
+            price[i] = q.price;
+            volume[i] = q.volume;
+            if (Derived::TWO_SIDED)
+            {
+                ask_price[i] = q.ask_price;
+                ask_volume[i] = q.ask_volume;
+            }
+        }
+    }
+};
+
+// Default parameters. Prices are multiples of the last price; volumes are
+// uniform in [1, MAX_VOLUME]. A variant is a new parameter struct, e.g.
+// MarketMaker<WideQuotes>, registered with make_strategy.
+struct RandomWalkParams {
+    static constexpr double BUY_PRICE = 0.99;
+    static constexpr double SELL_PRICE = 1.01;
+    static constexpr uint32_t MAX_VOLUME = 10;
+};
+
+struct MomentumParams {
+    static constexpr double THRESHOLD_SCALE = 0.001; // Relative move per unit of threshold
+    static constexpr double BUY_PRICE = 1.005;
+    static constexpr double SELL_PRICE = 0.995;
+    static constexpr uint32_t MAX_VOLUME = 10;
+};
+
+struct MeanReversionParams {
+    static constexpr double THRESHOLD_SCALE = 0.001;
+    static constexpr double BUY_PRICE = 1.002;
+    static constexpr double SELL_PRICE = 0.998;
+    static constexpr uint32_t MAX_VOLUME = 10;
+};
+
+struct MarketMakerParams {
+    static constexpr double BID_PRICE = 0.999;
+    static constexpr double ASK_PRICE = 1.001;
+    static constexpr uint32_t MAX_VOLUME = 5;
+};
+
+// Buy or sell at random
+template <typename P = RandomWalkParams>
+struct RandomWalk : StrategyKernel<RandomWalk<P>> {
+    static constexpr AgentStrategy ID = AgentStrategy::RANDOM_WALK;
+    static constexpr bool TWO_SIDED = false;
+    static KernelQuote quote(uint32_t r0, uint32_t r1, double px, double, double)
+    {
+        KernelQuote q = {};
+        q.is_buy = r0 < 0x80000000u;
+        q.price = px * (q.is_buy ? P::BUY_PRICE : P::SELL_PRICE);
+        q.volume = 1 + (int)Philox::below(r1, P::MAX_VOLUME);
+        return q;
+    }
+};
+
+// Buy when the price is above the reference, sell otherwise
+template <typename P = MomentumParams>
+struct Momentum : StrategyKernel<Momentum<P>> {
+    static constexpr AgentStrategy ID = AgentStrategy::MOMENTUM;
+    static constexpr bool TWO_SIDED = false;
+    static KernelQuote quote(uint32_t r0, uint32_t, double px, double ref, double threshold)
+    {
+        KernelQuote q = {};
+        q.is_buy = px > ref * (1.0 + P::THRESHOLD_SCALE * threshold);
+        q.price = px * (q.is_buy ? P::BUY_PRICE : P::SELL_PRICE);
+        q.volume = 1 + (int)Philox::below(r0, P::MAX_VOLUME);
+        return q;
+    }
+};
+
+// Buy when the price is below the reference, sell otherwise
+template <typename P = MeanReversionParams>
+struct MeanReversion : StrategyKernel<MeanReversion<P>> {
+    static constexpr AgentStrategy ID = AgentStrategy::MEAN_REVERSION;
+    static constexpr bool TWO_SIDED = false;
+    static KernelQuote quote(uint32_t r0, uint32_t, double px, double ref, double threshold)
+    {
+        KernelQuote q = {};
+        q.is_buy = px < ref * (1.0 - P::THRESHOLD_SCALE * threshold);
+        q.price = px * (q.is_buy ? P::BUY_PRICE : P::SELL_PRICE);
+        q.volume = 1 + (int)Philox::below(r0, P::MAX_VOLUME);
+        return q;
+    }
+};
+
+// Quote a bid and an ask around the last price
+template <typename P = MarketMakerParams>
+struct MarketMaker : StrategyKernel<MarketMaker<P>> {
+    static constexpr AgentStrategy ID = AgentStrategy::MARKET_MAKER;
+    static constexpr bool TWO_SIDED = true;
+    static KernelQuote quote(uint32_t r0, uint32_t r1, double px, double, double)
+    {
+        KernelQuote q;
+        q.is_buy = true;
+        q.price = px * P::BID_PRICE;
+        q.volume = 1 + (int)Philox::below(r0, P::MAX_VOLUME);
+        q.ask_price = px * P::ASK_PRICE;
+        q.ask_volume = 1 + (int)Philox::below(r1, P::MAX_VOLUME);
+        return q;
+    }
+};
+
+// Registry entry: the instantiated loop of one strategy type
+typedef void (*StrategyKernelFn)(const KernelArgs& args, int lo, int hi);
+struct StrategyInfo {
+    const char* name;           // Config name; "<name>_agents" sets its count
+    AgentStrategy id;           // Slot the kernel serves
+    bool two_sided;             // Also emits the ask order
+    StrategyKernelFn run;
+};
+
+template <typename S>
+constexpr StrategyInfo make_strategy(const char* name)
+{
+    return StrategyInfo{name, S::ID, S::TWO_SIDED, &S::run};
+}
+
+// Built-in strategies with their default parameters, in AgentStrategy order
+const StrategyInfo& default_strategy(AgentStrategy id);
+// Built-in strategy by config name, or nullptr
+const StrategyInfo* find_strategy(const std::string& name);
+
+#endif // STRATEGIES_H
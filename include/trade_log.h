@@ -0,0 +1,83 @@
+// ============================================================================
+// include/trade_log.h
+// Streaming binary trade log written by a background I/O thread
+// ============================================================================
+
+#ifndef TRADE_LOG_H
+#define TRADE_LOG_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "exchange.h"
+
+// Header of a binary trade log; sizeof(Trade) records follow to the end
+struct TradeLogHeader {
+    char magic[8];              // "TSTRADE1"
+    uint32_t record_size;       // sizeof(Trade)
+    int32_t rank;               // Rank that wrote the log
+};
+
+// Appends fixed-size Trade records to a file without stalling the tick
+// loop. Trades are copied into one of two preallocated chunks; when the
+// active chunk fills it is handed to the I/O thread and the other one takes
+// over, so the caller only waits if the disk falls a whole chunk behind.
+// append is called from one thread at a time (after the matching region).
+class TradeLogWriter {
+private:
+    std::FILE* file;
+    size_t chunk_records;
+    std::vector<Trade> chunks[2];
+    int active;                 // Chunk receiving appends
+    
+    std::thread io;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool pending;               // The inactive chunk is waiting to be written
+    bool stopping;
+    bool failed;                // A write came up short
+    long long written;          // Records appended so far
+    
+    void io_loop();
+    void hand_off();
+    
+public:
+    explicit TradeLogWriter(size_t chunk_records = 65536);
+    ~TradeLogWriter();
+    TradeLogWriter(const TradeLogWriter&) = delete;
+    TradeLogWriter& operator=(const TradeLogWriter&) = delete;
+    
+    // Create the file, write the header and start the I/O thread. With
+    // resume_records >= 0 an existing log is instead cut back to that many
+    // records and appended to, as when restarting from a checkpoint; this
+    // fails if the file holds fewer.
+    bool open(const std::string& filename, int rank, long long resume_records = -1);
+    bool is_open() const { return file != nullptr; }
+    
+    void append(const Trade* trades, size_t count);
+    void append(const std::vector<Trade>& trades) { append(trades.data(), trades.size()); }
+
+    // Block until every record appended so far is in the file. Returns
+    // false if any write failed.
+    bool flush();
+    
+    // Write out everything appended, stop the thread and close the file.
+    // Returns false if any write failed.
+    bool close();
+    long long records_written() const { return written; }
+};
+
+// Load a whole binary trade log. Returns false if the file is missing or
+// was written with a different record layout.
+bool read_trade_log(const std::string& filename, std::vector<Trade>& trades,
+                    TradeLogHeader* header = nullptr);
+
+// CSV rows in the format of Exchange::export_trade_log, header included
+void write_trades_csv(std::ostream& out, const Trade* trades, size_t count);
+
+#endif // TRADE_LOG_H
@@ -7,8 +7,16 @@
 #define UTILS_H
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
 // Simple timer class for performance measurement
 class Timer {
 private:
@@ -37,6 +45,49 @@ public:
     }
 };
 
+// Read the CPU timestamp counter; falls back to steady_clock nanoseconds on
+// targets without one, in which case tsc_cycles_per_ns() is 1
+inline uint64_t read_tsc() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// TSC frequency in cycles per nanosecond, calibrated once against
+// steady_clock on first use
+double tsc_cycles_per_ns();
+
+// Timer that also counts TSC cycles, for hot paths where a chrono call per
+// measurement is too expensive
+class TscTimer : public Timer {
+private:
+    uint64_t start_cycles;
+    
+public:
+    TscTimer() : start_cycles(read_tsc()) {}
+    
+    void reset() {
+        Timer::reset();
+        start_cycles = read_tsc();
+    }
+    
+    uint64_t elapsed_cycles() const {
+        return read_tsc() - start_cycles;
+    }
+    
+    double elapsed_ns() const {
+        return elapsed_cycles() / tsc_cycles_per_ns();
+    }
+};
+
+// An MPI count or displacement for n items. MPI takes them as int, and a
+// value that does not fit would silently corrupt the transfer, so a larger
+// n aborts the job with a message naming what was being sent.
+int mpi_count(size_t n, const char* what);
+
 // Logging utilities
 namespace Logger {
     void info(const std::string& message);
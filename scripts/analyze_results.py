@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Report speedup and efficiency of a scaling sweep and flag regressions.
+
+Usage: python3 scripts/analyze_results.py scaling_results.json
+           [--baseline baseline.json] [--tolerance 0.10]
+
+Reads the output of scripts/run_simulation.py. Configurations with the same
+instrument and agent counts form one scaling series, measured against its
+configuration with the fewest cores (ranks * threads):
+
+  strong  speedup = T_base / T, efficiency = speedup / (cores / base cores)
+  weak    efficiency = T_base / T, speedup = efficiency * cores / base cores
+
+With an instrumented build the mean per-tick time of each phase on the
+slowest rank is listed as well. Against a baseline sweep of the same mode,
+a configuration regresses when its orders/sec drops, or its efficiency
+falls, by more than the tolerance (fractional, default 10%). Exits with
+status 1 if any configuration regressed.
+"""
+
+import argparse
+import json
+import sys
+
+PHASES = ("agent_generation", "process_orders", "broadcast_prices", "barrier")
+PHASE_LABELS = ("gen ms", "match ms", "bcast ms", "barrier ms")
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def key(c):
+    return (c["ranks"], c["threads"], c["instruments"], c["agents"])
+
+
+def scaling(data):
+    """Attach cores, speedup and efficiency to every configuration"""
+    series = {}
+    for c in data["configs"]:
+        c["cores"] = c["ranks"] * c["threads"]
+        series.setdefault((c["instruments"], c["agents"]), []).append(c)
+    for configs in series.values():
+        configs.sort(key=lambda c: (c["cores"], c["ranks"]))
+        base = configs[0]
+        for c in configs:
+            ratio = c["cores"] / float(base["cores"])
+            t = max(c["time_ms"], 1e-9)
+            if data["mode"] == "strong":
+                c["speedup"] = base["time_ms"] / t
+                c["efficiency"] = c["speedup"] / ratio
+            else:
+                c["efficiency"] = base["time_ms"] / t
+                c["speedup"] = c["efficiency"] * ratio
+    return series
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("results")
+    parser.add_argument("--baseline")
+    parser.add_argument("--tolerance", type=float, default=0.10)
+    args = parser.parse_args()
+
+    data = load(args.results)
+    series = scaling(data)
+    base = None
+    if args.baseline:
+        base_data = load(args.baseline)
+        if base_data["mode"] != data["mode"]:
+            print("error: baseline is a %s scaling sweep, results are %s" % (base_data["mode"], data["mode"]))
+            return 1
+        if (base_data["ticks"], base_data.get("host")) != (data["ticks"], data.get("host")):
+            print("warning: baseline ran %d ticks on %s, results %d ticks on %s"
+                  % (base_data["ticks"], base_data.get("host"), data["ticks"], data.get("host")))
+        scaling(base_data)
+        base = {key(c): c for c in base_data["configs"]}
+
+    has_phases = any(c.get("phases_ms") for c in data["configs"])
+    print("%s scaling, %d ticks" % (data["mode"], data["ticks"]))
+    regressions = 0
+    for (instruments, agents), configs in sorted(series.items()):
+        print("\ninstruments=%d agents=%d%s" % (instruments, agents,
+                                                "" if data["mode"] == "strong" else " per core"))
+        header = "%4s %7s %5s %10s %14s %8s %6s" % ("np", "threads", "cores", "time ms",
+                                                  "orders/s", "speedup", "eff")
+        if has_phases:
+            header += "".join(" %10s" % label for label in PHASE_LABELS)
+        print(header)
+        for c in configs:
+            line = "%4d %7d %5d %10.0f %14.0f %8.2f %5.0f%%" % (
+                c["ranks"], c["threads"], c["cores"], c["time_ms"], c["orders_per_sec"],
+                c["speedup"], c["efficiency"] * 100)
+            if has_phases:
+                phases = c.get("phases_ms") or {}
+                line += "".join(" %10.3f" % phases[p] if p in phases else " %10s" % "-" for p in PHASES)
+            b = base.get(key(c)) if base else None
+            if b:
+                flags = []
+                if c["orders_per_sec"] < b["orders_per_sec"] * (1 - args.tolerance):
+                    flags.append("THROUGHPUT %+.0f%%" % ((c["orders_per_sec"] / b["orders_per_sec"] - 1) * 100))
+                if c["efficiency"] < b["efficiency"] * (1 - args.tolerance):
+                    flags.append("EFFICIENCY %.0f%% -> %.0f%%" % (b["efficiency"] * 100, c["efficiency"] * 100))
+                if flags:
+                    regressions += 1
+                    line += "  REGRESSION: " + ", ".join(flags)
+            elif base is not None:
+                line += "  new"
+            print(line)
+
+    if base is not None:
+        if regressions:
+            print("\n%d regression(s) beyond %.0f%% tolerance" % (regressions, args.tolerance * 100))
+            return 1
+        print("\nNo regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""Compare two bench_trading_sim result files and flag regressions.
+
+Usage: python3 scripts/compare_bench.py baseline.json current.json [--tolerance 0.10]
+
+A benchmark regresses when its ns_per_op grows by more than the tolerance
+(fractional, default 10%) or when it starts allocating in steady state.
+Exits with status 1 if any benchmark regressed.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+    results = {}
+    for r in data["results"]:
+        # The single size parameter is whichever key is not a metric
+        param = [k for k in r if k not in ("name", "iterations", "ns_per_op", "allocs_per_op")]
+        key = (r["name"], param[0] if param else "", r.get(param[0]) if param else None)
+        results[key] = r
+    return data, results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--tolerance", type=float, default=0.10)
+    args = parser.parse_args()
+
+    base_meta, base = load(args.baseline)
+    cur_meta, cur = load(args.current)
+    if (base_meta["ranks"], base_meta["threads"]) != (cur_meta["ranks"], cur_meta["threads"]):
+        print("warning: baseline ran with %d ranks/%d threads, current with %d/%d"
+              % (base_meta["ranks"], base_meta["threads"], cur_meta["ranks"], cur_meta["threads"]))
+
+    regressions = 0
+    print("%-28s %-20s %12s %12s %8s" % ("benchmark", "param", "baseline", "current", "change"))
+    for key in sorted(cur, key=str):
+        name, pname, pval = key
+        c = cur[key]
+        b = base.get(key)
+        label = "%s=%s" % (pname, pval)
+        if b is None:
+            print("%-28s %-20s %12s %12.1f %8s" % (name, label, "-", c["ns_per_op"], "new"))
+            continue
+        change = (c["ns_per_op"] - b["ns_per_op"]) / b["ns_per_op"] if b["ns_per_op"] > 0 else 0.0
+        flag = ""
+        if change > args.tolerance:
+            flag = "  REGRESSION"
+        elif b["allocs_per_op"] == 0 and c["allocs_per_op"] > 0:
+            flag = "  NOW ALLOCATES"
+        if flag:
+            regressions += 1
+        print("%-28s %-20s %12.1f %12.1f %+7.1f%%%s"
+              % (name, label, b["ns_per_op"], c["ns_per_op"], change * 100, flag))
+
+    if regressions:
+        print("\n%d regression(s) beyond %.0f%% tolerance" % (regressions, args.tolerance * 100))
+        return 1
+    print("\nNo regressions")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Run trading_sim across rank, thread, instrument and agent counts.
+
+Usage: python3 scripts/run_simulation.py [--mode strong|weak] [--ranks 1,2,4]
+           [--threads 1,2,4] [--instruments 3] [--agents 4000] [--ticks 500]
+           [--repeat 3] [--out scaling_results.json] [-- extra trading_sim args]
+
+Every combination of the four lists is one configuration. --agents sets the
+problem size, which the mode turns into agents per rank:
+
+  strong  the agent count is the whole market, split evenly over ranks:
+          agents per rank = agents / ranks
+  weak    the agent count is per core (rank * thread), so the market grows
+          with both: agents per rank = agents * threads
+
+Instruments are per exchange in both modes (per shard with --shard).
+Each configuration runs --repeat times in a scratch directory and the
+median wall time is kept. With an instrumented build
+(-DTRADING_INSTRUMENTATION=ON) the per-tick phase timelines are read as
+well, and each phase's time is recorded as the mean over ticks of the
+slowest rank. Checkpoints are off unless the extra arguments turn them on.
+
+The JSON output is the input of scripts/analyze_results.py.
+"""
+
+import argparse
+import itertools
+import json
+import os
+import platform
+import re
+import shlex
+import shutil
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+
+PHASES = ("agent_generation", "process_orders", "broadcast_prices", "barrier")
+
+# TimelineHeader and TickRecord from include/instrumentation.h
+HEADER = struct.Struct("<8sIIdiiQ")
+RECORD = struct.Struct("<ii4Q4Qqqqq")
+
+REPORT = {
+    "time_ms": re.compile(r"Total Execution Time: (\d+) ms"),
+    "orders": re.compile(r"Global Orders Submitted: (\d+)"),
+    "trades": re.compile(r"Global Trades Executed: (\d+)"),
+}
+
+
+def int_list(text):
+    return [int(v) for v in text.split(",") if v]
+
+
+def read_timeline(path):
+    """Per-tick phase cycles of one rank, and the file's cycles per ns"""
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, record_size, num_phases, cycles_per_ns, _, _, count = HEADER.unpack_from(data, 0)
+    if magic != b"TSPROF01" or record_size != RECORD.size or num_phases != len(PHASES):
+        raise ValueError("%s: not a timeline this script understands" % path)
+    ticks = {}
+    for i in range(count):
+        r = RECORD.unpack_from(data, HEADER.size + i * record_size)
+        ticks[r[0]] = r[6:10]
+    return ticks, cycles_per_ns
+
+
+def phase_times(directory):
+    """Mean ms per tick of each phase on the slowest rank, or None"""
+    files = sorted(f for f in os.listdir(directory) if re.match(r"timeline_rank_\d+\.bin$", f))
+    if not files:
+        return None
+    slowest = {}
+    for name in files:
+        ticks, cycles_per_ns = read_timeline(os.path.join(directory, name))
+        for tick, cycles in ticks.items():
+            ms = [c / cycles_per_ns / 1e6 for c in cycles]
+            prev = slowest.get(tick)
+            slowest[tick] = ms if prev is None else [max(a, b) for a, b in zip(prev, ms)]
+    n = max(1, len(slowest))
+    return {p: sum(t[k] for t in slowest.values()) / n for k, p in enumerate(PHASES)}
+
+
+def run_once(command, env):
+    scratch = tempfile.mkdtemp(prefix="scaling_")
+    try:
+        proc = subprocess.run(command, cwd=scratch, env=env, stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT, universal_newlines=True)
+        if proc.returncode != 0:
+            raise RuntimeError("%s exited with %d:\n%s" % (" ".join(command), proc.returncode, proc.stdout))
+        result = {}
+        for key, pattern in REPORT.items():
+            m = pattern.search(proc.stdout)
+            if not m:
+                raise RuntimeError("no '%s' in the output of %s" % (key, " ".join(command)))
+            result[key] = int(m.group(1))
+        result["phases_ms"] = phase_times(scratch)
+        return result
+    finally:
+        shutil.rmtree(scratch, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--binary", default="build/trading_sim")
+    parser.add_argument("--mpirun", default="mpirun", help="launcher command, e.g. 'mpirun --oversubscribe'")
+    parser.add_argument("--mode", choices=("strong", "weak"), default="strong")
+    parser.add_argument("--ranks", type=int_list, default=[1, 2, 4])
+    parser.add_argument("--threads", type=int_list, default=[1, 2, 4])
+    parser.add_argument("--instruments", type=int_list, default=[3])
+    parser.add_argument("--agents", type=int_list, default=[4000])
+    parser.add_argument("--ticks", type=int, default=500)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--out", default="scaling_results.json")
+    parser.add_argument("extra", nargs=argparse.REMAINDER, help="arguments after '--' go to trading_sim")
+    args = parser.parse_args()
+
+    binary = os.path.abspath(args.binary)
+    if not os.path.isfile(binary):
+        print("error: %s not found (build first, or pass --binary)" % binary)
+        return 1
+    extra = [a for a in args.extra if a != "--"]
+    if not any(a.startswith("--checkpoint-interval") for a in extra):
+        extra = ["--checkpoint-interval", "0"] + extra
+
+    configs = []
+    for ranks, threads, instruments, agents in itertools.product(
+            args.ranks, args.threads, args.instruments, args.agents):
+        per_rank = agents // ranks if args.mode == "strong" else agents * threads
+        if per_rank < 1:
+            print("skipping %d ranks: %d agents do not split that far" % (ranks, agents))
+            continue
+        command = shlex.split(args.mpirun) + ["-np", str(ranks), binary,
+                                              "--threads", str(threads),
+                                              "--instruments", str(instruments),
+                                              "--agents", str(per_rank),
+                                              "--ticks", str(args.ticks)] + extra
+        env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+        runs = []
+        for _ in range(max(1, args.repeat)):
+            try:
+                runs.append(run_once(command, env))
+            except RuntimeError as e:
+                print("error: %s" % e)
+                return 1
+        time_ms = statistics.median(r["time_ms"] for r in runs)
+        median_run = min(runs, key=lambda r: abs(r["time_ms"] - time_ms))
+        config = {
+            "ranks": ranks,
+            "threads": threads,
+            "instruments": instruments,
+            "agents": agents,
+            "agents_per_rank": per_rank,
+            "time_ms": time_ms,
+            "times_ms": [r["time_ms"] for r in runs],
+            "orders": median_run["orders"],
+            "trades": median_run["trades"],
+            "orders_per_sec": median_run["orders"] * 1000.0 / max(1, time_ms),
+            "phases_ms": median_run["phases_ms"],
+        }
+        configs.append(config)
+        print("%-6s np=%-3d threads=%-3d instruments=%-4d agents/rank=%-8d %8.0f ms %12.0f orders/s"
+              % (args.mode, ranks, threads, instruments, per_rank, time_ms, config["orders_per_sec"]))
+
+    with open(args.out, "w") as f:
+        json.dump({
+            "mode": args.mode,
+            "ticks": args.ticks,
+            "host": platform.node(),
+            "cpus": os.cpu_count(),
+            "binary": binary,
+            "extra_args": extra,
+            "configs": configs,
+        }, f, indent=2)
+    print("wrote %s" % args.out)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -16,6 +16,15 @@ NC='\033[0m'
 
 FAILED=0
 
+# The simulator streams binary trade logs; convert them to CSV for the checks
+convert_trades() {
+    for f in trades_rank_*.bin; do
+        [ -f "$f" ] && "$1/build/trade_log_to_csv" "$f" > /dev/null
+    done
+    [ -f price_history.bin ] && "$1/build/history_to_csv" price_history.bin > /dev/null
+    return 0
+}
+
 # Test 1: Build test
 echo "Test 1: Building project..."
 if ./scripts/build.sh --clean > /dev/null 2>&1; then
@@ -79,6 +88,7 @@ echo "Test 5: Checking output file generation..."
 TEMP_DIR=$(mktemp -d)
 cd "$TEMP_DIR"
 mpirun -np 2 ${OLDPWD}/build/trading_sim > /dev/null 2>&1
+convert_trades "$OLDPWD"
 
 FILES_OK=true
 for rank in 0 1; do
@@ -86,11 +96,11 @@ for rank in 0 1; do
         echo -e "${RED}✗ Missing trades_rank_${rank}.csv${NC}"
         FILES_OK=false
     fi
-    if [ ! -f "prices_rank_${rank}.csv" ]; then
-        echo -e "${RED}✗ Missing prices_rank_${rank}.csv${NC}"
-        FILES_OK=false
-    fi
 done
+if [ ! -f "price_history.bin" ]; then
+    echo -e "${RED}✗ Missing price_history.bin${NC}"
+    FILES_OK=false
+fi
 
 if [ "$FILES_OK" = true ]; then
     echo -e "${GREEN}✓ All output files generated${NC}"
@@ -106,13 +116,14 @@ echo "Test 6: Validating CSV file format..."
 TEMP_DIR=$(mktemp -d)
 cd "$TEMP_DIR"
 mpirun -np 1 ${OLDPWD}/build/trading_sim > /dev/null 2>&1
+convert_trades "$OLDPWD"
 
 CSV_OK=true
 
 # Check trades CSV
 if [ -f "trades_rank_0.csv" ]; then
     # Check header
-    if ! head -n 1 trades_rank_0.csv | grep -q "Timestamp,Instrument,BuyAgent,SellAgent,Price,Volume"; then
+    if ! head -n 1 trades_rank_0.csv | grep -q "Timestamp,Instrument,Price,Volume,BuyAgent,SellAgent"; then
         echo -e "${RED}✗ Invalid trades CSV header${NC}"
         CSV_OK=false
     fi
@@ -127,14 +138,18 @@ else
 fi
 
 # Check prices CSV
-if [ -f "prices_rank_0.csv" ]; then
+if [ -f "price_history.csv" ]; then
+    if ! head -n 1 price_history.csv | grep -q "Rank,Instrument,Tick,Open,High,Low,Close,Volume,Trades"; then
+        echo -e "${RED}✗ Invalid price history CSV header${NC}"
+        CSV_OK=false
+    fi
     # Check for data rows
-    if [ $(wc -l < prices_rank_0.csv) -lt 2 ]; then
+    if [ $(wc -l < price_history.csv) -lt 2 ]; then
         echo -e "${RED}✗ Empty prices CSV${NC}"
         CSV_OK=false
     fi
 else
-    echo -e "${RED}✗ prices_rank_0.csv not found${NC}"
+    echo -e "${RED}✗ price_history.csv not found${NC}"
     CSV_OK=false
 fi
 
@@ -159,7 +174,7 @@ for i in {1..10}; do
         THREAD_SAFE=false
         break
     fi
-    rm -f *.csv  # Clean up between runs
+    rm -f *.csv *.bin  # Clean up between runs
 done
 
 if [ "$THREAD_SAFE" = true ]; then
@@ -207,11 +222,13 @@ cd "$TEMP_DIR"
 
 # First run
 mpirun -np 2 ${OLDPWD}/build/trading_sim > /dev/null 2>&1
+convert_trades "$OLDPWD"
 TRADES1=$(wc -l < trades_rank_0.csv)
 
 # Clean and second run
-rm -f *.csv
+rm -f *.csv *.bin
 mpirun -np 2 ${OLDPWD}/build/trading_sim > /dev/null 2>&1
+convert_trades "$OLDPWD"
 TRADES2=$(wc -l < trades_rank_0.csv)
 
 # Results should be similar (allowing for small variations)
@@ -250,6 +267,29 @@ cd "$OLDPWD"
 rm -rf "$TEMP_DIR"
 echo ""
 
+# Test 11: Checkpoint/restart reproduces the uninterrupted run
+echo "Test 11: Restarting from the last checkpoint..."
+TEMP_DIR=$(mktemp -d)
+cd "$TEMP_DIR"
+REPO="$OLDPWD"
+mkdir full resumed
+(cd full && mpirun -np 2 "$REPO/build/trading_sim" --checkpoint-interval 250 > /dev/null 2>&1 && convert_trades "$REPO")
+cp full/checkpoint_rank_*.bin full/trades_rank_*.bin resumed/
+(cd resumed && mpirun -np 2 "$REPO/build/trading_sim" --checkpoint-interval 250 --restart > output.txt 2>&1 && convert_trades "$REPO")
+
+if grep -q "Resuming from checkpoint" resumed/output.txt && \
+   cmp -s full/trades_rank_0.csv resumed/trades_rank_0.csv && \
+   cmp -s full/trades_rank_1.csv resumed/trades_rank_1.csv && \
+   cmp -s full/price_history.bin resumed/price_history.bin; then
+    echo -e "${GREEN}✓ Restarted run matches the uninterrupted run${NC}"
+else
+    echo -e "${RED}✗ Restarted run diverged${NC}"
+    FAILED=$((FAILED + 1))
+fi
+cd "$OLDPWD"
+rm -rf "$TEMP_DIR"
+echo ""
+
 # Final summary
 echo "======================================"
 echo "Validation Summary"
@@ -0,0 +1,192 @@
+#include "affinity.h"
+#include <omp.h>
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+// Scheduler mask of the process before the first pin_threads
+static cpu_set_t startup_mask;
+static bool startup_mask_saved = false;
+#endif
+
+// "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+static std::vector<int> parse_cpu_list(const std::string &text)
+{
+    std::vector<int> out;
+    std::stringstream ss(text);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        int lo = 0, hi = 0;
+        char dash = 0;
+        std::stringstream range(item);
+        if (!(range >> lo))
+            continue;
+        hi = lo;
+        if (range >> dash >> hi && dash != '-')
+            hi = lo;
+        for (int c = lo; c <= hi; ++c)
+            out.push_back(c);
+    }
+    return out;
+}
+
+static std::string read_line(const std::string &path)
+{
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+// "0-3,5" from a sorted list
+static std::string format_list(const std::vector<int> &values)
+{
+    std::ostringstream out;
+    for (size_t k = 0; k < values.size();)
+    {
+        size_t end = k;
+        while (end + 1 < values.size() && values[end + 1] == values[end] + 1)
+            ++end;
+        out << (k > 0 ? "," : "") << values[k];
+        if (end > k)
+            out << "-" << values[end];
+        k = end + 1;
+    }
+    return out.str();
+}
+
+CpuTopology detect_topology()
+{
+    CpuTopology topo;
+    std::vector<int> allowed;
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (startup_mask_saved)
+        mask = startup_mask;
+    if (startup_mask_saved || sched_getaffinity(0, sizeof(mask), &mask) == 0)
+        for (int c = 0; c < CPU_SETSIZE; ++c)
+            if (CPU_ISSET(c, &mask))
+                allowed.push_back(c);
+    topo.online_cpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+#else
+    topo.online_cpus = (int)std::thread::hardware_concurrency();
+#endif
+    if (allowed.empty())
+        for (int c = 0; c < std::max(1, topo.online_cpus); ++c)
+            allowed.push_back(c);
+    topo.online_cpus = std::max(topo.online_cpus, (int)allowed.size());
+
+    // Group the allowed CPUs by node; CPUs no node claims go with the first
+    std::set<int> unplaced(allowed.begin(), allowed.end());
+    std::set<int> nodes_seen;
+    for (int node : parse_cpu_list(read_line("/sys/devices/system/node/online")))
+    {
+        std::vector<int> node_cpus =
+            parse_cpu_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+        for (int c : node_cpus)
+            if (unplaced.erase(c))
+            {
+                topo.cpus.push_back(c);
+                topo.node_of.push_back(node);
+                nodes_seen.insert(node);
+            }
+    }
+    int fallback = nodes_seen.empty() ? 0 : *nodes_seen.begin();
+    for (int c : unplaced)
+    {
+        topo.cpus.push_back(c);
+        topo.node_of.push_back(fallback);
+        nodes_seen.insert(fallback);
+    }
+    topo.num_nodes = (int)nodes_seen.size();
+    return topo;
+}
+
+ThreadPlacement plan_placement(const CpuTopology &topology, int num_threads, int local_rank, int local_size)
+{
+    size_t lo = 0, hi = topology.cpus.size();
+    if (local_size > 1 && (int)topology.cpus.size() == topology.online_cpus)
+    {
+        size_t n = topology.cpus.size();
+        lo = (size_t)local_rank * n / local_size;
+        hi = (size_t)(local_rank + 1) * n / local_size;
+        if (lo == hi) // more ranks than CPUs
+        {
+            lo = (size_t)local_rank % n;
+            hi = lo + 1;
+        }
+    }
+    ThreadPlacement p;
+    size_t share = hi - lo;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        size_t k = (size_t)num_threads <= share ? (size_t)t * share / num_threads : (size_t)t % share;
+        p.cpu_of_thread.push_back(topology.cpus[lo + k]);
+        p.node_of_thread.push_back(topology.node_of[lo + k]);
+    }
+    return p;
+}
+
+bool pin_threads(const ThreadPlacement &placement)
+{
+    const int n = (int)placement.cpu_of_thread.size();
+    if (n == 0)
+        return false;
+#ifdef __linux__
+    if (!startup_mask_saved && sched_getaffinity(0, sizeof(startup_mask), &startup_mask) != 0)
+        return false;
+    startup_mask_saved = true;
+    bool ok = true;
+#pragma omp parallel num_threads(n) reduction(&& : ok)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(placement.cpu_of_thread[omp_get_thread_num()], &set);
+        ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+    return ok;
+#else
+    return false;
+#endif
+}
+
+bool release_thread()
+{
+#ifdef __linux__
+    return startup_mask_saved && pthread_setaffinity_np(pthread_self(), sizeof(startup_mask), &startup_mask) == 0;
+#else
+    return false;
+#endif
+}
+
+std::string describe_placement(const CpuTopology &topology, const ThreadPlacement &placement)
+{
+    std::ostringstream out;
+    out << topology.num_nodes << (topology.num_nodes == 1 ? " node, " : " nodes, ") << topology.cpus.size()
+        << " of " << topology.online_cpus << " CPUs";
+    std::set<int> nodes(placement.node_of_thread.begin(), placement.node_of_thread.end());
+    for (int node : nodes)
+    {
+        std::vector<int> threads;
+        std::set<int> cpus;
+        for (size_t t = 0; t < placement.node_of_thread.size(); ++t)
+            if (placement.node_of_thread[t] == node)
+            {
+                threads.push_back((int)t);
+                cpus.insert(placement.cpu_of_thread[t]);
+            }
+        out << (node == *nodes.begin() ? "; " : ", ") << "node " << node << ": threads " << format_list(threads)
+            << " on CPUs " << format_list(std::vector<int>(cpus.begin(), cpus.end()));
+    }
+    return out.str();
+}
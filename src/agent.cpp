@@ -1,115 +1,175 @@
 #include "agent.h"
+#include "strategies.h"
+#include <omp.h>
 #include <algorithm>
 
-Agent::Agent(int thread_id_, int agent_id_, AgentStrategy strategy_)
-    : thread_id(thread_id_), agent_id(agent_id_), strategy(strategy_), rng(static_cast<unsigned int>(agent_id_)), momentum_threshold(0.5), reversion_threshold(0.5), position(0) {}
+Agent::Agent(int thread_id_, int agent_id_, AgentStrategy strategy_, PriceStatistic reference_stat_, uint64_t seed)
+    : thread_id(thread_id_), agent_id(agent_id_), strategy(strategy_), reference_stat(reference_stat_), rng(seed, static_cast<uint32_t>(agent_id_)), momentum_threshold(0.5), reversion_threshold(0.5), position(0) {}
 
-std::vector<Order> Agent::generate_orders(
+int Agent::generate_orders(
     int instrument_id,
     double current_price,
     double historical_average,
-    int timestamp)
+    int timestamp,
+    std::vector<Order> &out)
 {
-
+    // Draws are keyed by the tick, in the same order as the AgentEngine
+    // kernels, so the result does not depend on earlier calls
+    rng.seek(static_cast<uint64_t>(timestamp));
     switch (strategy)
     {
     case AgentStrategy::RANDOM_WALK:
-        return random_walk_strategy(instrument_id, current_price, timestamp);
+        return random_walk_strategy(instrument_id, current_price, timestamp, out);
     case AgentStrategy::MOMENTUM:
-        return momentum_strategy(instrument_id, current_price, historical_average, timestamp);
+        return momentum_strategy(instrument_id, current_price, historical_average, timestamp, out);
     case AgentStrategy::MEAN_REVERSION:
-        return mean_reversion_strategy(instrument_id, current_price, historical_average, timestamp);
+        return mean_reversion_strategy(instrument_id, current_price, historical_average, timestamp, out);
     case AgentStrategy::MARKET_MAKER:
     default:
-        return market_maker_strategy(instrument_id, current_price, timestamp);
+        return market_maker_strategy(instrument_id, current_price, timestamp, out);
     }
 }
 
-std::vector<Order> Agent::random_walk_strategy(int instrument_id, double current_price, int timestamp)
+int Agent::random_walk_strategy(int instrument_id, double current_price, int timestamp, std::vector<Order> &out)
 {
-    std::uniform_real_distribution<double> uni(0.0, 1.0);
-    std::uniform_int_distribution<int> vol(1, 10);
-    std::vector<Order> orders;
-
-    bool buy = uni(rng) < 0.5;
-    double px = current_price * (buy ? 0.99 : 1.01);
+    bool buy = rng() < 0x80000000u;
+    double px = current_price * (buy ? RandomWalkParams::BUY_PRICE : RandomWalkParams::SELL_PRICE);
     Order o;
     o.agent_id = agent_id;
     o.instrument_id = instrument_id;
     o.price = px;
-    o.volume = vol(rng);
+    o.volume = 1 + (int)Philox::below(rng(), RandomWalkParams::MAX_VOLUME);
     o.is_buy = buy;
     o.timestamp = timestamp;
     o.order_id = 0;
-    orders.push_back(o);
-    return orders;
+    out.push_back(o);
+    return 1;
 }
 
-std::vector<Order> Agent::momentum_strategy(int instrument_id, double current_price, double historical_average, int timestamp)
+int Agent::momentum_strategy(int instrument_id, double current_price, double historical_average, int timestamp, std::vector<Order> &out)
 {
-    std::uniform_int_distribution<int> vol(1, 10);
-    std::vector<Order> orders;
-
-    bool buy = current_price > historical_average * (1.0 + 0.001 * momentum_threshold);
-    double px = current_price * (buy ? 1.005 : 0.995);
+    bool buy = current_price > historical_average * (1.0 + MomentumParams::THRESHOLD_SCALE * momentum_threshold);
+    double px = current_price * (buy ? MomentumParams::BUY_PRICE : MomentumParams::SELL_PRICE);
     Order o;
     o.agent_id = agent_id;
     o.instrument_id = instrument_id;
     o.price = px;
-    o.volume = vol(rng);
+    o.volume = 1 + (int)Philox::below(rng(), MomentumParams::MAX_VOLUME);
     o.is_buy = buy;
     o.timestamp = timestamp;
     o.order_id = 0;
-    orders.push_back(o);
-    return orders;
+    out.push_back(o);
+    return 1;
 }
 
-std::vector<Order> Agent::mean_reversion_strategy(int instrument_id, double current_price, double historical_average, int timestamp)
+int Agent::mean_reversion_strategy(int instrument_id, double current_price, double historical_average, int timestamp, std::vector<Order> &out)
 {
-    std::uniform_int_distribution<int> vol(1, 10);
-    std::vector<Order> orders;
-
-    bool buy = current_price < historical_average * (1.0 - 0.001 * reversion_threshold);
-    double px = current_price * (buy ? 1.002 : 0.998);
+    bool buy = current_price < historical_average * (1.0 - MeanReversionParams::THRESHOLD_SCALE * reversion_threshold);
+    double px = current_price * (buy ? MeanReversionParams::BUY_PRICE : MeanReversionParams::SELL_PRICE);
     Order o;
     o.agent_id = agent_id;
     o.instrument_id = instrument_id;
     o.price = px;
-    o.volume = vol(rng);
+    o.volume = 1 + (int)Philox::below(rng(), MeanReversionParams::MAX_VOLUME);
     o.is_buy = buy;
     o.timestamp = timestamp;
     o.order_id = 0;
-    orders.push_back(o);
-    return orders;
+    out.push_back(o);
+    return 1;
 }
 
-std::vector<Order> Agent::market_maker_strategy(int instrument_id, double current_price, int timestamp)
+int Agent::market_maker_strategy(int instrument_id, double current_price, int timestamp, std::vector<Order> &out)
 {
-    std::uniform_int_distribution<int> vol(1, 5);
-    std::vector<Order> orders;
-
     // Place a bid and an ask around the mid price
     {
         Order bid;
         bid.agent_id = agent_id;
         bid.instrument_id = instrument_id;
-        bid.price = current_price * 0.999;
-        bid.volume = vol(rng);
+        bid.price = current_price * MarketMakerParams::BID_PRICE;
+        bid.volume = 1 + (int)Philox::below(rng(), MarketMakerParams::MAX_VOLUME);
         bid.is_buy = true;
         bid.timestamp = timestamp;
         bid.order_id = 0;
-        orders.push_back(bid);
+        out.push_back(bid);
     }
     {
         Order ask;
         ask.agent_id = agent_id;
         ask.instrument_id = instrument_id;
-        ask.price = current_price * 1.001;
-        ask.volume = vol(rng);
+        ask.price = current_price * MarketMakerParams::ASK_PRICE;
+        ask.volume = 1 + (int)Philox::below(rng(), MarketMakerParams::MAX_VOLUME);
         ask.is_buy = false;
         ask.timestamp = timestamp;
         ask.order_id = 0;
-        orders.push_back(ask);
+        out.push_back(ask);
+    }
+    return 2;
+}
+
+// ---------------- AgentPool -----------------
+
+AgentPool::AgentPool(int rank, int num_agents, int num_instruments, int num_threads, uint64_t seed)
+    : base_agent_id(rank * num_agents)
+{
+    agents.reserve(num_agents);
+    instruments.reserve(num_agents);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        // owner of agent i under the schedule(static) split in generate_orders
+        int owner = (int)((long long)i * num_threads / num_agents);
+        AgentStrategy strategy = static_cast<AgentStrategy>(i % NUM_STRATEGIES);
+        agents.emplace_back(owner, base_agent_id + i, strategy, PriceStatistic::MEAN, seed);
+        instruments.push_back(i % num_instruments);
+    }
+}
+
+long long AgentPool::generate_orders(Exchange &exchange, int timestamp)
+{
+    long long submitted = 0;
+    int n = (int)agents.size();
+    if ((int)thread_orders.size() < omp_get_max_threads())
+        thread_orders.resize(omp_get_max_threads());
+
+#pragma omp parallel for schedule(static) reduction(+ : submitted)
+    for (int i = 0; i < n; ++i)
+    {
+        Agent &agent = agents[i];
+        int instrument_id = instruments[i];
+
+        // Agent observes market and decides on action, from the published
+        // snapshot so the read is safe while books are being matched
+        MarketSnapshot snap;
+        exchange.read_snapshot(instrument_id, snap);
+        double current_price = snap.last_price;
+        double historical_avg = snap.stats[static_cast<int>(agent.get_reference_statistic())];
+
+        std::vector<Order> &orders = thread_orders[omp_get_thread_num()].orders;
+        orders.clear();
+        agent.generate_orders(instrument_id, current_price, historical_avg, timestamp, orders);
+
+        // Submit orders to exchange (lock-free, into this thread's lane)
+        for (const auto &order : orders)
+        {
+            exchange.submit_order(order);
+            submitted++;
+        }
+    }
+    return submitted;
+}
+
+void AgentPool::apply_fills(const Exchange &exchange)
+{
+    int n = (int)agents.size();
+    for (int i = 0; i < exchange.get_num_instruments(); ++i)
+    {
+        for (const auto &t : exchange.get_instrument_trades(i))
+        {
+            int buyer = t.buy_agent_id - base_agent_id;
+            int seller = t.sell_agent_id - base_agent_id;
+            if (buyer >= 0 && buyer < n)
+                agents[buyer].apply_fill(t.volume, true);
+            if (seller >= 0 && seller < n)
+                agents[seller].apply_fill(t.volume, false);
+        }
     }
-    return orders;
 }
@@ -0,0 +1,411 @@
+#include "agent_engine.h"
+#include <omp.h>
+#include <algorithm>
+
+// Slots handled per scheduling unit; also the scratch size per thread
+static const int KERNEL_BLOCK = 1024;
+
+// Resize without touching new elements, so the caller's parallel fill
+// decides where the pages live. Storage is replaced only when it is short.
+template <typename T>
+static void resize_untouched(FirstTouchVector<T> &v, size_t n)
+{
+    if (v.capacity() < n)
+        FirstTouchVector<T>().swap(v);
+    v.resize(n);
+}
+
+static int total_agents(const std::vector<int> &agents_per_strategy)
+{
+    int n = 0;
+    for (int c : agents_per_strategy)
+        n += c;
+    return n;
+}
+
+AgentEngine::AgentEngine(int rank, int num_agents, int num_instruments_)
+    : base_agent_id(0), num_instruments(0), seed(0), order_lifetime(0), use_offload(false),
+      offload_stale(true)
+{
+    rebuild(rank, num_agents, num_instruments_);
+}
+
+AgentEngine::AgentEngine(int rank, const std::vector<int> &agents_per_strategy, int num_instruments_)
+    : base_agent_id(0), num_instruments(0), seed(0), order_lifetime(0), use_offload(false),
+      offload_stale(true)
+{
+    rebuild(rank, agents_per_strategy, num_instruments_);
+}
+
+void AgentEngine::rebuild(int rank, int num_agents, int num_instruments_)
+{
+    base_agent_id = rank * num_agents;
+    num_instruments = num_instruments_;
+    std::vector<AgentStrategy> strategy_of(num_agents);
+    for (int i = 0; i < num_agents; ++i)
+        strategy_of[i] = static_cast<AgentStrategy>(i % NUM_STRATEGIES);
+    build(strategy_of);
+}
+
+void AgentEngine::rebuild(int rank, const std::vector<int> &agents_per_strategy, int num_instruments_)
+{
+    base_agent_id = rank * total_agents(agents_per_strategy);
+    num_instruments = num_instruments_;
+    std::vector<AgentStrategy> strategy_of;
+    for (int s = 0; s < NUM_STRATEGIES && s < (int)agents_per_strategy.size(); ++s)
+        strategy_of.insert(strategy_of.end(), agents_per_strategy[s], static_cast<AgentStrategy>(s));
+    build(strategy_of);
+}
+
+void AgentEngine::build(const std::vector<AgentStrategy> &strategy_of)
+{
+    int num_agents = (int)strategy_of.size();
+    seed = 0;
+    order_lifetime = 0;
+    for (int s = 0; s < NUM_STRATEGIES; ++s)
+    {
+        kernels[s] = default_strategy(static_cast<AgentStrategy>(s));
+        reference_stats[s] = PriceStatistic::MEAN;
+    }
+    segments.clear();
+
+    // Bucket local agents by (instrument, strategy); within a bucket agents
+    // stay in ID order so the layout is deterministic. Instrument-major
+    // order keeps each instrument's agents in a few consecutive blocks, so
+    // one thread generates most of a book's orders.
+    int buckets = NUM_STRATEGIES * num_instruments;
+    std::vector<std::vector<int>> members(buckets);
+    for (int i = 0; i < num_agents; ++i)
+    {
+        int strategy = static_cast<int>(strategy_of[i]);
+        int instrument = i % num_instruments;
+        members[instrument * NUM_STRATEGIES + strategy].push_back(i);
+    }
+
+    std::vector<int> local_of_slot;
+    local_of_slot.reserve(num_agents);
+    slot_of.assign(num_agents, 0);
+    for (int b = 0; b < buckets; ++b)
+    {
+        if (members[b].empty())
+            continue;
+        AgentSegment seg;
+        seg.begin = (int)local_of_slot.size();
+        seg.strategy = static_cast<AgentStrategy>(b % NUM_STRATEGIES);
+        seg.instrument_id = b / NUM_STRATEGIES;
+        for (int local : members[b])
+        {
+            slot_of[local] = (int)local_of_slot.size();
+            local_of_slot.push_back(local);
+        }
+        seg.end = (int)local_of_slot.size();
+        segments.push_back(seg);
+    }
+
+    // Filled with the same blocks and schedule as generate_orders
+    resize_untouched(agent_ids, num_agents);
+    resize_untouched(thresholds, num_agents);
+    resize_untouched(positions, num_agents);
+    int blocks = (num_agents + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < blocks; ++b)
+    {
+        int end = std::min(num_agents, (b + 1) * KERNEL_BLOCK);
+        for (int i = b * KERNEL_BLOCK; i < end; ++i)
+        {
+            agent_ids[i] = base_agent_id + local_of_slot[i];
+            thresholds[i] = 0.5;
+            positions[i] = 0;
+        }
+    }
+    prices.assign(num_instruments, 0.0);
+    references.assign(buckets, 0.0);
+    offload_stale = true;
+}
+
+std::vector<int> AgentEngine::home_threads(int num_threads) const
+{
+    // Blocks per thread under schedule(static): an even split, the first
+    // (blocks % num_threads) threads taking one extra
+    num_threads = std::max(1, num_threads);
+    int n = (int)agent_ids.size();
+    int blocks = (n + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+    int per = blocks / num_threads, extra = blocks % num_threads;
+    std::vector<int> thread_of_block(blocks);
+    for (int t = 0, b = 0; t < num_threads; ++t)
+        for (int k = 0; k < per + (t < extra ? 1 : 0); ++k)
+            thread_of_block[b++] = t;
+
+    std::vector<std::vector<int>> slots(num_instruments, std::vector<int>(num_threads, 0));
+    for (const auto &seg : segments)
+        for (int b = seg.begin / KERNEL_BLOCK; b * KERNEL_BLOCK < seg.end; ++b)
+        {
+            int lo = std::max(seg.begin, b * KERNEL_BLOCK);
+            int hi = std::min(seg.end, (b + 1) * KERNEL_BLOCK);
+            slots[seg.instrument_id][thread_of_block[b]] += hi - lo;
+        }
+    std::vector<int> home(num_instruments);
+    for (int i = 0; i < num_instruments; ++i)
+    {
+        // Instruments without local agents are spread round-robin
+        home[i] = i % num_threads;
+        int best = 0;
+        for (int t = 0; t < num_threads; ++t)
+            if (slots[i][t] > best)
+            {
+                best = slots[i][t];
+                home[i] = t;
+            }
+    }
+    return home;
+}
+
+void AgentEngine::serialize(ByteWriter &out) const
+{
+    out.put_vector(agent_ids);
+    out.put_vector(thresholds);
+    out.put_vector(positions);
+    for (int s = 0; s < NUM_STRATEGIES; ++s)
+        out.put(reference_stats[s]);
+    out.put(seed);
+}
+
+bool AgentEngine::deserialize(ByteReader &in)
+{
+    // The layout is fixed by the constructor; only state may differ
+    std::vector<int> ids;
+    std::vector<double> thr;
+    std::vector<int> pos;
+    in.get_vector(ids);
+    in.get_vector(thr);
+    in.get_vector(pos);
+    PriceStatistic stats[NUM_STRATEGIES];
+    for (int s = 0; s < NUM_STRATEGIES; ++s)
+        in.get(stats[s]);
+    uint64_t saved_seed = 0;
+    in.get(saved_seed);
+    if (!in.ok() || saved_seed != seed || ids.size() != agent_ids.size() ||
+        !std::equal(ids.begin(), ids.end(), agent_ids.begin()) || thr.size() != ids.size() ||
+        pos.size() != ids.size())
+        return false;
+    // Copied rather than swapped in, so the arrays keep their placement
+    std::copy(thr.begin(), thr.end(), thresholds.begin());
+    std::copy(pos.begin(), pos.end(), positions.begin());
+    for (int s = 0; s < NUM_STRATEGIES; ++s)
+        reference_stats[s] = stats[s];
+    offload_stale = true;
+    return true;
+}
+
+void AgentEngine::set_strategy_kernel(const StrategyInfo &info)
+{
+    kernels[static_cast<int>(info.id)] = info;
+}
+
+bool AgentEngine::set_offload(bool on)
+{
+    use_offload = on && AgentOffload::available();
+    offload_stale = true;
+    return use_offload == on;
+}
+
+void AgentEngine::set_reference_statistic(AgentStrategy strategy, PriceStatistic stat)
+{
+    reference_stats[static_cast<int>(strategy)] = stat;
+}
+
+// Each segment runs its strategy's kernel (see strategies.h) over the
+// slots it shares with the block. Output index j is relative to the start
+// of the block. With continuous matching (live set) each segment re-reads
+// its instrument's snapshot, so agents react to fills earlier in the same
+// tick.
+void AgentEngine::run_kernels(int begin, int end, int timestamp, KernelScratch &out, const Exchange *live)
+{
+    KernelArgs args;
+    args.ids = agent_ids.data();
+    args.thresholds = thresholds.data();
+    args.seed = seed;
+    args.tick = (uint64_t)timestamp;
+    args.is_buy = out.is_buy.data() - begin;
+    args.order_price = out.price.data() - begin;
+    args.volume = out.volume.data() - begin;
+    args.ask_price = out.ask_price.data() - begin;
+    args.ask_volume = out.ask_volume.data() - begin;
+    for (const auto &seg : segments)
+    {
+        int lo = std::max(begin, seg.begin);
+        int hi = std::min(end, seg.end);
+        if (lo >= hi)
+            continue;
+
+        args.price = prices[seg.instrument_id];
+        MarketSnapshot snap;
+        if (live && live->read_snapshot(seg.instrument_id, snap))
+            args.price = snap.last_price;
+        args.reference = references[static_cast<int>(seg.strategy) * num_instruments + seg.instrument_id];
+        kernels[static_cast<int>(seg.strategy)].run(args, lo, hi);
+    }
+}
+
+long long AgentEngine::emit_orders(int begin, int end, const KernelScratch &out,
+                                   Exchange &exchange, int timestamp)
+{
+    long long submitted = 0;
+    for (const auto &seg : segments)
+    {
+        int lo = std::max(begin, seg.begin);
+        int hi = std::min(end, seg.end);
+        bool two_sided = kernels[static_cast<int>(seg.strategy)].two_sided;
+        for (int i = lo; i < hi; ++i)
+        {
+            int j = i - begin;
+            Order o;
+            o.agent_id = agent_ids[i];
+            o.instrument_id = seg.instrument_id;
+            o.price = out.price[j];
+            o.volume = out.volume[j];
+            o.is_buy = out.is_buy[j] != 0;
+            o.timestamp = timestamp;
+            if (order_lifetime > 0)
+            {
+                o.time_in_force = TimeInForce::GTD;
+                o.expire_tick = timestamp + order_lifetime - 1;
+            }
+            exchange.submit_order(o);
+            submitted++;
+            if (two_sided)
+            {
+                o.price = out.ask_price[j];
+                o.volume = out.ask_volume[j];
+                o.is_buy = false;
+                exchange.submit_order(o);
+                submitted++;
+            }
+        }
+    }
+    return submitted;
+}
+
+long long AgentEngine::generate_orders(Exchange &exchange, int timestamp)
+{
+    // Market snapshot read once per tick rather than once per agent
+    MarketSnapshot snap;
+    for (int inst = 0; inst < num_instruments; ++inst)
+    {
+        exchange.read_snapshot(inst, snap);
+        prices[inst] = snap.last_price;
+        for (int s = 0; s < NUM_STRATEGIES; ++s)
+            references[s * num_instruments + inst] = snap.stats[static_cast<int>(reference_stats[s])];
+    }
+
+    if (can_offload(exchange))
+        return generate_offloaded(exchange, timestamp);
+
+    if ((int)scratch.size() < omp_get_max_threads())
+        scratch.resize(omp_get_max_threads());
+
+    long long submitted = 0;
+    int n = (int)agent_ids.size();
+    int blocks = (n + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+    const Exchange *live = exchange.get_continuous() ? &exchange : nullptr;
+
+#pragma omp parallel for schedule(static) reduction(+ : submitted)
+    for (int b = 0; b < blocks; ++b)
+    {
+        KernelScratch &out = scratch[omp_get_thread_num()];
+        if (out.price.empty()) // first use, so the buffers land on this thread's node
+        {
+            out.is_buy.resize(KERNEL_BLOCK);
+            out.price.resize(KERNEL_BLOCK);
+            out.volume.resize(KERNEL_BLOCK);
+            out.ask_price.resize(KERNEL_BLOCK);
+            out.ask_volume.resize(KERNEL_BLOCK);
+        }
+        int begin = b * KERNEL_BLOCK;
+        int end = std::min(n, begin + KERNEL_BLOCK);
+        run_kernels(begin, end, timestamp, out, live);
+        submitted += emit_orders(begin, end, out, exchange, timestamp);
+    }
+    return submitted;
+}
+
+bool AgentEngine::can_offload(const Exchange &exchange) const
+{
+    if (!use_offload || exchange.get_continuous())
+        return false;
+    // The device runs the built-in kernels only
+    for (int s = 0; s < NUM_STRATEGIES; ++s)
+        if (kernels[s].run != default_strategy(static_cast<AgentStrategy>(s)).run)
+            return false;
+    return true;
+}
+
+// The device returns every order of the tick in slot order; they are
+// submitted with the host path's blocks and schedule, so each order goes
+// into the same lane, in the same position, as without offload.
+long long AgentEngine::generate_offloaded(Exchange &exchange, int timestamp)
+{
+    const int n = (int)agent_ids.size();
+    if (offload_stale)
+    {
+        std::vector<unsigned char> strategy_of(n);
+        std::vector<int> instrument_of(n);
+        for (const auto &seg : segments)
+            for (int i = seg.begin; i < seg.end; ++i)
+            {
+                strategy_of[i] = static_cast<unsigned char>(seg.strategy);
+                instrument_of[i] = seg.instrument_id;
+            }
+        offload.load(agent_ids.data(), thresholds.data(), strategy_of, instrument_of, num_instruments);
+        offload_stale = false;
+    }
+    const std::vector<DeviceOrder> &batch = offload.run(seed, (uint64_t)timestamp, prices.data(), references.data());
+
+    long long submitted = 0;
+    int blocks = (n + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+#pragma omp parallel for schedule(static) reduction(+ : submitted)
+    for (int b = 0; b < blocks; ++b)
+    {
+        int lo = offload.order_begin(b * KERNEL_BLOCK);
+        int hi = offload.order_begin(std::min(n, (b + 1) * KERNEL_BLOCK));
+        for (int k = lo; k < hi; ++k)
+        {
+            const DeviceOrder &d = batch[k];
+            Order o;
+            o.agent_id = d.agent_id;
+            o.instrument_id = d.instrument_id;
+            o.price = d.price;
+            o.volume = d.volume;
+            o.is_buy = d.is_buy != 0;
+            o.timestamp = timestamp;
+            if (order_lifetime > 0)
+            {
+                o.time_in_force = TimeInForce::GTD;
+                o.expire_tick = timestamp + order_lifetime - 1;
+            }
+            exchange.submit_order(o);
+        }
+        submitted += hi - lo;
+    }
+    return submitted;
+}
+
+void AgentEngine::apply_fills(const Exchange &exchange)
+{
+    for (int i = 0; i < exchange.get_num_instruments(); ++i)
+        apply_fills(exchange.get_instrument_trades(i));
+}
+
+void AgentEngine::apply_fills(const std::vector<Trade> &trades)
+{
+    int n = (int)agent_ids.size();
+    for (const auto &t : trades)
+    {
+        int buyer = t.buy_agent_id - base_agent_id;
+        int seller = t.sell_agent_id - base_agent_id;
+        if (buyer >= 0 && buyer < n)
+            positions[slot_of[buyer]] += t.volume;
+        if (seller >= 0 && seller < n)
+            positions[slot_of[seller]] -= t.volume;
+    }
+}
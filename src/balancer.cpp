@@ -0,0 +1,153 @@
+#include "balancer.h"
+#include "utils.h"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+LoadBalancer::LoadBalancer(int rank_, int size_, int interval_, double tolerance_,
+                           int max_moves_, LoadMetric metric_)
+    : rank(rank_), size(size_), interval(interval_), tolerance(tolerance_),
+      max_moves(max_moves_), metric(metric_), bytes_sent(0)
+{
+    outbound.resize(size);
+    send_counts.resize(size);
+    recv_counts.resize(size);
+    send_displs.resize(size);
+    recv_displs.resize(size);
+}
+
+std::vector<InstrumentMove> LoadBalancer::plan_moves(const std::vector<double> &cost,
+                                                     std::vector<int> &owners, int size,
+                                                     double tolerance, int max_moves)
+{
+    std::vector<InstrumentMove> planned;
+    std::vector<double> load(size, 0.0);
+    double total = 0.0;
+    for (size_t i = 0; i < cost.size(); ++i)
+    {
+        load[owners[i]] += cost[i];
+        total += cost[i];
+    }
+    if (total <= 0.0 || size < 2)
+        return planned;
+    double mean = total / size;
+
+    for (int m = 0; m < max_moves; ++m)
+    {
+        int hot = 0, cold = 0;
+        for (int r = 1; r < size; ++r)
+        {
+            if (load[r] > load[hot])
+                hot = r;
+            if (load[r] < load[cold])
+                cold = r;
+        }
+        double gap = load[hot] - load[cold];
+        if (gap <= tolerance * mean)
+            break;
+
+        // Moving cost c changes the pair's gap to |gap - 2c|; only c < gap
+        // improves it, and c closest to gap / 2 improves it most
+        int best = -1;
+        double best_dist = 0.0;
+        for (size_t i = 0; i < cost.size(); ++i)
+        {
+            if (owners[i] != hot || cost[i] <= 0.0 || cost[i] >= gap)
+                continue;
+            double dist = std::fabs(gap * 0.5 - cost[i]);
+            if (best < 0 || dist < best_dist)
+            {
+                best = (int)i;
+                best_dist = dist;
+            }
+        }
+        if (best < 0)
+            break;
+
+        InstrumentMove mv = {best, hot, cold, cost[best]};
+        planned.push_back(mv);
+        owners[best] = cold;
+        load[hot] -= cost[best];
+        load[cold] += cost[best];
+    }
+    return planned;
+}
+
+int LoadBalancer::rebalance(Exchange &exchange)
+{
+    int n = exchange.get_num_instruments();
+    local_cost.assign(n, 0.0);
+    cost.resize(n);
+    owners.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        owners[i] = exchange.get_owner(i);
+        if (exchange.is_local(i))
+            local_cost[i] = metric == LoadMetric::MATCH_CYCLES ? (double)exchange.get_match_cycles(i)
+                                                               : (double)exchange.get_booked_orders(i);
+    }
+    // Each instrument has one host, so the sum is that host's measurement
+    MPI_Allreduce(local_cost.data(), cost.data(), n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    exchange.reset_load_counters();
+
+    moves = plan_moves(cost, owners, size, tolerance, max_moves);
+    if (moves.empty())
+        return 0;
+
+    // Pack each outgoing book as [instrument id][byte count][state]
+    for (const auto &mv : moves)
+    {
+        if (mv.from != rank)
+            continue;
+        std::vector<char> &out = outbound[mv.to];
+        size_t header = out.size();
+        out.resize(header + 2 * sizeof(int));
+        exchange.export_book(mv.instrument_id, out);
+        int id = mv.instrument_id;
+        int bytes = mpi_count(out.size() - header - 2 * sizeof(int), "migrated book");
+        std::memcpy(out.data() + header, &id, sizeof(int));
+        std::memcpy(out.data() + header + sizeof(int), &bytes, sizeof(int));
+    }
+
+    send.clear();
+    for (int r = 0; r < size; ++r)
+    {
+        send_displs[r] = mpi_count(send.size(), "migrated books");
+        send_counts[r] = mpi_count(outbound[r].size(), "migrated books");
+        send.insert(send.end(), outbound[r].begin(), outbound[r].end());
+        outbound[r].clear();
+        if (r != rank)
+            bytes_sent += send_counts[r];
+    }
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    size_t total = 0;
+    for (int r = 0; r < size; ++r)
+    {
+        recv_displs[r] = mpi_count(total, "migrated books");
+        total += (size_t)recv_counts[r];
+    }
+    recv.resize(total);
+    MPI_Alltoallv(send.data(), send_counts.data(), send_displs.data(), MPI_BYTE,
+                  recv.data(), recv_counts.data(), recv_displs.data(), MPI_BYTE, MPI_COMM_WORLD);
+
+    // Every rank applies the same owner changes; the new hosts then load
+    // the books they received
+    for (const auto &mv : moves)
+        exchange.set_owner(mv.instrument_id, mv.to);
+    size_t pos = 0;
+    while (pos + 2 * sizeof(int) <= recv.size())
+    {
+        int id = 0, bytes = 0;
+        std::memcpy(&id, recv.data() + pos, sizeof(int));
+        std::memcpy(&bytes, recv.data() + pos + sizeof(int), sizeof(int));
+        pos += 2 * sizeof(int);
+        if (!exchange.import_book(id, recv.data() + pos, (size_t)bytes))
+        {
+            // The sender has already dropped its copy, so the book is lost
+            std::cerr << "Rank " << rank << ": cannot load migrated book " << id << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        pos += (size_t)bytes;
+    }
+    return (int)moves.size();
+}
@@ -0,0 +1,180 @@
+#include "checkpoint.h"
+#include "affinity.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mpi.h>
+
+static uint64_t fnv1a(const char *data, size_t n)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < n; ++i)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+std::string checkpoint_path(const std::string &prefix, int rank, int slot)
+{
+    return prefix + "_rank_" + std::to_string(rank) + "_" + std::to_string(slot) + ".bin";
+}
+
+CheckpointWriter::CheckpointWriter(int rank_, int num_ranks_, const std::string &prefix_)
+    : rank(rank_), num_ranks(num_ranks_), prefix(prefix_), active(0), slot(0), pending(false),
+      stopping(false), failed(false), pending_tick(-1), pending_slot(0), written_tick(-1)
+{
+    io = std::thread(&CheckpointWriter::io_loop, this);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+    finish();
+}
+
+void CheckpointWriter::io_loop()
+{
+    // Started by the pinned main thread; keep off worker 0's CPU
+    release_thread();
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        cv.wait(lock, [this] { return pending || stopping; });
+        if (!pending)
+            return;
+
+        // The inactive buffer is ours until pending is cleared
+        const std::vector<char> &data = buffers[active ^ 1];
+        int tick = pending_tick;
+        std::string path = checkpoint_path(prefix, rank, pending_slot);
+        lock.unlock();
+
+        CheckpointHeader h;
+        std::memcpy(h.magic, "TSCKPT03", 8);
+        h.rank = rank;
+        h.num_ranks = num_ranks;
+        h.tick = tick;
+        h.reserved = 0;
+        h.payload_bytes = data.size();
+        h.checksum = fnv1a(data.data(), data.size());
+        std::string tmp = path + ".tmp";
+        std::FILE *f = std::fopen(tmp.c_str(), "wb");
+        bool ok = f && std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+                  (data.empty() || std::fwrite(data.data(), 1, data.size(), f) == data.size());
+        if (f)
+            ok = std::fclose(f) == 0 && ok;
+        std::error_code ec;
+        if (ok)
+            std::filesystem::rename(tmp, path, ec);
+        ok = ok && !ec;
+
+        lock.lock();
+        failed = failed || !ok;
+        if (ok)
+            written_tick = tick;
+        pending = false;
+        cv.notify_all();
+    }
+}
+
+std::vector<char> &CheckpointWriter::buffer()
+{
+    buffers[active].clear(); // capacity kept from earlier checkpoints
+    return buffers[active];
+}
+
+void CheckpointWriter::commit(int tick)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !pending; });
+    active ^= 1;
+    pending_tick = tick;
+    pending_slot = slot;
+    slot ^= 1;
+    pending = true;
+    cv.notify_all();
+}
+
+bool CheckpointWriter::finish()
+{
+    if (io.joinable())
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return !pending; });
+            stopping = true;
+            cv.notify_all();
+        }
+        io.join();
+    }
+    return !failed;
+}
+
+int CheckpointWriter::last_written_tick()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return written_tick;
+}
+
+bool read_checkpoint(const std::string &filename, CheckpointHeader &header, std::vector<char> &payload)
+{
+    std::FILE *f = std::fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    bool ok = std::fread(&header, sizeof(header), 1, f) == 1 && std::memcmp(header.magic, "TSCKPT03", 8) == 0;
+    if (ok)
+    {
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(filename, ec);
+        ok = !ec && size == sizeof(header) + header.payload_bytes;
+    }
+    if (ok)
+    {
+        payload.resize(header.payload_bytes);
+        ok = payload.empty() || std::fread(payload.data(), 1, payload.size(), f) == payload.size();
+        ok = ok && fnv1a(payload.data(), payload.size()) == header.checksum;
+    }
+    std::fclose(f);
+    return ok;
+}
+
+bool load_latest_checkpoint(const std::string &prefix, int rank, int num_ranks, int &tick,
+                            std::vector<char> &payload, int *loaded_slot)
+{
+    // Each rank reports the ticks of its valid slots (-1 for none)
+    std::vector<char> slots[2];
+    int mine[2];
+    for (int s = 0; s < 2; ++s)
+    {
+        CheckpointHeader h;
+        bool ok = read_checkpoint(checkpoint_path(prefix, rank, s), h, slots[s]) && h.rank == rank &&
+                  h.num_ranks == num_ranks;
+        mine[s] = ok ? h.tick : -1;
+    }
+    std::vector<int> all(2 * num_ranks);
+    MPI_Allgather(mine, 2, MPI_INT, all.data(), 2, MPI_INT, MPI_COMM_WORLD);
+
+    // Newest tick every rank has; ranks differ by at most one checkpoint
+    // when a run is killed while writing
+    int best = -1;
+    for (int s = 0; s < 2; ++s)
+    {
+        int candidate = all[s];
+        if (candidate <= best)
+            continue;
+        bool everywhere = true;
+        for (int r = 1; r < num_ranks && everywhere; ++r)
+            everywhere = all[2 * r] == candidate || all[2 * r + 1] == candidate;
+        if (everywhere)
+            best = candidate;
+    }
+    if (best < 0)
+        return false;
+    int s = mine[0] == best ? 0 : 1;
+    tick = best;
+    payload.swap(slots[s]);
+    if (loaded_slot)
+        *loaded_slot = s;
+    return true;
+}
@@ -0,0 +1,149 @@
+#include "comm_thread.h"
+#include "affinity.h"
+#include <chrono>
+
+// How often an idle communication thread tests in-flight reductions
+static const std::chrono::microseconds PROGRESS_INTERVAL(50);
+
+CommThread::CommThread(int rank, int size, int staleness_, int snapshot_interval_, bool dedicated_)
+    : md(rank, size), staleness(staleness_), snapshot_interval(snapshot_interval_), dedicated(dedicated_),
+      posted(0), done(0), stopping(false), result_ready(false), bytes_sent(0)
+{
+    md.set_staleness(staleness);
+    md.set_snapshot_interval(snapshot_interval);
+    if (dedicated)
+        thread = std::thread(&CommThread::loop, this);
+}
+
+CommThread::~CommThread()
+{
+    if (!thread.joinable())
+        return;
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        wait_idle(lock);
+        stopping = true;
+        cv.notify_all();
+    }
+    thread.join();
+}
+
+void CommThread::loop()
+{
+    // Started by a pinned worker; run beside the team rather than on its CPU
+    release_thread();
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        if (done < posted)
+        {
+            std::function<void()> fn;
+            fn.swap(job);
+            lock.unlock();
+            fn();
+            lock.lock();
+            done++;
+            cv.notify_all();
+            continue;
+        }
+        if (stopping)
+            return;
+        if (md.get_in_flight() > 0)
+        {
+            // Open MPI only advances a non-blocking collective inside MPI
+            // calls, so poke it while the workers are busy
+            lock.unlock();
+            md.progress();
+            lock.lock();
+            if (done == posted && !stopping)
+                cv.wait_for(lock, PROGRESS_INTERVAL);
+        }
+        else
+            cv.wait(lock);
+    }
+}
+
+void CommThread::wait_idle(std::unique_lock<std::mutex> &lock)
+{
+    cv.wait(lock, [this] { return done == posted; });
+}
+
+void CommThread::exchange_market_data()
+{
+    if (snapshot_interval > 0)
+    {
+        md.publish_deltas(send_prices, send_volumes, result);
+        result_ready = true;
+    }
+    else if (md.exchange_prices(send_prices, result))
+        result_ready = true;
+    bytes_sent.store(md.get_bytes_sent(), std::memory_order_relaxed);
+}
+
+void CommThread::call(const std::function<void()> &fn)
+{
+    if (!dedicated)
+    {
+        fn();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    wait_idle(lock);
+    job = fn;
+    posted++;
+    cv.notify_all();
+    wait_idle(lock);
+}
+
+bool CommThread::publish(const std::vector<double> &local_prices, const std::vector<int> &tick_volumes,
+                         std::vector<double> &global_prices)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    wait_idle(lock); // the previous exchange has finished with the buffers
+    bool fresh = false;
+    if (dedicated && result_ready)
+    {
+        global_prices.assign(result.begin(), result.end());
+        result_ready = false;
+        fresh = true;
+    }
+    send_prices.assign(local_prices.begin(), local_prices.end());
+    send_volumes.assign(tick_volumes.begin(), tick_volumes.end());
+    if (!dedicated)
+    {
+        lock.unlock();
+        exchange_market_data();
+        if (!result_ready)
+            return false;
+        global_prices.assign(result.begin(), result.end());
+        result_ready = false;
+        return true;
+    }
+    job = [this] { exchange_market_data(); };
+    posted++;
+    cv.notify_all();
+    return fresh;
+}
+
+void CommThread::progress()
+{
+    if (!dedicated)
+        md.progress();
+}
+
+void CommThread::synchronize()
+{
+    call([this] { md.synchronize(); });
+}
+
+bool CommThread::drain(std::vector<double> &global_prices)
+{
+    bool drained = false;
+    call([this, &drained] { drained = md.drain(result); });
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!drained && !result_ready)
+        return false;
+    global_prices.assign(result.begin(), result.end());
+    result_ready = false;
+    return true;
+}
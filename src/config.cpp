@@ -0,0 +1,292 @@
+#include "config.h"
+#include "strategies.h"
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// Suffix of the per-strategy count options: "<strategy name>_agents"
+static const std::string AGENTS_SUFFIX = "_agents";
+
+struct OptionHelp {
+    const char *key;
+    const char *help;
+};
+
+static const OptionHelp OPTIONS[] = {
+    {"instruments", "instruments per exchange (3)"},
+    {"agents", "agents per exchange, strategies interleaved (1000)"},
+    {"random_walk_agents", "explicit strategy mix; any of these four replaces 'agents'"},
+    {"momentum_agents", ""},
+    {"mean_reversion_agents", ""},
+    {"market_maker_agents", ""},
+    {"threads", "OpenMP threads per rank (8)"},
+    {"ticks", "simulation ticks (1000)"},
+    {"seed", "agent RNG seed (0)"},
+    {"staleness", "ticks global prices may lag, 0 = blocking + barrier (0)"},
+    {"snapshot_interval", "delta market data with a snapshot every N ticks, 0 = off (0)"},
+    {"shard", "one market with instruments sharded across ranks (false)"},
+    {"rebalance_interval", "sharded only: migrate books every N ticks, 0 = never (100)"},
+    {"bar_interval", "ticks per OHLC bar in price_history.bin (1)"},
+    {"replay", "recorded order feed or trade log to replay (none)"},
+    {"replay_speed", "recorded ticks per simulation tick (1)"},
+    {"checkpoint_interval", "checkpoint every N ticks, 0 = never (0)"},
+    {"matchers", "continuous matching with N matcher threads, 0 = batch per tick (0)"},
+    {"order_lifetime", "agent orders expire after N ticks, 0 = rest until filled (0)"},
+    {"pin_threads", "bind threads to CPUs and books to their home thread (true)"},
+    {"comm_thread", "dedicated MPI thread, market data overlaps the next tick (false)"},
+    {"offload", "agent kernels on the OpenMP target device, TRADING_OFFLOAD builds (false)"},
+    {"output_prefix", "prefix for every output file (none)"},
+};
+
+// Options that may be given on the command line without a value
+static bool is_flag(const std::string &key)
+{
+    return key == "restart" || key == "shard" || key == "pin_threads" || key == "comm_thread" ||
+           key == "offload";
+}
+
+static bool parse_long(const std::string &text, long long min_value, long long &out)
+{
+    if (text.empty())
+        return false;
+    errno = 0;
+    char *end = nullptr;
+    long long v = std::strtoll(text.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || v < min_value || v > 0x7fffffffLL)
+        return false;
+    out = v;
+    return true;
+}
+
+static bool parse_int(const std::string &text, long long min_value, int &field)
+{
+    long long v = 0;
+    if (!parse_long(text, min_value, v))
+        return false;
+    field = (int)v;
+    return true;
+}
+
+static bool parse_bool(const std::string &text, bool &out)
+{
+    if (text == "1" || text == "true" || text == "yes" || text == "on")
+        out = true;
+    else if (text == "0" || text == "false" || text == "no" || text == "off")
+        out = false;
+    else
+        return false;
+    return true;
+}
+
+static std::string trim(const std::string &s)
+{
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+        return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+int SimConfig::total_agents() const
+{
+    if (agents_per_strategy.empty())
+        return num_agents;
+    int n = 0;
+    for (int c : agents_per_strategy)
+        n += c;
+    return n;
+}
+
+bool set_config_value(SimConfig &config, const std::string &key, const std::string &value,
+                      std::string &error)
+{
+    bool ok = true;
+    if (key == "instruments")
+        ok = parse_int(value, 1, config.num_instruments);
+    else if (key == "agents")
+        ok = parse_int(value, 0, config.num_agents);
+    else if (key == "threads")
+        ok = parse_int(value, 1, config.num_threads);
+    else if (key == "ticks")
+        ok = parse_int(value, 0, config.ticks);
+    else if (key == "seed")
+    {
+        errno = 0;
+        char *end = nullptr;
+        unsigned long long s = std::strtoull(value.c_str(), &end, 0);
+        ok = !value.empty() && value[0] != '-' && errno == 0 && *end == '\0';
+        if (ok)
+            config.seed = s;
+    }
+    else if (key == "staleness")
+        ok = parse_int(value, 0, config.price_staleness);
+    else if (key == "snapshot_interval")
+        ok = parse_int(value, 0, config.snapshot_interval);
+    else if (key == "shard")
+        ok = parse_bool(value, config.shard_instruments);
+    else if (key == "rebalance_interval")
+        ok = parse_int(value, 0, config.rebalance_interval);
+    else if (key == "bar_interval")
+        ok = parse_int(value, 1, config.history_bar_interval);
+    else if (key == "replay")
+        config.replay_file = value;
+    else if (key == "replay_speed")
+        ok = parse_int(value, 1, config.replay_speed);
+    else if (key == "checkpoint_interval")
+        ok = parse_int(value, 0, config.checkpoint_interval);
+    else if (key == "matchers")
+        ok = parse_int(value, 0, config.continuous_matchers);
+    else if (key == "order_lifetime")
+        ok = parse_int(value, 0, config.order_lifetime);
+    else if (key == "pin_threads")
+        ok = parse_bool(value, config.pin_threads);
+    else if (key == "comm_thread")
+        ok = parse_bool(value, config.comm_thread);
+    else if (key == "offload")
+        ok = parse_bool(value, config.offload);
+    else if (key == "output_prefix")
+        config.output_prefix = value;
+    else if (key == "restart")
+        ok = parse_bool(value, config.restart);
+    else
+    {
+        // Strategy counts are looked up in the strategy registry
+        const StrategyInfo *strategy = nullptr;
+        if (key.size() > AGENTS_SUFFIX.size() &&
+            key.compare(key.size() - AGENTS_SUFFIX.size(), AGENTS_SUFFIX.size(), AGENTS_SUFFIX) == 0)
+            strategy = find_strategy(key.substr(0, key.size() - AGENTS_SUFFIX.size()));
+        if (!strategy)
+        {
+            error = "unknown option '" + key + "'";
+            return false;
+        }
+        int count = 0;
+        ok = parse_int(value, 0, count);
+        if (ok)
+        {
+            config.agents_per_strategy.resize(NUM_STRATEGIES, 0);
+            config.agents_per_strategy[static_cast<int>(strategy->id)] = count;
+        }
+    }
+    if (!ok)
+        error = "bad value '" + value + "' for option '" + key + "'";
+    return ok;
+}
+
+bool load_config_file(const std::string &filename, const SimConfig &defaults,
+                      std::vector<SimConfig> &runs, std::string &error)
+{
+    std::ifstream in(filename);
+    if (!in)
+    {
+        error = "cannot open config file '" + filename + "'";
+        return false;
+    }
+    SimConfig base = defaults;
+    runs.clear();
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line))
+    {
+        ++line_no;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        line = trim(line);
+        if (line.empty())
+            continue;
+        if (line == "[run]")
+        {
+            runs.push_back(base);
+            continue;
+        }
+        size_t eq = line.find('=');
+        std::string key = trim(line.substr(0, eq));
+        std::string value = eq == std::string::npos ? "" : trim(line.substr(eq + 1));
+        SimConfig &target = runs.empty() ? base : runs.back();
+        if (eq == std::string::npos || !set_config_value(target, key, value, error))
+        {
+            if (eq == std::string::npos)
+                error = "expected key = value";
+            error = filename + ":" + std::to_string(line_no) + ": " + error;
+            return false;
+        }
+    }
+    if (runs.empty())
+        runs.push_back(base);
+    return true;
+}
+
+bool parse_command_line(int argc, char **argv, std::vector<SimConfig> &runs, std::string &error)
+{
+    std::string config_file;
+    std::vector<std::pair<std::string, std::string>> overrides;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            error = config_usage();
+            return false;
+        }
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            error = "unexpected argument '" + arg + "'";
+            return false;
+        }
+        std::string key = arg.substr(2), value;
+        size_t eq = key.find('=');
+        if (eq != std::string::npos)
+        {
+            value = key.substr(eq + 1);
+            key.erase(eq);
+        }
+        // Command line spelling uses dashes; files and keys use underscores
+        for (auto &c : key)
+            if (c == '-')
+                c = '_';
+        if (eq == std::string::npos)
+        {
+            // A switch followed by another option or nothing means on
+            if (is_flag(key) && (i + 1 >= argc || std::string(argv[i + 1]).compare(0, 2, "--") == 0))
+                value = "true";
+            else if (i + 1 < argc)
+                value = argv[++i];
+            else
+            {
+                error = "option '--" + key + "' needs a value";
+                return false;
+            }
+        }
+        if (key == "config")
+            config_file = value;
+        else
+            overrides.push_back(std::make_pair(key, value));
+    }
+
+    runs.assign(1, SimConfig());
+    if (!config_file.empty() && !load_config_file(config_file, SimConfig(), runs, error))
+        return false;
+    for (auto &run : runs)
+        for (const auto &kv : overrides)
+            if (!set_config_value(run, kv.first, kv.second, error))
+                return false;
+    return true;
+}
+
+std::string config_usage()
+{
+    std::ostringstream out;
+    out << "usage: trading_sim [--config FILE] [--restart] [--option value ...]\n"
+        << "Options (also valid as 'option = value' lines in a config file; a\n"
+        << "'[run]' line starts another run of a sweep):\n";
+    for (const auto &o : OPTIONS)
+    {
+        out << "  --" << o.key;
+        for (size_t pad = std::string(o.key).size(); pad < 24; ++pad)
+            out << ' ';
+        out << o.help << "\n";
+    }
+    return out.str();
+}
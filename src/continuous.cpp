@@ -0,0 +1,242 @@
+#include "continuous.h"
+#include "affinity.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+
+// Orders a matcher takes from one ring before moving to the next, so a
+// busy lane cannot starve the others
+static const int MATCH_BATCH = 64;
+// Empty polling rounds a matcher spins, then yields, before it parks
+static const int IDLE_SPINS = 256;
+static const int IDLE_YIELDS = 1024;
+
+// Histogram bucket of a latency in cycles: exact below 8, then eight
+// sub-buckets per power of two
+static int latency_bucket(uint64_t cycles)
+{
+    if (cycles < 8)
+        return (int)cycles;
+    int msb = 3;
+    while (msb < 63 && (cycles >> (msb + 1)) != 0)
+        ++msb;
+    return (msb - 2) * 8 + (int)((cycles >> (msb - 3)) & 7);
+}
+
+// Midpoint of a bucket in cycles
+static double bucket_cycles(int bucket)
+{
+    if (bucket < 8)
+        return bucket;
+    int msb = bucket / 8 + 2;
+    double width = std::ldexp(1.0, msb - 3);
+    return (8 + bucket % 8) * width + width * 0.5;
+}
+
+ContinuousEngine::ContinuousEngine(Exchange &exchange_, int num_matchers, size_t ring_capacity)
+    : exchange(exchange_), num_producers(exchange_.get_num_lanes() + 1), stopping(false)
+{
+    num_matchers = std::max(1, num_matchers);
+    for (int i = 0; i < num_producers * num_matchers; ++i)
+        rings.emplace_back(new SpscRing<Entry>(ring_capacity));
+    for (int i = 0; i < exchange.get_num_instruments(); ++i)
+    {
+        instruments.emplace_back(new InstrumentState());
+        instruments[i]->booked = 0;
+        instruments[i]->cycles = 0;
+    }
+    for (int m = 0; m < num_matchers; ++m)
+    {
+        matchers.emplace_back(new Matcher());
+        matchers[m]->histogram.assign(LATENCY_BUCKETS, 0);
+        matchers[m]->orders = 0;
+        matchers[m]->total_cycles = 0;
+        matchers[m]->max_cycles = 0;
+        matchers[m]->sleeping.store(false);
+    }
+    exchange.continuous = this;
+    for (int m = 0; m < num_matchers; ++m)
+        matchers[m]->thread = std::thread(&ContinuousEngine::matcher_loop, this, m);
+}
+
+ContinuousEngine::~ContinuousEngine()
+{
+    for (auto &ring : rings)
+        while (!ring->empty())
+            std::this_thread::yield();
+    {
+        std::lock_guard<std::mutex> lock(wake_mtx);
+        stopping.store(true);
+    }
+    wake_cv.notify_all();
+    for (auto &m : matchers)
+        m->thread.join();
+    if (exchange.continuous == this)
+        exchange.continuous = nullptr;
+}
+
+void ContinuousEngine::wake(Matcher &m)
+{
+    // Pairs with the fence in matcher_loop: either the matcher sees the new
+    // entry before parking or this thread sees it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m.sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(wake_mtx);
+        wake_cv.notify_all();
+    }
+}
+
+void ContinuousEngine::submit(int producer, const Order &order)
+{
+    const int nm = (int)matchers.size();
+    const int m = order.instrument_id % nm;
+    SpscRing<Entry> &ring = *rings[producer * nm + m];
+    Entry e;
+    e.order = order;
+    e.submit_tsc = read_tsc();
+    while (!ring.try_push(e))
+        std::this_thread::yield();
+    wake(*matchers[m]);
+}
+
+void ContinuousEngine::matcher_loop(int m)
+{
+    // Not one of the pinned OpenMP team; run anywhere it is allowed
+    release_thread();
+    Matcher &me = *matchers[m];
+    const int nm = (int)matchers.size();
+    int idle = 0;
+    for (;;)
+    {
+        bool worked = false;
+        for (int p = 0; p < num_producers; ++p)
+        {
+            SpscRing<Entry> &ring = *rings[p * nm + m];
+            for (int k = 0; k < MATCH_BATCH; ++k)
+            {
+                const Entry *e = ring.front();
+                if (!e)
+                    break;
+                const int i = e->order.instrument_id;
+                InstrumentState &st = *instruments[i];
+                OrderBook &book = exchange.order_books[i];
+                uint64_t start = read_tsc();
+                book.expire_orders(e->order.timestamp);
+                book.apply(e->order);
+                book.match_orders(e->order.timestamp, st.fills);
+                exchange.publish_snapshot(i, e->order.timestamp);
+                uint64_t end = read_tsc();
+                st.booked++;
+                st.cycles += end - start;
+
+                uint64_t latency = end - e->submit_tsc;
+                me.histogram[latency_bucket(latency)]++;
+                me.orders++;
+                me.total_cycles += latency;
+                me.max_cycles = std::max(me.max_cycles, latency);
+                ring.pop();
+                worked = true;
+            }
+        }
+        if (worked)
+        {
+            idle = 0;
+            continue;
+        }
+        if (stopping.load(std::memory_order_acquire))
+            return;
+        if (++idle < IDLE_SPINS)
+            continue;
+        if (idle < IDLE_SPINS + IDLE_YIELDS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Park until a producer pushes. The lock is held from the final
+        // check until wait releases it, so a wake-up cannot fall between
+        std::unique_lock<std::mutex> lock(wake_mtx);
+        me.sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool pending = false;
+        for (int p = 0; p < num_producers && !pending; ++p)
+            pending = !rings[p * nm + m]->empty();
+        if (!pending && !stopping.load(std::memory_order_relaxed))
+            wake_cv.wait(lock);
+        me.sleeping.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+int ContinuousEngine::complete_tick(int current_tick, std::vector<std::vector<Trade>> &out)
+{
+    // An empty ring means its matcher has popped, and so finished, every
+    // order in it; the acquire in empty() makes the books and fills visible
+    for (auto &ring : rings)
+        while (!ring->empty())
+            std::this_thread::yield();
+
+    int total = 0;
+    for (int i = 0; i < (int)instruments.size(); ++i)
+    {
+        InstrumentState &st = *instruments[i];
+        out[i].clear();
+        out[i].swap(st.fills); // both buffers keep their capacity
+        total += (int)out[i].size();
+        exchange.booked_orders[i] += st.booked;
+        exchange.match_cycles[i] += st.cycles;
+        st.booked = 0;
+        st.cycles = 0;
+        // Books that saw no orders this tick still retire their GTD orders
+        if (exchange.is_local(i) && exchange.order_books[i].expire_orders(current_tick) > 0)
+            exchange.publish_snapshot(i, current_tick);
+    }
+    return total;
+}
+
+MatchLatency ContinuousEngine::get_latency() const
+{
+    MatchLatency r = {0, 0.0, 0.0, 0.0, 0.0};
+    std::vector<long long> histogram(LATENCY_BUCKETS, 0);
+    unsigned long long total = 0;
+    uint64_t max_cycles = 0;
+    for (const auto &m : matchers)
+    {
+        for (int b = 0; b < LATENCY_BUCKETS; ++b)
+            histogram[b] += m->histogram[b];
+        r.orders += m->orders;
+        total += m->total_cycles;
+        max_cycles = std::max(max_cycles, m->max_cycles);
+    }
+    if (r.orders == 0)
+        return r;
+
+    const double per_ns = tsc_cycles_per_ns();
+    const long long p50 = (r.orders + 1) / 2;
+    const long long p99 = r.orders - r.orders / 100;
+    long long seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; ++b)
+    {
+        long long before = seen;
+        seen += histogram[b];
+        if (before < p50 && seen >= p50)
+            r.p50_ns = bucket_cycles(b) / per_ns;
+        if (before < p99 && seen >= p99)
+            r.p99_ns = bucket_cycles(b) / per_ns;
+    }
+    r.mean_ns = (double)total / r.orders / per_ns;
+    r.max_ns = max_cycles / per_ns;
+    return r;
+}
+
+void ContinuousEngine::reset_latency()
+{
+    for (auto &m : matchers)
+    {
+        std::fill(m->histogram.begin(), m->histogram.end(), 0LL);
+        m->orders = 0;
+        m->total_cycles = 0;
+        m->max_cycles = 0;
+    }
+}
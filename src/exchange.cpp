@@ -1,120 +1,1185 @@
 #include "exchange.h"
+#include <mpi.h>
+#include "continuous.h"
+#include "trade_log.h"
+#include "utils.h"
+#include <omp.h>
 #include <algorithm>
-#include <numeric>
+#include <climits>
+#include <cmath>
+#include <cstring>
 #include <sstream>
 
 // ---------------- OrderBook -----------------
 
-static bool bid_cmp(const Order &a, const Order &b)
+// Width in ticks of a freshly centred price ladder
+static const size_t LADDER_WIDTH = 1024;
+// Most ticks a ladder may span (~20 MiB of levels); orders priced beyond
+// it are rejected rather than growing the window without bound
+static const size_t MAX_LADDER_WIDTH = (size_t)1 << 20;
+// Prices further than this many ticks from zero cannot be booked
+static const double MAX_ABS_TICKS = 1e15;
+
+// ---------------- OrderSlab -----------------
+
+OrderSlab::OrderSlab(const OrderSlab &other) : free_head(NO_CHUNK), used(0)
+{
+    *this = other;
+}
+
+OrderSlab &OrderSlab::operator=(const OrderSlab &other)
+{
+    if (this == &other)
+        return *this;
+    // Only chunks below the high water mark hold anything, free list included
+    while (pages.size() * PAGE_CHUNKS < other.used)
+        pages.emplace_back(new OrderChunk[PAGE_CHUNKS]);
+    for (uint32_t c = 0; c < other.used; c += PAGE_CHUNKS)
+        std::memcpy(pages[c / PAGE_CHUNKS].get(), other.pages[c / PAGE_CHUNKS].get(),
+                    std::min(PAGE_CHUNKS, other.used - c) * sizeof(OrderChunk));
+    free_head = other.free_head;
+    used = other.used;
+    return *this;
+}
+
+uint32_t OrderSlab::allocate()
+{
+    if (free_head != NO_CHUNK)
+    {
+        uint32_t chunk = free_head;
+        free_head = at(chunk).next;
+        return chunk;
+    }
+    if (used == pages.size() * PAGE_CHUNKS)
+        pages.emplace_back(new OrderChunk[PAGE_CHUNKS]); // default-initialized: not touched here
+    return used++;
+}
+
+// ---------------- PriceLadder -----------------
+
+PriceLadder::PriceLadder(bool is_bid_)
+    : base_tick(0), best_tick(0), active_levels(0), is_bid(is_bid_) {}
+
+void PriceLadder::reset(long long center_tick, size_t width)
+{
+    // Levels only index into the slab, so dropping both releases every
+    // order without walking the queues
+    levels.assign(width, PriceLevel());
+    slab.reset();
+    base_tick = center_tick - (long long)(width / 2);
+    best_tick = center_tick;
+    active_levels = 0;
+}
+
+bool PriceLadder::ensure_range(long long tick)
+{
+    bool inside = !levels.empty() && tick >= base_tick && tick < base_tick + (long long)levels.size();
+    if (!inside && active_levels == 0)
+    {
+        // Nothing rests on this side, so the window can move to the price
+        // instead of stretching towards it
+        reset(tick, LADDER_WIDTH);
+        return true;
+    }
+    if (tick < base_tick)
+    {
+        // grow downwards by at least the current width to amortize the shift
+        size_t needed = (size_t)(base_tick - tick);
+        if (needed > MAX_LADDER_WIDTH - levels.size())
+            return false;
+        size_t grow = std::min(std::max(needed, levels.size()), MAX_LADDER_WIDTH - levels.size());
+        levels.insert(levels.begin(), grow, PriceLevel());
+        base_tick -= (long long)grow;
+    }
+    else if (tick >= base_tick + (long long)levels.size())
+    {
+        size_t needed = (size_t)(tick - base_tick) + 1;
+        if (needed > MAX_LADDER_WIDTH)
+            return false;
+        levels.resize(std::min(std::max(needed, levels.size() * 2), MAX_LADDER_WIDTH));
+    }
+    return true;
+}
+
+uint64_t PriceLadder::push(const RestingOrder &order)
+{
+    long long tick = order.price_ticks;
+    ensure_range(tick); // callers have checked it fits
+    PriceLevel &level = levels[tick - base_tick];
+    if (level.empty())
+    {
+        active_levels++;
+        bool better = is_bid ? tick > best_tick : tick < best_tick;
+        if (active_levels == 1 || better)
+            best_tick = tick;
+        level.head_chunk = level.tail_chunk = slab.allocate();
+        level.head = level.tail = 0;
+    }
+    else if (level.tail == ORDER_CHUNK_SIZE)
+    {
+        uint32_t chunk = slab.allocate();
+        slab.at(level.tail_chunk).next = chunk;
+        level.tail_chunk = chunk;
+        level.tail = 0;
+    }
+    uint64_t slot = (uint64_t)level.tail_chunk * ORDER_CHUNK_SIZE + level.tail++;
+    slab.order(slot) = order;
+    level.total_volume += order.volume;
+    return slot;
+}
+
+void PriceLadder::pop_front(PriceLevel &level)
+{
+    for (;;)
+    {
+        level.head++;
+        if (level.head_chunk == level.tail_chunk && level.head == level.tail)
+        {
+            slab.release(level.head_chunk);
+            level.head_chunk = level.tail_chunk = NO_CHUNK;
+            return;
+        }
+        if (level.head == ORDER_CHUNK_SIZE)
+        {
+            uint32_t next = slab.at(level.head_chunk).next;
+            slab.release(level.head_chunk);
+            level.head_chunk = next;
+            level.head = 0;
+        }
+        if (slab.order(level.front_slot()).volume > 0)
+            return;
+    }
+}
+
+int PriceLadder::top_levels(int n, long long *ticks, int *volumes) const
+{
+    int found = 0;
+    if (empty())
+        return 0;
+    long long step = is_bid ? -1 : 1;
+    long long end = is_bid ? base_tick - 1 : base_tick + (long long)levels.size();
+    for (long long t = best_tick; t != end && found < n; t += step)
+    {
+        const PriceLevel &level = levels[t - base_tick];
+        if (level.empty())
+            continue;
+        ticks[found] = t;
+        volumes[found] = level.total_volume;
+        found++;
+    }
+    return found;
+}
+
+void PriceLadder::advance_best()
+{
+    // the next level is almost always adjacent, so a linear walk is cheap
+    long long step = is_bid ? -1 : 1;
+    do
+    {
+        best_tick += step;
+    } while (levels[best_tick - base_tick].empty());
+}
+
+void PriceLadder::pop_best_front()
+{
+    PriceLevel &level = best_level();
+    pop_front(level);
+    if (!level.empty())
+        return;
+
+    active_levels--;
+    if (active_levels > 0)
+        advance_best();
+}
+
+const RestingOrder *PriceLadder::find(uint64_t slot, uint32_t sequence) const
+{
+    // Orders only leave with volume 0, so a live match can only be the
+    // order itself, even if its chunk has since been freed
+    const RestingOrder &o = slab.order(slot);
+    return o.sequence == sequence && o.volume > 0 ? &o : nullptr;
+}
+
+bool PriceLadder::cancel(uint64_t slot, uint32_t sequence, RestingOrder &removed)
+{
+    if (!find(slot, sequence))
+        return false;
+    RestingOrder &o = slab.order(slot);
+    long long tick = o.price_ticks;
+    PriceLevel &level = levels[tick - base_tick];
+    removed = o;
+    level.total_volume -= o.volume;
+    o.volume = 0;
+    if (slot != level.front_slot())
+        return true; // left in the queue until it reaches the front
+
+    pop_front(level);
+    if (!level.empty())
+        return true;
+    active_levels--;
+    if (active_levels > 0 && tick == best_tick)
+        advance_best();
+    return true;
+}
+
+bool PriceLadder::reduce(uint64_t slot, uint32_t sequence, int new_volume)
+{
+    if (!find(slot, sequence))
+        return false;
+    RestingOrder &o = slab.order(slot);
+    if (new_volume <= 0 || new_volume > o.volume)
+        return false;
+    levels[o.price_ticks - base_tick].total_volume -= o.volume - new_volume;
+    o.volume = new_volume;
+    return true;
+}
+
+// ---------------- OrderIndex -----------------
+
+static const size_t INDEX_MIN_SIZE = 16;
+
+OrderIndex::OrderIndex() : shift(64 - 4), count(0)
+{
+    table.assign(INDEX_MIN_SIZE, Entry{0, 0});
+}
+
+void OrderIndex::clear()
+{
+    if (count > 0)
+        std::fill(table.begin(), table.end(), Entry{0, 0});
+    count = 0;
+}
+
+void OrderIndex::grow()
+{
+    std::vector<Entry> old(table.size() * 2, Entry{0, 0});
+    old.swap(table);
+    shift--;
+    count = 0;
+    for (const auto &e : old)
+        if (e.key != 0)
+            insert(e.key, e.value);
+}
+
+void OrderIndex::insert(long long key, uint32_t value)
+{
+    if ((count + 1) * 2 > table.size())
+        grow();
+    const size_t mask = table.size() - 1;
+    for (size_t i = home(key);; i = (i + 1) & mask)
+    {
+        if (table[i].key == key)
+        {
+            table[i].value = value;
+            return;
+        }
+        if (table[i].key == 0)
+        {
+            table[i].key = key;
+            table[i].value = value;
+            count++;
+            return;
+        }
+    }
+}
+
+bool OrderIndex::find(long long key, uint32_t &value) const
+{
+    const size_t mask = table.size() - 1;
+    for (size_t i = home(key);; i = (i + 1) & mask)
+    {
+        if (table[i].key == key)
+        {
+            value = table[i].value;
+            return true;
+        }
+        if (table[i].key == 0)
+            return false;
+    }
+}
+
+void OrderIndex::erase(long long key)
+{
+    const size_t mask = table.size() - 1;
+    size_t i = home(key);
+    while (table[i].key != key)
+    {
+        if (table[i].key == 0)
+            return;
+        i = (i + 1) & mask;
+    }
+    // Walk the rest of the probe run and move back each entry whose home
+    // slot does not lie between the hole and itself
+    for (size_t j = i;;)
+    {
+        j = (j + 1) & mask;
+        if (table[j].key == 0)
+            break;
+        size_t h = home(table[j].key);
+        bool stays = i <= j ? (h > i && h <= j) : (h > i || h <= j);
+        if (stays)
+            continue;
+        table[i] = table[j];
+        i = j;
+    }
+    table[i].key = 0;
+    count--;
+}
+
+// ---------------- OrderBook -----------------
+
+OrderBook::OrderBook(double tick_size_, double initial_price)
+    : instrument_id(0), tick_size(tick_size_), bids(true), asks(false),
+      resting_bids(0), resting_asks(0), next_sequence(0),
+      expiry_wheel(EXPIRY_WHEEL_SLOTS), expired_through(0), cancelled_orders(0), expired_orders(0),
+      last_price(initial_price), history(initial_price), stats(initial_price)
+{
+    long long center = price_to_ticks(initial_price, true);
+    bids.reset(center, LADDER_WIDTH);
+    asks.reset(center, LADDER_WIDTH);
+}
+
+void OrderBook::reset(double tick_size_, double initial_price)
+{
+    tick_size = tick_size_;
+    resting_bids = resting_asks = 0;
+    order_info.clear();
+    free_slots.clear();
+    index.clear();
+    for (auto &slot : expiry_wheel)
+        slot.clear();
+    expired_through = 0;
+    ioc_pending.clear();
+    cancelled_orders = expired_orders = 0;
+    next_sequence = 0;
+    last_price = initial_price;
+    history.clear(initial_price);
+    stats = PriceStatistics(initial_price);
+    long long center = price_to_ticks(initial_price, true);
+    bids.reset(center, LADDER_WIDTH);
+    asks.reset(center, LADDER_WIDTH);
+}
+
+bool OrderBook::set_tick_size(double tick)
+{
+    if (tick <= 0.0 || resting_bids > 0 || resting_asks > 0)
+        return false;
+    tick_size = tick;
+    long long center = price_to_ticks(last_price, true);
+    bids.reset(center, LADDER_WIDTH);
+    asks.reset(center, LADDER_WIDTH);
+    return true;
+}
+
+bool OrderBook::is_bookable(double price) const
+{
+    return std::isfinite(price) && std::fabs(price / tick_size) < MAX_ABS_TICKS;
+}
+
+long long OrderBook::price_to_ticks(double price, bool is_buy) const
 {
-    if (a.price != b.price)
-        return a.price > b.price;     // higher first
-    return a.timestamp < b.timestamp; // earlier first
+    double x = price / tick_size;
+    double nearest = std::round(x);
+    if (std::fabs(x - nearest) < 1e-6)
+        return (long long)nearest; // already on a tick, modulo fp error
+    return (long long)(is_buy ? std::floor(x) : std::ceil(x));
+}
+
+uint32_t OrderBook::acquire_slot(const Order &order)
+{
+    uint32_t handle;
+    if (!free_slots.empty())
+    {
+        handle = free_slots.back();
+        free_slots.pop_back();
+    }
+    else
+    {
+        handle = (uint32_t)order_info.size();
+        order_info.emplace_back();
+    }
+    OrderInfo &info = order_info[handle];
+    info.order_id = order.order_id;
+    info.agent_id = order.agent_id;
+    info.timestamp = order.timestamp;
+    info.expire_tick = order.expire_tick;
+    info.time_in_force = order.time_in_force;
+    return handle;
 }
 
-static bool ask_cmp(const Order &a, const Order &b)
+void OrderBook::release_slot(uint32_t handle)
 {
-    if (a.price != b.price)
-        return a.price < b.price;     // lower first
-    return a.timestamp < b.timestamp; // earlier first
+    // A later order reusing the ID may own the index entry by now
+    long long id = order_info[handle].order_id;
+    uint32_t indexed;
+    if (id != 0 && index.find(id, indexed) && indexed == handle)
+        index.erase(id);
+    free_slots.push_back(handle);
 }
 
-void OrderBook::add_order(const Order &order)
+void OrderBook::rest(const RestingOrder &o)
 {
-    if (order.is_buy)
+    OrderInfo &info = order_info[o.handle];
+    info.sequence = o.sequence;
+    info.is_buy = o.is_buy;
+    if (o.is_buy)
     {
-        bids.push_back(order);
+        info.slot = bids.push(o);
+        resting_bids++;
     }
     else
     {
-        asks.push_back(order);
+        info.slot = asks.push(o);
+        resting_asks++;
+    }
+    if (info.order_id != 0)
+        index.insert(info.order_id, o.handle);
+
+    PendingRetire r = {info.slot, o.sequence, 0, o.is_buy};
+    if (info.time_in_force == TimeInForce::IOC)
+        ioc_pending.push_back(r);
+    else if (info.time_in_force == TimeInForce::GTD && info.expire_tick < INT_MAX)
+    {
+        r.retire_tick = info.expire_tick + 1;
+        expiry_wheel[(unsigned)r.retire_tick % EXPIRY_WHEEL_SLOTS].push_back(r);
     }
 }
 
+bool OrderBook::cancel_at(bool is_buy, uint64_t slot, uint32_t sequence)
+{
+    RestingOrder removed;
+    if (!(is_buy ? bids : asks).cancel(slot, sequence, removed))
+        return false;
+    release_slot(removed.handle);
+    if (is_buy)
+        resting_bids--;
+    else
+        resting_asks--;
+    return true;
+}
+
+bool OrderBook::add_order(const Order &order)
+{
+    if (order.volume <= 0)
+        return false; // zero-volume orders are ignored
+    if (order.time_in_force == TimeInForce::GTD && order.expire_tick < expired_through)
+    {
+        expired_orders++;
+        return false;
+    }
+    if (!is_bookable(order.price))
+        return false;
+
+    RestingOrder o;
+    o.price_ticks = price_to_ticks(order.price, order.is_buy);
+    if (!(order.is_buy ? bids : asks).ensure_range(o.price_ticks))
+        return false; // too far from the rest of the book
+    o.sequence = next_sequence++;
+    o.volume = order.volume;
+    o.handle = acquire_slot(order);
+    o.is_buy = order.is_buy;
+    rest(o);
+    return true;
+}
+
+bool OrderBook::cancel_order(long long order_id)
+{
+    uint32_t handle;
+    if (order_id == 0 || !index.find(order_id, handle))
+        return false;
+    const OrderInfo &info = order_info[handle];
+    if (!cancel_at(info.is_buy, info.slot, info.sequence))
+        return false;
+    cancelled_orders++;
+    return true;
+}
+
+bool OrderBook::replace_order(long long order_id, double price, int volume, int timestamp)
+{
+    uint32_t handle;
+    if (order_id == 0 || !index.find(order_id, handle))
+        return false;
+    if (volume <= 0)
+        return cancel_order(order_id);
+    if (!is_bookable(price))
+        return false; // the resting order is left as it was
+
+    const OrderInfo info = order_info[handle];
+    PriceLadder &side = info.is_buy ? bids : asks;
+    long long ticks = price_to_ticks(price, info.is_buy);
+    if (!side.ensure_range(ticks))
+        return false;
+    const RestingOrder *current = side.find(info.slot, info.sequence);
+    if (current && ticks == current->price_ticks &&
+        side.reduce(info.slot, info.sequence, volume))
+        return true;
+
+    // Anything but a size-down loses priority: requeue under the same ID
+    cancel_at(info.is_buy, info.slot, info.sequence);
+    Order o;
+    o.price = price;
+    o.order_id = order_id;
+    o.agent_id = info.agent_id;
+    o.instrument_id = instrument_id;
+    o.volume = volume;
+    o.timestamp = timestamp;
+    o.expire_tick = info.expire_tick;
+    o.is_buy = info.is_buy;
+    o.time_in_force = info.time_in_force;
+    return add_order(o);
+}
+
+bool OrderBook::apply(const Order &order)
+{
+    switch (order.action)
+    {
+    case OrderAction::CANCEL:
+        return cancel_order(order.order_id);
+    case OrderAction::REPLACE:
+        return replace_order(order.order_id, order.price, order.volume, order.timestamp);
+    default:
+        return add_order(order);
+    }
+}
+
+int OrderBook::expire_orders(int current_tick)
+{
+    if (current_tick <= expired_through)
+        return 0;
+    // One slot per tick since the last call, or the whole wheel after a gap
+    long long span = (long long)current_tick - expired_through;
+    int slots = span >= EXPIRY_WHEEL_SLOTS ? EXPIRY_WHEEL_SLOTS : (int)span;
+    int retired = 0;
+    for (int k = 1; k <= slots; ++k)
+    {
+        std::vector<PendingRetire> &slot =
+            expiry_wheel[(unsigned)(expired_through + k) % EXPIRY_WHEEL_SLOTS];
+        size_t kept = 0;
+        for (size_t n = 0; n < slot.size(); ++n)
+        {
+            if (slot[n].retire_tick > current_tick)
+                slot[kept++] = slot[n]; // due on a later turn of the wheel
+            else if (cancel_at(slot[n].is_buy, slot[n].slot, slot[n].sequence))
+                retired++;
+        }
+        slot.resize(kept);
+    }
+    expired_through = current_tick;
+    expired_orders += retired;
+    return retired;
+}
+
+int OrderBook::get_order_volume(long long order_id) const
+{
+    uint32_t handle;
+    if (order_id == 0 || !index.find(order_id, handle))
+        return 0;
+    const OrderInfo &info = order_info[handle];
+    const RestingOrder *o = (info.is_buy ? bids : asks).find(info.slot, info.sequence);
+    return o ? o->volume : 0;
+}
+
 std::vector<Trade> OrderBook::match_orders(int current_tick)
 {
     std::vector<Trade> trades;
+    match_orders(current_tick, trades);
+    return trades;
+}
 
-    // sort order books
-    std::sort(bids.begin(), bids.end(), bid_cmp);
-    std::sort(asks.begin(), asks.end(), ask_cmp);
+int OrderBook::match_orders(int current_tick, std::vector<Trade> &trades)
+{
+    size_t first = trades.size();
 
-    size_t bi = 0, ai = 0;
-    while (bi < bids.size() && ai < asks.size())
+    while (!bids.empty() && !asks.empty())
     {
-        Order &bid = bids[bi];
-        Order &ask = asks[ai];
-        if (bid.price < ask.price)
+        if (bids.best() < asks.best())
             break; // no match
 
+        PriceLevel &bid_level = bids.best_level();
+        PriceLevel &ask_level = asks.best_level();
+        RestingOrder &bid = bids.front(bid_level);
+        RestingOrder &ask = asks.front(ask_level);
+
         int vol = std::min(bid.volume, ask.volume);
-        Trade t{bid.agent_id, ask.agent_id, bid.instrument_id, (bid.price + ask.price) * 0.5, vol, current_tick};
+        double px = ticks_to_price(bid.price_ticks + ask.price_ticks) * 0.5;
+        Trade t{px, order_info[bid.handle].agent_id, order_info[ask.handle].agent_id,
+                instrument_id, vol, current_tick, 0};
         trades.push_back(t);
 
         last_price = t.price;
-        price_history.push_back(last_price);
+        history.add_trade(current_tick, t.price, vol);
+        stats.add_trade(t.price, vol);
 
         bid.volume -= vol;
         ask.volume -= vol;
+        bid_level.total_volume -= vol;
+        ask_level.total_volume -= vol;
+
+        // retire filled orders; the ladder advances past emptied levels
         if (bid.volume == 0)
-            bi++;
+        {
+            release_slot(bid.handle);
+            bids.pop_best_front();
+            resting_bids--;
+        }
         if (ask.volume == 0)
-            ai++;
+        {
+            release_slot(ask.handle);
+            asks.pop_best_front();
+            resting_asks--;
+        }
     }
 
-    // erase filled orders
-    bids.erase(bids.begin(), bids.begin() + bi);
-    asks.erase(asks.begin(), asks.begin() + ai);
+    // IOC orders do not rest past the match that follows their booking
+    for (const auto &r : ioc_pending)
+        if (cancel_at(r.is_buy, r.slot, r.sequence))
+            cancelled_orders++;
+    ioc_pending.clear();
 
-    return trades;
+    return (int)(trades.size() - first);
+}
+
+void OrderBook::fill_snapshot(MarketSnapshot &out) const
+{
+    long long ticks[SNAPSHOT_DEPTH];
+    int volumes[SNAPSHOT_DEPTH];
+    out.last_price = last_price;
+    for (int s = 0; s < NUM_PRICE_STATISTICS; ++s)
+        out.stats[s] = stats.get(static_cast<PriceStatistic>(s));
+    int n = bids.top_levels(SNAPSHOT_DEPTH, ticks, volumes);
+    for (int k = 0; k < SNAPSHOT_DEPTH; ++k)
+    {
+        out.bid_price[k] = k < n ? ticks_to_price(ticks[k]) : 0.0;
+        out.bid_volume[k] = k < n ? volumes[k] : 0;
+    }
+    n = asks.top_levels(SNAPSHOT_DEPTH, ticks, volumes);
+    for (int k = 0; k < SNAPSHOT_DEPTH; ++k)
+    {
+        out.ask_price[k] = k < n ? ticks_to_price(ticks[k]) : 0.0;
+        out.ask_volume[k] = k < n ? volumes[k] : 0;
+    }
+    out.best_bid = out.bid_price[0];
+    out.best_ask = out.ask_price[0];
+    out.bid_orders = (int32_t)resting_bids;
+    out.ask_orders = (int32_t)resting_asks;
+    out.traded_volume = stats.volume();
+}
+
+bool OrderBook::get_best_bid(double &price) const
+{
+    if (bids.empty())
+        return false;
+    price = ticks_to_price(bids.best());
+    return true;
+}
+
+bool OrderBook::get_best_ask(double &price) const
+{
+    if (asks.empty())
+        return false;
+    price = ticks_to_price(asks.best());
+    return true;
+}
+
+// A resting order with its side-table data, as serialized
+struct SerializedOrder {
+    long long price_ticks;
+    long long order_id;
+    uint32_t sequence;
+    int32_t volume;
+    int32_t agent_id;
+    int32_t timestamp;
+    int32_t expire_tick;
+    int16_t time_in_force;
+    int16_t is_buy;
+};
+
+void OrderBook::serialize(ByteWriter &out) const
+{
+    out.put(instrument_id);
+    out.put(tick_size);
+    out.put(next_sequence);
+    out.put(last_price);
+    out.put(expired_through);
+    out.put(cancelled_orders);
+    out.put(expired_orders);
+    history.serialize(out);
+    stats.serialize(out);
+
+    // Same layout as put_vector, with the records written in place
+    size_t count = resting_bids + resting_asks;
+    out.put((unsigned long long)count);
+    char *dst = out.extend(count * sizeof(SerializedOrder));
+    auto collect = [&](const RestingOrder &o) {
+        const OrderInfo &info = order_info[o.handle];
+        SerializedOrder so = {o.price_ticks, info.order_id, o.sequence, o.volume,
+                              info.agent_id, info.timestamp, info.expire_tick,
+                              (int16_t)info.time_in_force, (int16_t)(o.is_buy ? 1 : 0)};
+        std::memcpy(dst, &so, sizeof(so));
+        dst += sizeof(so);
+    };
+    bids.for_each(collect);
+    asks.for_each(collect);
 }
 
-double OrderBook::get_historical_average() const
+bool OrderBook::deserialize(ByteReader &in)
 {
-    if (price_history.empty())
-        return last_price;
-    double sum = std::accumulate(price_history.begin(), price_history.end(), 0.0);
-    return sum / price_history.size();
+    std::vector<SerializedOrder> resting;
+    in.get(instrument_id);
+    in.get(tick_size);
+    in.get(next_sequence);
+    in.get(last_price);
+    in.get(expired_through);
+    in.get(cancelled_orders);
+    in.get(expired_orders);
+    if (!history.deserialize(in) || !stats.deserialize(in) || !in.get_vector(resting) || tick_size <= 0.0)
+        return false;
+
+    long long center = price_to_ticks(last_price, true);
+    bids.reset(center, LADDER_WIDTH);
+    asks.reset(center, LADDER_WIDTH);
+    order_info.clear();
+    free_slots.clear();
+    index.clear();
+    for (auto &slot : expiry_wheel)
+        slot.clear();
+    ioc_pending.clear();
+    resting_bids = resting_asks = 0;
+    // Written level by level in priority order, so pushing them back in
+    // the same order restores time priority
+    for (const auto &so : resting)
+    {
+        RestingOrder o;
+        o.price_ticks = so.price_ticks;
+        o.sequence = so.sequence;
+        o.volume = so.volume;
+        o.handle = (uint32_t)order_info.size();
+        o.is_buy = so.is_buy != 0;
+        if (so.time_in_force < 0 || so.time_in_force > (int)TimeInForce::GTD ||
+            !(o.is_buy ? bids : asks).ensure_range(o.price_ticks))
+            return false;
+        OrderInfo info;
+        info.order_id = so.order_id;
+        info.agent_id = so.agent_id;
+        info.timestamp = so.timestamp;
+        info.expire_tick = so.expire_tick;
+        info.time_in_force = static_cast<TimeInForce>(so.time_in_force);
+        order_info.push_back(info);
+        rest(o); // re-indexes the order and refiles it on the expiry wheel
+    }
+    return true;
 }
 
 // ---------------- Exchange -----------------
 
-Exchange::Exchange(int rank_, int num_instruments_)
-    : rank(rank_), num_instruments(num_instruments_), next_order_id(1)
+Order make_cancel(int instrument_id, long long order_id, int timestamp)
+{
+    Order o;
+    o.order_id = order_id;
+    o.instrument_id = instrument_id;
+    o.timestamp = timestamp;
+    o.action = OrderAction::CANCEL;
+    return o;
+}
+
+Order make_replace(int instrument_id, long long order_id, double price, int volume, int timestamp)
+{
+    Order o = make_cancel(instrument_id, order_id, timestamp);
+    o.price = price;
+    o.volume = volume;
+    o.action = OrderAction::REPLACE;
+    return o;
+}
+
+Exchange::Exchange(int rank_, int num_instruments_, double tick_size, int num_lanes)
+    : rank(rank_), num_instruments(0), trade_sink(nullptr), continuous(nullptr), snapshot_count(0)
+{
+    reset(num_instruments_, tick_size, num_lanes);
+}
+
+void Exchange::reset(int num_instruments_, double tick_size, int num_lanes)
+{
+    num_instruments = num_instruments_;
+    order_books.resize(num_instruments, OrderBook(tick_size));
+    for (int i = 0; i < num_instruments; ++i)
+    {
+        order_books[i].reset(tick_size);
+        order_books[i].set_instrument_id(i);
+    }
+    if (num_lanes <= 0)
+        num_lanes = omp_get_max_threads();
+    lanes.resize(num_lanes);
+    for (auto &lane : lanes)
+    {
+        lane.by_instrument.resize(num_instruments);
+        for (auto &pending : lane.by_instrument)
+            pending.clear();
+        lane.next_sequence = 0;
+    }
+    inbound.by_instrument.resize(num_instruments);
+    for (auto &routed : inbound.by_instrument)
+        routed.clear();
+    tick_trades.resize(num_instruments);
+    for (auto &fills : tick_trades)
+        fills.clear();
+    trade_log.clear();
+    trade_sink = nullptr;
+    owners.clear();
+    remote_quotes.clear();
+    match_cycles.assign(num_instruments, 0);
+    booked_orders.assign(num_instruments, 0);
+    if (snapshot_count != num_instruments)
+    {
+        snapshots.reset(new VersionedBuffer<MarketSnapshot>[num_instruments]);
+        snapshot_count = num_instruments;
+    }
+    for (int i = 0; i < num_instruments; ++i)
+        publish_snapshot(i, -1);
+    home_order.clear();
+    home_begin.clear();
+}
+
+bool Exchange::place_books(const std::vector<int> &home_thread)
 {
-    order_books.resize(num_instruments);
+    if ((int)home_thread.size() != num_instruments)
+        return false;
+    int homes = 1;
+    for (int t : home_thread)
+        homes = std::max(homes, t + 1);
+
+    // Counting sort of the instruments by home thread
+    home_begin.assign(homes + 1, 0);
+    for (int t : home_thread)
+        home_begin[std::max(0, t) + 1]++;
+    for (int t = 0; t < homes; ++t)
+        home_begin[t + 1] += home_begin[t];
+    home_order.resize(num_instruments);
+    std::vector<int> fill(home_begin.begin(), home_begin.end() - 1);
+    for (int i = 0; i < num_instruments; ++i)
+        home_order[fill[std::max(0, home_thread[i])]++] = i;
+    home_cursors.reset(new HomeCursor[homes]);
+
+    // Books are empty after reset, so a fresh one built by the home thread
+    // loses nothing; its ladders and tables now live on that thread's node
+#pragma omp parallel
+    {
+        const int me = omp_get_thread_num();
+        for (int t = me; t < homes; t += omp_get_num_threads())
+            for (int k = home_begin[t]; k < home_begin[t + 1]; ++k)
+            {
+                int i = home_order[k];
+                OrderBook fresh(order_books[i].get_tick_size());
+                fresh.set_instrument_id(i);
+                order_books[i] = std::move(fresh);
+                std::vector<Trade>().swap(tick_trades[i]); // regrown by the matching thread
+            }
+    }
+    return true;
 }
 
-void Exchange::submit_order(const Order &order)
+void Exchange::publish_snapshot(int instrument_id, int tick)
 {
-    std::lock_guard<std::mutex> lock(order_mutex);
+    MarketSnapshot s;
+    if (is_local(instrument_id))
+    {
+        order_books[instrument_id].fill_snapshot(s);
+        s.is_local = 1;
+    }
+    else
+    {
+        // Remote view: prices and statistics only
+        const MarketQuote &q = remote_quotes[instrument_id];
+        std::memset(&s, 0, sizeof(s));
+        s.last_price = q.price;
+        s.stats[(int)PriceStatistic::MEAN] = q.mean;
+        s.stats[(int)PriceStatistic::EWMA] = q.ewma;
+        s.stats[(int)PriceStatistic::SMA] = q.sma;
+        s.stats[(int)PriceStatistic::VWAP] = q.vwap;
+        s.is_local = 0;
+    }
+    s.tick = tick;
+    snapshots[instrument_id].publish(s);
+}
+
+uint64_t Exchange::read_snapshot(int instrument_id, MarketSnapshot &out) const
+{
+    if (instrument_id < 0 || instrument_id >= num_instruments)
+        return 0;
+    return snapshots[instrument_id].read(out);
+}
+
+bool Exchange::set_tick_size(int instrument_id, double tick)
+{
+    if (instrument_id >= 0 && instrument_id < (int)order_books.size())
+    {
+        return order_books[instrument_id].set_tick_size(tick);
+    }
+    return false;
+}
+
+long long Exchange::submit_order(const Order &order)
+{
+    return submit_order(order, omp_get_thread_num());
+}
+
+long long Exchange::submit_order(const Order &order, int lane_id)
+{
+    if (order.instrument_id < 0 || order.instrument_id >= num_instruments)
+        return 0;
+    if (lane_id < 0 || lane_id >= (int)lanes.size())
+        return 0;
+
+    OrderLane &lane = lanes[lane_id];
     Order o = order;
-    o.order_id = next_order_id++;
-    pending_orders.push(o);
+    if (o.action == OrderAction::NEW)
+    {
+        long long seq = lane.next_sequence++;
+        long long block = seq / ORDER_ID_BLOCK;
+        o.order_id = ((long long)rank << ORDER_ID_RANK_SHIFT) +
+                     (block * (long long)lanes.size() + lane_id) * ORDER_ID_BLOCK +
+                     seq % ORDER_ID_BLOCK + 1;
+    }
+    else if (o.order_id == 0)
+        return 0;
+    if (continuous && is_local(o.instrument_id))
+        continuous->submit(lane_id, o);
+    else
+        lane.by_instrument[o.instrument_id].push_back(o);
+    return o.order_id;
+}
+
+bool Exchange::set_instrument_owners(const std::vector<int> &owners_)
+{
+    if ((int)owners_.size() != num_instruments)
+        return false;
+    owners = owners_;
+    MarketQuote q = {0.0, 0.0, 0.0, 0.0, 0.0};
+    remote_quotes.assign(num_instruments, q);
+    for (int i = 0; i < num_instruments; ++i)
+    {
+        // Until the first quote arrives, report the book's initial state
+        const OrderBook &ob = order_books[i];
+        remote_quotes[i].price = ob.get_last_price();
+        remote_quotes[i].mean = ob.get_statistic(PriceStatistic::MEAN);
+        remote_quotes[i].ewma = ob.get_statistic(PriceStatistic::EWMA);
+        remote_quotes[i].sma = ob.get_statistic(PriceStatistic::SMA);
+        remote_quotes[i].vwap = ob.get_statistic(PriceStatistic::VWAP);
+    }
+    for (int i = 0; i < num_instruments; ++i)
+        publish_snapshot(i, -1);
+    return true;
+}
+
+void Exchange::collect_remote_orders(std::vector<std::vector<Order>> &per_rank)
+{
+    if (owners.empty())
+        return;
+    for (int i = 0; i < num_instruments; ++i)
+    {
+        if (owners[i] == rank)
+            continue;
+        std::vector<Order> &out = per_rank[owners[i]];
+        for (auto &lane : lanes)
+        {
+            std::vector<Order> &pending = lane.by_instrument[i];
+            out.insert(out.end(), pending.begin(), pending.end());
+            pending.clear();
+        }
+    }
+}
+
+long long Exchange::inject_order(const Order &order)
+{
+    if (order.instrument_id < 0 || order.instrument_id >= num_instruments || !is_local(order.instrument_id))
+        return 0;
+    if (continuous)
+        continuous->submit((int)lanes.size(), order);
+    else
+        inbound.by_instrument[order.instrument_id].push_back(order);
+    return order.order_id;
+}
+
+void Exchange::set_remote_quotes(const std::vector<MarketQuote> &quotes)
+{
+    for (int i = 0; i < num_instruments && i < (int)quotes.size(); ++i)
+        if (!is_local(i))
+        {
+            remote_quotes[i] = quotes[i];
+            publish_snapshot(i, -1);
+        }
+}
+
+bool Exchange::set_owner(int instrument_id, int owner)
+{
+    if (owners.empty() || instrument_id < 0 || instrument_id >= num_instruments)
+        return false;
+    if (owners[instrument_id] == rank && owner != rank)
+    {
+        OrderBook &old = order_books[instrument_id];
+        MarketQuote q;
+        q.price = old.get_last_price();
+        q.mean = old.get_statistic(PriceStatistic::MEAN);
+        q.ewma = old.get_statistic(PriceStatistic::EWMA);
+        q.sma = old.get_statistic(PriceStatistic::SMA);
+        q.vwap = old.get_statistic(PriceStatistic::VWAP);
+        remote_quotes[instrument_id] = q;
+        old = OrderBook(old.get_tick_size(), q.price);
+        old.set_instrument_id(instrument_id);
+        tick_trades[instrument_id].clear();
+    }
+    owners[instrument_id] = owner;
+    publish_snapshot(instrument_id, -1);
+    return true;
+}
+
+bool Exchange::export_book(int instrument_id, std::vector<char> &out) const
+{
+    if (instrument_id < 0 || instrument_id >= num_instruments || !is_local(instrument_id))
+        return false;
+    ByteWriter w(out);
+    order_books[instrument_id].serialize(w);
+    return true;
+}
+
+bool Exchange::import_book(int instrument_id, const char *data, size_t size)
+{
+    if (instrument_id < 0 || instrument_id >= num_instruments || !is_local(instrument_id))
+        return false;
+    ByteReader r(data, size);
+    OrderBook book;
+    if (!book.deserialize(r) || book.get_instrument_id() != instrument_id)
+        return false;
+    order_books[instrument_id] = std::move(book);
+    publish_snapshot(instrument_id, -1);
+    return true;
+}
+
+void Exchange::serialize(ByteWriter &out) const
+{
+    out.put(num_instruments);
+    out.put((int)lanes.size());
+    for (const auto &lane : lanes)
+        out.put(lane.next_sequence);
+    out.put_vector(owners);
+    out.put_vector(remote_quotes);
+    out.put_vector(match_cycles);
+    out.put_vector(booked_orders);
+    out.put_vector(trade_log);
+    for (const auto &ob : order_books)
+        ob.serialize(out);
+}
+
+bool Exchange::deserialize(ByteReader &in)
+{
+    int instruments = 0, lane_count = 0;
+    in.get(instruments);
+    in.get(lane_count);
+    if (!in.ok() || instruments != num_instruments || lane_count != (int)lanes.size())
+        return false;
+    for (auto &lane : lanes)
+        in.get(lane.next_sequence);
+    in.get_vector(owners);
+    in.get_vector(remote_quotes);
+    in.get_vector(match_cycles);
+    in.get_vector(booked_orders);
+    in.get_vector(trade_log);
+    if (!in.ok() || (!owners.empty() && (int)owners.size() != num_instruments) ||
+        (int)match_cycles.size() != num_instruments || (int)booked_orders.size() != num_instruments)
+        return false;
+    for (int i = 0; i < num_instruments; ++i)
+    {
+        if (!order_books[i].deserialize(in) || order_books[i].get_instrument_id() != i)
+            return false;
+        tick_trades[i].clear();
+    }
+    for (int i = 0; i < num_instruments; ++i)
+        publish_snapshot(i, -1);
+    return true;
+}
+
+void Exchange::reset_load_counters()
+{
+    std::fill(match_cycles.begin(), match_cycles.end(), 0ULL);
+    std::fill(booked_orders.begin(), booked_orders.end(), 0LL);
+}
+
+int Exchange::match_book(int i, int current_tick)
+{
+    if (!is_local(i))
+        return 0;
+    uint64_t start = read_tsc();
+    OrderBook &book = order_books[i];
+    long long booked = 0;
+    book.expire_orders(current_tick);
+    for (auto &lane : lanes)
+    {
+        std::vector<Order> &pending = lane.by_instrument[i];
+        for (const auto &o : pending)
+            book.apply(o);
+        booked += (long long)pending.size();
+        pending.clear(); // keeps capacity for the next tick
+    }
+    std::vector<Order> &routed = inbound.by_instrument[i];
+    for (const auto &o : routed)
+        book.apply(o);
+    booked += (long long)routed.size();
+    routed.clear();
+    tick_trades[i].clear(); // reused buffer, capacity survives the tick
+    int trades = book.match_orders(current_tick, tick_trades[i]);
+    publish_snapshot(i, current_tick);
+    booked_orders[i] += booked;
+    match_cycles[i] += read_tsc() - start;
+    return trades;
 }
 
 int Exchange::process_orders(int current_tick)
 {
-    // Move pending orders to corresponding order books
+    int trades_total = 0;
+
+    if (continuous)
     {
-        std::lock_guard<std::mutex> lock(order_mutex);
-        while (!pending_orders.empty())
+        // Already matched on arrival; wait for the matchers and take the fills
+        trades_total = continuous->complete_tick(current_tick, tick_trades);
+    }
+    else if (!home_begin.empty())
+    {
+        // Each thread drains its home group, then claims books from the
+        // other groups so a busy home does not hold up the tick
+        const int homes = (int)home_begin.size() - 1;
+        for (int t = 0; t < homes; ++t)
+            home_cursors[t].next.store(home_begin[t], std::memory_order_relaxed);
+#pragma omp parallel reduction(+ : trades_total)
         {
-            Order o = pending_orders.front();
-            pending_orders.pop();
-            if (o.instrument_id >= 0 && o.instrument_id < (int)order_books.size())
+            const int me = omp_get_thread_num();
+            for (int k = 0; k < homes; ++k)
             {
-                order_books[o.instrument_id].add_order(o);
+                const int t = (me + k) % homes;
+                for (;;)
+                {
+                    int pos = home_cursors[t].next.fetch_add(1, std::memory_order_relaxed);
+                    if (pos >= home_begin[t + 1])
+                        break;
+                    trades_total += match_book(home_order[pos], current_tick);
+                }
             }
         }
     }
+    else
+    {
+        // Books share no state, so each one is drained and matched independently.
+        // Activity is skewed across instruments, hence dynamic scheduling.
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : trades_total)
+        for (int i = 0; i < num_instruments; ++i)
+            trades_total += match_book(i, current_tick);
+    }
 
-    int trades_total = 0;
-    for (size_t i = 0; i < order_books.size(); ++i)
+    // Merge per-instrument fills in instrument order
+    for (int i = 0; i < num_instruments; ++i)
     {
-        auto t = order_books[i].match_orders(current_tick);
-        trades_total += (int)t.size();
-        trade_log.insert(trade_log.end(), t.begin(), t.end());
+        if (trade_sink)
+            trade_sink->append(tick_trades[i]);
+        else
+            trade_log.insert(trade_log.end(), tick_trades[i].begin(), tick_trades[i].end());
     }
     return trades_total;
 }
@@ -123,6 +1188,8 @@ double Exchange::get_price(int instrument_id) const
 {
     if (instrument_id >= 0 && instrument_id < (int)order_books.size())
     {
+        if (!is_local(instrument_id))
+            return remote_quotes[instrument_id].price;
         return order_books[instrument_id].get_last_price();
     }
     return 0.0;
@@ -132,19 +1199,91 @@ double Exchange::get_historical_average(int instrument_id) const
 {
     if (instrument_id >= 0 && instrument_id < (int)order_books.size())
     {
+        if (!is_local(instrument_id))
+            return remote_quotes[instrument_id].mean;
         return order_books[instrument_id].get_historical_average();
     }
     return 0.0;
 }
 
+double Exchange::get_statistic(int instrument_id, PriceStatistic stat) const
+{
+    if (instrument_id >= 0 && instrument_id < (int)order_books.size())
+    {
+        if (!is_local(instrument_id))
+        {
+            const MarketQuote &q = remote_quotes[instrument_id];
+            switch (stat)
+            {
+            case PriceStatistic::EWMA:
+                return q.ewma;
+            case PriceStatistic::SMA:
+                return q.sma;
+            case PriceStatistic::VWAP:
+                return q.vwap;
+            case PriceStatistic::MEAN:
+            default:
+                return q.mean;
+            }
+        }
+        return order_books[instrument_id].get_statistic(stat);
+    }
+    return 0.0;
+}
+
 std::vector<double> Exchange::get_all_prices() const
 {
-    std::vector<double> prices(order_books.size());
+    std::vector<double> prices;
+    get_all_prices(prices);
+    return prices;
+}
+
+void Exchange::get_all_prices(std::vector<double> &prices) const
+{
+    prices.resize(order_books.size());
     for (size_t i = 0; i < order_books.size(); ++i)
     {
-        prices[i] = order_books[i].get_last_price();
+        prices[i] = get_price((int)i);
     }
-    return prices;
+}
+
+void Exchange::get_tick_volumes(std::vector<int> &volumes) const
+{
+    volumes.assign(num_instruments, 0);
+    for (int i = 0; i < num_instruments; ++i)
+        for (const auto &t : tick_trades[i])
+            volumes[i] += t.volume;
+}
+
+size_t Exchange::total_resting_orders() const
+{
+    size_t n = 0;
+    for (const auto &ob : order_books)
+        n += ob.bid_depth() + ob.ask_depth();
+    return n;
+}
+
+long long Exchange::total_expired_orders() const
+{
+    long long n = 0;
+    for (const auto &ob : order_books)
+        n += ob.get_expired_count();
+    return n;
+}
+
+bool Exchange::set_history_options(int bar_interval, bool keep_trades)
+{
+    bool ok = true;
+    for (auto &ob : order_books)
+        ok = ob.set_history_options(bar_interval, keep_trades) && ok;
+    return ok;
+}
+
+void Exchange::reserve_history(size_t trades_per_instrument)
+{
+    trade_log.reserve(trade_log.size() + trades_per_instrument * order_books.size());
+    for (auto &ob : order_books)
+        ob.reserve_history(trades_per_instrument);
 }
 
 void Exchange::update_global_prices(const std::vector<double> &global_prices, int /*local_rank*/)
@@ -157,12 +1296,7 @@ void Exchange::update_global_prices(const std::vector<double> &global_prices, in
 void Exchange::export_trade_log(const std::string &filename) const
 {
     std::ofstream ofs(filename);
-    ofs << "Timestamp,Instrument,Price,Volume,BuyAgent,SellAgent\n";
-    for (const auto &t : trade_log)
-    {
-        ofs << t.timestamp << "," << t.instrument_id << "," << t.price << "," << t.volume
-            << "," << t.buy_agent_id << "," << t.sell_agent_id << "\n";
-    }
+    write_trades_csv(ofs, trade_log.data(), trade_log.size());
 }
 
 void Exchange::export_price_history(const std::string &filename) const
@@ -173,20 +1307,100 @@ void Exchange::export_price_history(const std::string &filename) const
         ofs << ",Instrument_" << i;
     ofs << "\n";
 
-    // Find longest history length
-    size_t max_len = 0;
+    // Walk all bar series in step, one row per bar start tick
+    int interval = 1;
+    int last_tick = -1;
     for (const auto &ob : order_books)
-        max_len = std::max(max_len, ob.get_price_history().size());
+    {
+        const PriceHistory &h = ob.get_price_history();
+        interval = h.get_bar_interval();
+        if (h.bar_count() > 0)
+            last_tick = std::max(last_tick, (int)h.bar(h.bar_count() - 1).tick);
+    }
+    std::vector<size_t> next(order_books.size(), 0);
+    std::vector<double> close(order_books.size());
+    for (size_t i = 0; i < order_books.size(); ++i)
+        close[i] = order_books[i].get_price_history().get_initial_price();
 
-    for (size_t tick = 0; tick < max_len; ++tick)
+    for (int tick = 0; tick <= last_tick; tick += interval)
     {
         ofs << tick;
-        for (const auto &ob : order_books)
+        for (size_t i = 0; i < order_books.size(); ++i)
         {
-            const auto &hist = ob.get_price_history();
-            double v = tick < hist.size() ? hist[tick] : (hist.empty() ? 0.0 : hist.back());
-            ofs << "," << v;
+            const PriceHistory &h = order_books[i].get_price_history();
+            while (next[i] < h.bar_count() && h.bar(next[i]).tick <= tick)
+                close[i] = h.bar(next[i]++).close;
+            ofs << "," << close[i];
         }
         ofs << "\n";
     }
 }
+
+bool Exchange::write_history(const std::string &filename) const
+{
+    int size = 1, world_rank = 0;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+    // This rank's block: header, directory of hosted instruments, bars
+    std::vector<char> block;
+    ByteWriter w(block);
+    HistoryBlockHeader bh = {rank, 0, 0};
+    std::vector<HistoryEntry> entries;
+    for (int i = 0; i < num_instruments; ++i)
+    {
+        if (!is_local(i))
+            continue;
+        const PriceHistory &h = order_books[i].get_price_history();
+        HistoryEntry e = {i, h.get_bar_interval(), (int64_t)h.bar_count()};
+        entries.push_back(e);
+        bh.bar_count += e.bar_count;
+    }
+    bh.instrument_count = (int32_t)entries.size();
+    w.put(bh);
+    for (const auto &e : entries)
+        w.put(e);
+    for (const auto &e : entries)
+    {
+        const PriceHistory &h = order_books[e.instrument_id].get_price_history();
+        size_t at = block.size();
+        block.resize(at + h.bar_count() * sizeof(OhlcBar));
+        if (h.bar_count())
+            std::memcpy(block.data() + at, h.bar_data(), h.bar_count() * sizeof(OhlcBar));
+    }
+
+    // Blocks are laid out in rank order after the file header
+    long long my_bytes = (long long)block.size(), offset = 0;
+    MPI_Exscan(&my_bytes, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (world_rank == 0)
+        offset = 0; // MPI_Exscan leaves rank 0's result undefined
+    offset += (long long)sizeof(HistoryFileHeader);
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, filename.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+        return false;
+    MPI_File_set_size(fh, 0);
+    bool ok = true;
+    if (world_rank == 0)
+    {
+        HistoryFileHeader fhdr;
+        std::memcpy(fhdr.magic, "TSBARS01", 8);
+        fhdr.num_ranks = size;
+        fhdr.bar_size = (int32_t)sizeof(OhlcBar);
+        ok = MPI_File_write_at(fh, 0, &fhdr, (int)sizeof(fhdr), MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+    }
+    // Large blocks are written in pieces that fit an int count
+    const long long piece = 1LL << 30;
+    long long rounds = (my_bytes + piece - 1) / piece, max_rounds = 0;
+    MPI_Allreduce(&rounds, &max_rounds, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    for (long long r = 0; r < max_rounds; ++r)
+    {
+        long long start = std::min(r * piece, my_bytes);
+        int n = (int)std::min(piece, my_bytes - start);
+        ok = MPI_File_write_at_all(fh, offset + start, block.data() + start, n, MPI_BYTE,
+                                   MPI_STATUS_IGNORE) == MPI_SUCCESS && ok;
+    }
+    MPI_File_close(&fh);
+    return ok;
+}
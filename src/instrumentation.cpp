@@ -0,0 +1,90 @@
+#include "instrumentation.h"
+#include <cstring>
+#include <fstream>
+
+const char *phase_name(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::AGENT_GENERATION:
+        return "agent_generation";
+    case Phase::PROCESS_ORDERS:
+        return "process_orders";
+    case Phase::BROADCAST_PRICES:
+        return "broadcast_prices";
+    case Phase::BARRIER:
+    default:
+        return "barrier";
+    }
+}
+
+TickProfiler::TickProfiler(int rank_, size_t expected_ticks)
+    : rank(rank_), epoch(0)
+{
+    records.reserve(expected_ticks);
+    std::memset(&current, 0, sizeof(current));
+    // Calibrate now rather than inside the first timed tick
+    tsc_cycles_per_ns();
+    epoch = read_tsc();
+}
+
+void TickProfiler::begin_tick(int tick)
+{
+    std::memset(&current, 0, sizeof(current));
+    current.tick = tick;
+    current.rank = rank;
+}
+
+void TickProfiler::set_counters(long long orders, long long book_depth, long long fills, long long bytes)
+{
+    current.orders = orders;
+    current.book_depth = book_depth;
+    current.fills = fills;
+    current.bytes = bytes;
+}
+
+bool TickProfiler::write_binary(const std::string &filename) const
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs)
+        return false;
+    TimelineHeader h;
+    std::memcpy(h.magic, "TSPROF01", 8);
+    h.record_size = sizeof(TickRecord);
+    h.num_phases = NUM_PHASES;
+    h.cycles_per_ns = tsc_cycles_per_ns();
+    h.rank = rank;
+    h.reserved = 0;
+    h.num_records = records.size();
+    ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    ofs.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(TickRecord));
+    return (bool)ofs;
+}
+
+bool TickProfiler::write_chrome_trace(const std::string &filename) const
+{
+    std::ofstream ofs(filename);
+    if (!ofs)
+        return false;
+    const double us_per_cycle = 1.0 / (tsc_cycles_per_ns() * 1000.0);
+
+    ofs << "{\"traceEvents\":[\n";
+    ofs << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << rank
+        << ",\"args\":{\"name\":\"rank " << rank << "\"}}";
+    for (const auto &r : records)
+    {
+        for (int p = 0; p < NUM_PHASES; ++p)
+        {
+            ofs << ",\n{\"name\":\"" << phase_name((Phase)p) << "\",\"ph\":\"X\",\"pid\":" << rank
+                << ",\"tid\":0,\"ts\":" << r.phase_start[p] * us_per_cycle
+                << ",\"dur\":" << r.phase_cycles[p] * us_per_cycle
+                << ",\"args\":{\"tick\":" << r.tick << "}}";
+        }
+        ofs << ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":" << rank
+            << ",\"ts\":" << r.phase_start[0] * us_per_cycle
+            << ",\"args\":{\"orders\":" << r.orders << ",\"book_depth\":" << r.book_depth
+            << ",\"fills\":" << r.fills << ",\"bytes\":" << r.bytes << "}}";
+    }
+    ofs << "\n]}\n";
+    return (bool)ofs;
+}
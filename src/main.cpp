@@ -2,107 +2,307 @@
 #include <omp.h>
 #include <iostream>
 #include <memory>
+#include <algorithm>
 #include <chrono>
 #include <iomanip>
 #include <vector>
 #include <string>
 #include "exchange.h"
+#include "affinity.h"
 #include "agent.h"
+#include "agent_engine.h"
 #include "marketdata.h"
+#include "router.h"
+#include "balancer.h"
+#include "checkpoint.h"
+#include "comm_thread.h"
+#include "config.h"
+#include "continuous.h"
+#include "replay.h"
+#include "trade_log.h"
+#include "instrumentation.h"
 #include "utils.h"
 
 using namespace std;
 
-int main(int argc, char **argv)
+// One complete simulation run. The exchange and agent engine persist
+// across the runs of a sweep and are reset here, so book and agent storage
+// allocated by an earlier run is reused. Collective over MPI_COMM_WORLD.
+// local_rank and local_size place this rank among those on its machine;
+// thread_level is what MPI_Init_thread provided.
+static void run_simulation(const SimConfig &cfg, int rank, int size, int local_rank, int local_size,
+                           int thread_level, Exchange &exchange, AgentEngine &agents)
 {
-    // Initialize MPI environment
-    // Each MPI rank represents a separate exchange/market node
-    MPI_Init(&argc, &argv);
+    // Simulation parameters (see SimConfig and config_usage for meanings)
+    const int NUM_INSTRUMENTS = cfg.num_instruments;
+    const int NUM_AGENTS = cfg.total_agents();
+    const int NUM_THREADS = cfg.num_threads;
+    const int SIMULATION_TICKS = cfg.ticks;
+    const int PRICE_STALENESS = cfg.price_staleness;
+    const int SNAPSHOT_INTERVAL = cfg.snapshot_interval;
+    const bool SHARD_INSTRUMENTS = cfg.shard_instruments;
+    const int REBALANCE_INTERVAL = cfg.rebalance_interval;
+    const int HISTORY_BAR_INTERVAL = cfg.history_bar_interval;
+    const std::string &REPLAY_FILE = cfg.replay_file;
+    const int REPLAY_SPEED = cfg.replay_speed;
+    const int CHECKPOINT_INTERVAL = cfg.checkpoint_interval;
+    const int CONTINUOUS_MATCHERS = cfg.continuous_matchers;
+    const int ORDER_LIFETIME = cfg.order_lifetime;
+    const bool COMM_THREAD = cfg.comm_thread && thread_level >= MPI_THREAD_SERIALIZED;
+    const std::string &OUT = cfg.output_prefix;
+    const bool restart = cfg.restart;
 
-    int rank, size;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Get this process's rank
-    MPI_Comm_size(MPI_COMM_WORLD, &size); // Get total number of processes
+    // Set OpenMP thread count
+    omp_set_num_threads(NUM_THREADS);
 
-    // Simulation parameters
-    const int NUM_INSTRUMENTS = 3;     // Number of trading instruments per exchange
-    const int NUM_AGENTS = 8;          // Number of trader agents (OpenMP threads)
-    const int SIMULATION_TICKS = 1000; // Total simulation time steps
-    const int AGENTS_PER_INSTRUMENT = NUM_AGENTS / NUM_INSTRUMENTS;
+    // Pin the team before anything allocates, so first touch by a thread
+    // places memory on that thread's node
+    CpuTopology topology = detect_topology();
+    ThreadPlacement placement = plan_placement(topology, NUM_THREADS, local_rank, local_size);
+    const bool pinned = cfg.pin_threads && pin_threads(placement);
 
-    // Set OpenMP thread count
-    omp_set_num_threads(NUM_AGENTS);
+    if (cfg.comm_thread && !COMM_THREAD && rank == 0)
+        cerr << "warning: MPI lacks MPI_THREAD_SERIALIZED, communicating from the main thread" << endl;
+    const bool OFFLOAD = cfg.offload && AgentOffload::available();
+    if (cfg.offload && !OFFLOAD && rank == 0)
+        cerr << "warning: built without TRADING_OFFLOAD, agent kernels run on the host" << endl;
 
     if (rank == 0)
     {
         std::cout << "=== Algorithmic Trading Simulator ===" << std::endl;
         std::cout << "MPI Processes (Exchanges): " << size << std::endl;
-        std::cout << "OpenMP Threads (Agents) per Process: " << NUM_AGENTS << std::endl;
+        std::cout << "OpenMP Threads per Process: " << NUM_THREADS << std::endl;
+        std::cout << "Agents per Process: " << NUM_AGENTS << std::endl;
         std::cout << "Instruments per Exchange: " << NUM_INSTRUMENTS << std::endl;
         std::cout << "Simulation Ticks: " << SIMULATION_TICKS << std::endl;
+        std::cout << "Seed: " << cfg.seed << std::endl;
+        std::cout << "Price Staleness (ticks): " << PRICE_STALENESS << std::endl;
+        std::cout << "Sharded Instruments: " << (SHARD_INSTRUMENTS ? "yes" : "no") << std::endl;
+        std::cout << "Matching: ";
+        if (CONTINUOUS_MATCHERS > 0)
+            std::cout << "continuous, " << CONTINUOUS_MATCHERS << " matcher threads" << std::endl;
+        else
+            std::cout << "batch per tick" << std::endl;
+        if (ORDER_LIFETIME > 0)
+            std::cout << "Agent Order Lifetime (ticks): " << ORDER_LIFETIME << std::endl;
+        std::cout << "MPI Communication: "
+                  << (COMM_THREAD ? "dedicated thread (serialized)" : "main thread (funneled)") << std::endl;
+        std::cout << "Agent Kernels: " << (OFFLOAD ? AgentOffload::describe() : "host") << std::endl;
+        std::cout << "Thread Placement (rank 0): ";
+        if (pinned)
+            std::cout << describe_placement(topology, placement) << std::endl;
+        else
+            std::cout << (cfg.pin_threads ? "pinning unavailable" : "off") << std::endl;
         std::cout << "======================================" << std::endl;
     }
 
-    // Create exchange for this rank
-    Exchange exchange(rank, NUM_INSTRUMENTS);
+    // When sharded, every rank sees the same global instruments but hosts
+    // only NUM_INSTRUMENTS of them; orders for the rest are routed
+    const int market_instruments = SHARD_INSTRUMENTS ? NUM_INSTRUMENTS * size : NUM_INSTRUMENTS;
+
+    // Exchange for this rank, one submission lane per OpenMP thread
+    exchange.reset(market_instruments, DEFAULT_TICK_SIZE, NUM_THREADS);
+
+    // Agent population, persistent across ticks, stored as per-strategy
+    // arrays and driven by batched strategy kernels
+    if (cfg.agents_per_strategy.empty())
+        agents.rebuild(rank, NUM_AGENTS, market_instruments);
+    else
+        agents.rebuild(rank, cfg.agents_per_strategy, market_instruments);
+    agents.set_seed(cfg.seed);
+    agents.set_order_lifetime(ORDER_LIFETIME);
+    agents.set_offload(OFFLOAD);
+    // Each book lives with the thread generating most of its orders
+    if (pinned)
+        exchange.place_books(agents.home_threads(NUM_THREADS));
+
+    // Cross-rank order and fill routing for the sharded market
+    OrderRouter router(rank, size);
+    if (SHARD_INSTRUMENTS)
+    {
+        exchange.set_instrument_owners(OrderRouter::round_robin_owners(market_instruments, size));
+        router.register_agents(agents.get_base_agent_id(), (int)agents.size());
+    }
+
+    // Resume point: the newest checkpoint every rank completed. The run
+    // counters come first so the trade log can be reopened at the right
+    // length before the exchange and agents are restored below.
+    int start_tick = 0;
+    int loaded_slot = 0;
+    vector<char> checkpoint;
+    long long resume_orders = 0, resume_trades = 0, resume_trade_records = -1;
+    int resume_migrated = 0;
+    if (restart)
+    {
+        int last_tick = -1;
+        if (load_latest_checkpoint(OUT + "checkpoint", rank, size, last_tick, checkpoint, &loaded_slot))
+            start_tick = last_tick + 1;
+        else if (rank == 0)
+            cerr << "warning: no usable checkpoint, starting from tick 0" << endl;
+    }
+    ByteReader resume(checkpoint.data(), checkpoint.size());
+    if (start_tick > 0)
+    {
+        int saved_tick = 0;
+        resume.get(saved_tick);
+        resume.get(resume_orders);
+        resume.get(resume_trades);
+        resume.get(resume_migrated);
+        resume.get(resume_trade_records);
+    }
 
-    // Initialize market data manager for cross-exchange communication
-    MarketDataManager md_manager(rank, size);
+    // Fills stream to a per-rank binary log as they happen rather than
+    // accumulating in memory; tools/trade_log_to_csv converts it
+    TradeLogWriter trade_writer;
+    if (trade_writer.open(OUT + "trades_rank_" + to_string(rank) + ".bin", rank, resume_trade_records))
+        exchange.set_trade_sink(&trade_writer);
+    else if (rank == 0)
+        cerr << "warning: cannot open trade log, keeping trades in memory" << endl;
+    // Individual trades are already in the trade log; history keeps bars only
+    exchange.set_history_options(HISTORY_BAR_INTERVAL, false);
+
+    // Recorded feed submitted alongside the synthetic agents' orders
+    ReplayEngine replay;
+    if (!REPLAY_FILE.empty())
+    {
+        if (replay.open(REPLAY_FILE))
+        {
+            replay.set_speed(REPLAY_SPEED);
+            replay.seek(start_tick);
+        }
+        else if (rank == 0)
+            cerr << "warning: cannot open replay feed " << REPLAY_FILE << endl;
+    }
+
+    // Moves hot books off overloaded ranks by orders booked, so sharded
+    // runs stay reproducible
+    LoadBalancer balancer(rank, size, REBALANCE_INTERVAL);
+    int books_migrated = resume_migrated;
+
+    if (start_tick > 0 && (!exchange.deserialize(resume) || !agents.deserialize(resume)))
+    {
+        cerr << "Rank " << rank << ": checkpoint does not match this configuration" << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (rank == 0 && start_tick > 0)
+        cout << "Resuming from checkpoint after tick " << start_tick - 1 << endl;
+
+    // Per-rank checkpoint files written in the background
+    CheckpointWriter checkpointer(rank, size, OUT + "checkpoint");
+    checkpointer.set_next_slot(loaded_slot ^ 1);
+
+    // Continuous mode: books are matched on arrival by dedicated threads and
+    // process_orders only collects the fills
+    std::unique_ptr<ContinuousEngine> continuous;
+    if (CONTINUOUS_MATCHERS > 0)
+        continuous.reset(new ContinuousEngine(exchange, CONTINUOUS_MATCHERS));
+
+    // Cross-exchange market data. With a dedicated communication thread it
+    // also runs every collective of the tick loop, so MPI is only entered
+    // from one thread at a time
+    CommThread comm(rank, size, PRICE_STALENESS, SNAPSHOT_INTERVAL, COMM_THREAD);
+
+    // Per-tick phase timeline (compiled out unless TRADING_INSTRUMENTATION)
+    MPI_Barrier(MPI_COMM_WORLD);
+    INSTRUMENT(TickProfiler profiler(rank, SIMULATION_TICKS));
+    INSTRUMENT(long long bytes_before = 0);
 
     // Performance tracking
     auto start_time = std::chrono::high_resolution_clock::now();
 
     // Statistics tracking
-    long long total_orders = 0;
-    long long total_trades = 0;
+    long long total_orders = resume_orders;
+    long long total_trades = resume_trades;
+
+    // Price buffers reused every tick
+    vector<double> local_prices, global_prices;
+    vector<int> tick_volumes;
 
     // Main simulation loop
-    for (int tick = 0; tick < SIMULATION_TICKS; ++tick)
+    for (int tick = start_tick; tick < SIMULATION_TICKS; ++tick)
     {
 
-// Phase 1: Agents generate and submit orders (parallel)
-#pragma omp parallel reduction(+ : total_orders)
-        {
-            int thread_id = omp_get_thread_num();
-
-            // Each agent is assigned to trade specific instruments
-            int instrument_id = thread_id % NUM_INSTRUMENTS;
-
-            // Create agent with strategy based on thread ID
-            AgentStrategy strategy = static_cast<AgentStrategy>(thread_id % 4);
-            Agent agent(thread_id, rank * NUM_AGENTS + thread_id, strategy);
-
-            // Agent observes market and decides on action
-            double current_price = exchange.get_price(instrument_id);
-            double historical_avg = exchange.get_historical_average(instrument_id);
-
-            // Generate orders based on strategy
-            std::vector<Order> orders = agent.generate_orders(
-                instrument_id,
-                current_price,
-                historical_avg,
-                tick);
-
-            // Submit orders to exchange (thread-safe)
-            for (const auto &order : orders)
-            {
-                exchange.submit_order(order);
-                total_orders++;
-            }
-        }
+        INSTRUMENT(profiler.begin_tick(tick));
 
-        // Phase 2: Exchange processes orders and matches trades (sequential)
+        // Phase 1: Agents generate and submit orders (parallel strategy kernels),
+        // followed by this tick's slice of the replayed feed
+        INSTRUMENT(profiler.begin_phase(Phase::AGENT_GENERATION));
+        long long orders_this_tick = agents.generate_orders(exchange, tick);
+        orders_this_tick += replay.feed(exchange, tick);
+        total_orders += orders_this_tick;
+        comm.progress();
+        INSTRUMENT(profiler.end_phase(Phase::AGENT_GENERATION));
+
+        // Phase 2: Exchange processes orders and matches trades (parallel per instrument).
+        // Sharded: orders go to their instrument's host first and fills
+        // come back to the agents' hosts, one all-to-all each
+        INSTRUMENT(profiler.begin_phase(Phase::PROCESS_ORDERS));
+        if (SHARD_INSTRUMENTS)
+            comm.call([&] { router.route_orders(exchange); });
         int trades_this_tick = exchange.process_orders(tick);
         total_trades += trades_this_tick;
+        agents.apply_fills(exchange);
+        if (SHARD_INSTRUMENTS)
+        {
+            comm.call([&] { router.return_fills(exchange); });
+            agents.apply_fills(router.get_remote_fills());
+        }
+        INSTRUMENT(profiler.end_phase(Phase::PROCESS_ORDERS));
 
-        // Phase 3: Broadcast price updates across exchanges (MPI communication)
-        vector<double> local_prices = exchange.get_all_prices();
-        vector<double> global_prices = md_manager.broadcast_prices(local_prices);
+        // Phase 3: Exchange price updates across exchanges (MPI communication).
+        // With staleness N this posts a non-blocking reduction and consumes
+        // the one posted N ticks ago, which completed behind phases 1 and 2.
+        // A dedicated communication thread runs it behind the next tick.
+        INSTRUMENT(profiler.begin_phase(Phase::BROADCAST_PRICES));
+        exchange.get_all_prices(local_prices);
+        if (SHARD_INSTRUMENTS)
+        {
+            // Each instrument has a single host, whose view everyone takes
+            comm.call([&] { router.exchange_quotes(exchange); });
+        }
+        else
+        {
+            // Delta dissemination sends only instruments that moved
+            if (SNAPSHOT_INTERVAL > 0)
+                exchange.get_tick_volumes(tick_volumes);
+            // Update local exchange with global market information
+            if (comm.publish(local_prices, tick_volumes, global_prices))
+                exchange.update_global_prices(global_prices, rank);
+        }
+        if (SHARD_INSTRUMENTS && balancer.due(tick))
+            comm.call([&] { books_migrated += balancer.rebalance(exchange); });
+        INSTRUMENT(profiler.end_phase(Phase::BROADCAST_PRICES));
 
-        // Update local exchange with global market information
-        exchange.update_global_prices(global_prices, rank);
+        // Phase 4: Synchronize all exchanges at end of tick. The collective
+        // already paces the ranks, so the asynchronous mode skips it
+        INSTRUMENT(profiler.begin_phase(Phase::BARRIER));
+        if (PRICE_STALENESS == 0)
+            comm.synchronize();
+        INSTRUMENT(profiler.end_phase(Phase::BARRIER));
 
-        // Phase 4: Synchronize all exchanges at end of tick
-        MPI_Barrier(MPI_COMM_WORLD);
+        INSTRUMENT(profiler.set_counters(orders_this_tick, (long long)exchange.total_resting_orders(),
+                                         trades_this_tick, comm.get_bytes_sent() + router.get_bytes_sent() +
+                                                               balancer.get_bytes_sent() - bytes_before));
+        INSTRUMENT(bytes_before = comm.get_bytes_sent() + router.get_bytes_sent() + balancer.get_bytes_sent());
+        INSTRUMENT(profiler.end_tick());
+
+        // Checkpoint between ticks, when no orders are in flight. Only the
+        // serialization runs here; the I/O thread writes it out while the
+        // next ticks run
+        if (CHECKPOINT_INTERVAL > 0 && (tick + 1) % CHECKPOINT_INTERVAL == 0 && tick + 1 < SIMULATION_TICKS)
+        {
+            if (trade_writer.is_open())
+                trade_writer.flush();
+            ByteWriter w(checkpointer.buffer());
+            w.put(tick);
+            w.put(total_orders);
+            w.put(total_trades);
+            w.put(books_migrated);
+            w.put(trade_writer.is_open() ? trade_writer.records_written() : -1LL);
+            exchange.serialize(w);
+            agents.serialize(w);
+            checkpointer.commit(tick);
+        }
 
         // Progress reporting (rank 0 only, every 100 ticks)
         if (rank == 0 && (tick + 1) % 100 == 0)
@@ -114,21 +314,54 @@ int main(int argc, char **argv)
         }
     }
 
+    // Complete outstanding reductions so the final prices are applied
+    if (comm.drain(global_prices))
+        exchange.update_global_prices(global_prices, rank);
+
     // Calculate performance metrics
     auto end_time = chrono::high_resolution_clock::now();
-    auto duration = chrono::duration_cast<chrono::milliseconds>(
-                        end_time - start_time)
-                        .count();
+    auto duration = std::max<long long>(1, chrono::duration_cast<chrono::milliseconds>(
+                                               end_time - start_time)
+                                               .count());
 
     // Gather statistics from all ranks
     long long global_orders = 0;
     long long global_trades = 0;
     MPI_Reduce(&total_orders, &global_orders, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
     MPI_Reduce(&total_trades, &global_trades, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    long long expired = exchange.total_expired_orders(), global_expired = 0;
+    MPI_Reduce(&expired, &global_expired, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // Per-order match latency: orders summed, the quantiles' worst rank
+    double latency[4] = {0.0, 0.0, 0.0, 0.0};
+    long long matched = 0, global_matched = 0;
+    if (continuous)
+    {
+        MatchLatency l = continuous->get_latency();
+        matched = l.orders;
+        latency[0] = l.mean_ns;
+        latency[1] = l.p50_ns;
+        latency[2] = l.p99_ns;
+        latency[3] = l.max_ns;
+        continuous.reset();
+        MPI_Reduce(&matched, &global_matched, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : latency, latency, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    }
+
+    if (!checkpointer.finish() && rank == 0)
+        cerr << "warning: a checkpoint write failed" << endl;
 
     // Export results to file (each rank writes its own file)
-    exchange.export_trade_log("trades_rank_" + to_string(rank) + ".csv");
-    exchange.export_price_history("prices_rank_" + to_string(rank) + ".csv");
+    if (trade_writer.is_open())
+        trade_writer.close();
+    else
+        exchange.export_trade_log(OUT + "trades_rank_" + to_string(rank) + ".csv");
+    // Collective: every rank's bars go into one shared file
+    if (!exchange.write_history(OUT + "price_history.bin") && rank == 0)
+        cerr << "Failed to write " << OUT << "price_history.bin" << endl;
+    exchange.set_trade_sink(nullptr);
+    INSTRUMENT(profiler.write_chrome_trace(OUT + "timeline_rank_" + to_string(rank) + ".json"));
+    INSTRUMENT(profiler.write_binary(OUT + "timeline_rank_" + to_string(rank) + ".bin"));
 
     // Final report (rank 0 only)
     if (rank == 0)
@@ -141,8 +374,66 @@ int main(int argc, char **argv)
              << (global_orders * 1000.0 / duration) << endl;
         cout << "Trades per Second: "
              << (global_trades * 1000.0 / duration) << endl;
+        if (ORDER_LIFETIME > 0)
+            cout << "Orders Expired: " << global_expired << endl;
+        if (SHARD_INSTRUMENTS)
+            cout << "Order Books Migrated: " << books_migrated << endl;
+        if (CONTINUOUS_MATCHERS > 0)
+            cout << "Match Latency (ns, worst rank): mean " << latency[0] << ", p50 " << latency[1]
+                 << ", p99 " << latency[2] << ", max " << latency[3] << " over " << global_matched
+                 << " orders" << endl;
         cout << "==========================" << std::endl;
     }
+}
+
+int main(int argc, char **argv)
+{
+    // Initialize MPI environment
+    // Each MPI rank represents a separate exchange/market node. Serialized
+    // threading lets a communication thread (--comm-thread) make the calls;
+    // without one only the main thread does, as funneled requires
+    int thread_level = MPI_THREAD_SINGLE;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &thread_level);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Get this process's rank
+    MPI_Comm_size(MPI_COMM_WORLD, &size); // Get total number of processes
+
+    // Ranks sharing this machine, for splitting its CPUs between them
+    MPI_Comm node_comm;
+    int local_rank = 0, local_size = 1;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &local_rank);
+    MPI_Comm_size(node_comm, &local_size);
+    MPI_Comm_free(&node_comm);
+
+    // Every rank parses the same arguments and file, so all agree on the runs
+    vector<SimConfig> runs;
+    string error;
+    if (!parse_command_line(argc, argv, runs, error))
+    {
+        if (rank == 0)
+            cerr << error << endl;
+        MPI_Finalize();
+        return error == config_usage() ? 0 : 1;
+    }
+
+    // A sweep writes each run's files under its own prefix unless the
+    // config names one
+    if (runs.size() > 1)
+        for (size_t r = 0; r < runs.size(); ++r)
+            if (runs[r].output_prefix.empty())
+                runs[r].output_prefix = "run" + to_string(r) + "_";
+
+    // Created once; every run resets them in place
+    Exchange exchange(rank, runs[0].num_instruments, DEFAULT_TICK_SIZE, runs[0].num_threads);
+    AgentEngine agents(rank, 0, runs[0].num_instruments);
+    for (size_t r = 0; r < runs.size(); ++r)
+    {
+        if (rank == 0 && runs.size() > 1)
+            cout << "\n### Run " << r + 1 << " of " << runs.size() << " ###" << endl;
+        run_simulation(runs[r], rank, size, local_rank, local_size, thread_level, exchange, agents);
+    }
 
     // Cleanup MPI environment
     MPI_Finalize();
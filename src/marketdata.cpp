@@ -1,16 +1,202 @@
 #include "marketdata.h"
+#include "utils.h"
 
-MarketDataManager::MarketDataManager(int rank_, int size_) : rank(rank_), size(size_) {}
+MarketDataManager::MarketDataManager(int rank_, int size_)
+    : rank(rank_), size(size_), bytes_sent(0), staleness(0), head(0), in_flight(0),
+      snapshot_interval(100), publications(0) {}
 
 std::vector<double> MarketDataManager::broadcast_prices(const std::vector<double> &local_prices)
 {
-    std::vector<double> summed(local_prices.size(), 0.0);
+    std::vector<double> summed;
+    broadcast_prices(local_prices, summed);
+    return summed;
+}
+
+void MarketDataManager::broadcast_prices(const std::vector<double> &local_prices,
+                                         std::vector<double> &summed)
+{
+    summed.resize(local_prices.size());
     // Sum across ranks
     MPI_Allreduce(local_prices.data(), summed.data(), (int)local_prices.size(), MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    bytes_sent += (long long)(local_prices.size() * sizeof(double));
     // Average
     for (auto &v : summed)
         v /= size;
-    return summed;
+}
+
+void MarketDataManager::set_staleness(int ticks)
+{
+    if (in_flight > 0 || ticks < 0)
+        return;
+    staleness = ticks;
+    pending.assign(ticks > 0 ? ticks + 1 : 0, PendingReduction());
+    for (auto &p : pending)
+    {
+        p.request = MPI_REQUEST_NULL;
+        p.active = false;
+    }
+    head = 0;
+}
+
+bool MarketDataManager::exchange_prices(const std::vector<double> &local_prices,
+                                        std::vector<double> &global_prices)
+{
+    if (staleness == 0)
+    {
+        broadcast_prices(local_prices, global_prices);
+        return true;
+    }
+
+    // Post this tick's reduction into the free slot behind the in-flight ones
+    PendingReduction &slot = pending[(head + in_flight) % pending.size()];
+    slot.send.assign(local_prices.begin(), local_prices.end());
+    slot.recv.resize(local_prices.size());
+    MPI_Iallreduce(slot.send.data(), slot.recv.data(), (int)slot.send.size(), MPI_DOUBLE,
+                   MPI_SUM, MPI_COMM_WORLD, &slot.request);
+    slot.active = true;
+    bytes_sent += (long long)(local_prices.size() * sizeof(double));
+    in_flight++;
+
+    if (in_flight <= staleness)
+        return false;
+
+    // Consume the reduction posted staleness ticks ago
+    complete_oldest(global_prices);
+    return true;
+}
+
+void MarketDataManager::complete_oldest(std::vector<double> &global_prices)
+{
+    PendingReduction &oldest = pending[head];
+    MPI_Wait(&oldest.request, MPI_STATUS_IGNORE);
+    oldest.active = false;
+    global_prices.resize(oldest.recv.size());
+    for (size_t i = 0; i < oldest.recv.size(); ++i)
+        global_prices[i] = oldest.recv[i] / size;
+    head = (head + 1) % (int)pending.size();
+    in_flight--;
+}
+
+void MarketDataManager::progress()
+{
+    for (auto &p : pending)
+    {
+        if (!p.active)
+            continue;
+        int done = 0;
+        MPI_Test(&p.request, &done, MPI_STATUS_IGNORE);
+    }
+}
+
+bool MarketDataManager::drain(std::vector<double> &global_prices)
+{
+    if (in_flight == 0)
+        return false;
+    while (in_flight > 0)
+        complete_oldest(global_prices);
+    return true;
+}
+
+void MarketDataManager::set_snapshot_interval(int ticks)
+{
+    if (ticks > 0)
+        snapshot_interval = ticks;
+}
+
+int MarketDataManager::publish_deltas(const std::vector<double> &local_prices,
+                                      const std::vector<int> &tick_volumes,
+                                      std::vector<double> &global_prices)
+{
+    size_t n = local_prices.size();
+    bool snapshot = publications % snapshot_interval == 0 || published.size() != n;
+    if (published.size() != n)
+    {
+        published.assign(n, 0.0);
+        seqs.assign(n, 0);
+        rank_prices.assign(n * size, 0.0);
+        rank_volumes.assign(n * size, 0);
+        touched.assign(n, 0);
+        touched_ids.reserve(n);
+        outgoing.reserve(n);
+        counts.resize(size);
+        displs.resize(size);
+    }
+    publications++;
+
+    // Batch this rank's changes into one message
+    outgoing.clear();
+    for (size_t i = 0; i < n; ++i)
+    {
+        int vol = i < tick_volumes.size() ? tick_volumes[i] : 0;
+        if (!snapshot && local_prices[i] == published[i] && vol == 0)
+            continue;
+        PriceUpdate u;
+        u.instrument_id = (int32_t)i;
+        u.volume = vol;
+        u.price = local_prices[i];
+        u.seq = ++seqs[i];
+        outgoing.push_back(u);
+        published[i] = local_prices[i];
+    }
+
+    // Exchange counts, then the variable-length batches as raw bytes
+    int my_bytes = mpi_count(outgoing.size() * sizeof(PriceUpdate), "price update batch");
+    MPI_Allgather(&my_bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    size_t total = 0;
+    for (int r = 0; r < size; ++r)
+    {
+        displs[r] = mpi_count(total, "price update batch");
+        total += (size_t)counts[r];
+    }
+    incoming.resize(total / sizeof(PriceUpdate));
+    MPI_Allgatherv(outgoing.data(), my_bytes, MPI_BYTE, incoming.data(), counts.data(),
+                   displs.data(), MPI_BYTE, MPI_COMM_WORLD);
+    bytes_sent += my_bytes;
+
+    // Apply updates, then re-average only the instruments that changed
+    global_prices.resize(n);
+    for (int r = 0; r < size; ++r)
+    {
+        const PriceUpdate *u = incoming.data() + displs[r] / sizeof(PriceUpdate);
+        int k = counts[r] / (int)sizeof(PriceUpdate);
+        for (int j = 0; j < k; ++j)
+        {
+            size_t i = (size_t)u[j].instrument_id;
+            if (i >= n)
+                continue;
+            rank_prices[r * n + i] = u[j].price;
+            rank_volumes[r * n + i] = u[j].volume;
+            if (!touched[i])
+                touched_ids.push_back((int)i);
+            touched[i] = 1;
+        }
+    }
+    for (int i : touched_ids)
+    {
+        double sum = 0.0;
+        for (int r = 0; r < size; ++r)
+            sum += rank_prices[r * n + i];
+        global_prices[i] = sum / size;
+        touched[i] = 0;
+    }
+    touched_ids.clear();
+    return (int)incoming.size();
+}
+
+double MarketDataManager::get_rank_price(int source_rank, int instrument_id) const
+{
+    size_t n = published.size();
+    if (source_rank < 0 || source_rank >= size || instrument_id < 0 || (size_t)instrument_id >= n)
+        return 0.0;
+    return rank_prices[source_rank * n + instrument_id];
+}
+
+int MarketDataManager::get_rank_volume(int source_rank, int instrument_id) const
+{
+    size_t n = published.size();
+    if (source_rank < 0 || source_rank >= size || instrument_id < 0 || (size_t)instrument_id >= n)
+        return 0;
+    return rank_volumes[source_rank * n + instrument_id];
 }
 
 void MarketDataManager::synchronize()
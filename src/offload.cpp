@@ -0,0 +1,160 @@
+#include "offload.h"
+#include "strategies.h"
+#include <omp.h>
+#include <algorithm>
+
+AgentOffload::AgentOffload()
+    : device(0), num_slots(0), num_instruments(0), num_orders(0), mapped(false) {}
+
+AgentOffload::~AgentOffload()
+{
+    unmap();
+}
+
+bool AgentOffload::available()
+{
+#ifdef TRADING_OFFLOAD
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::string AgentOffload::describe()
+{
+#ifdef TRADING_OFFLOAD
+    int devices = omp_get_num_devices();
+    if (devices == 0)
+        return "OpenMP target, no device (host fallback)";
+    return "OpenMP target device " + std::to_string(omp_get_default_device()) + " of " +
+           std::to_string(devices);
+#else
+    return "host (built without TRADING_OFFLOAD)";
+#endif
+}
+
+void AgentOffload::unmap()
+{
+    if (!mapped)
+        return;
+#ifdef TRADING_OFFLOAD
+    [[maybe_unused]] const int *d_ids = ids.data();
+    [[maybe_unused]] const double *d_thr = thresholds.data();
+    [[maybe_unused]] const unsigned char *d_strategy = strategy.data();
+    [[maybe_unused]] const int *d_instrument = instrument.data();
+    [[maybe_unused]] const int *d_first = first_order.data();
+    [[maybe_unused]] const double *d_in = inputs.data();
+    [[maybe_unused]] DeviceOrder *d_out = batch.data();
+    const int n = num_slots, num_inputs = (int)inputs.size(), total = num_orders;
+#pragma omp target exit data device(device) map(delete : d_ids[0:n], d_thr[0:n], d_strategy[0:n], \
+                                                d_instrument[0:n], d_first[0:n + 1], d_in[0:num_inputs], \
+                                                d_out[0:total])
+#endif
+    mapped = false;
+}
+
+void AgentOffload::load(const int *ids_, const double *thresholds_, const std::vector<unsigned char> &strategy_of,
+                        const std::vector<int> &instrument_of, int num_instruments_)
+{
+    unmap();
+    num_slots = (int)strategy_of.size();
+    num_instruments = num_instruments_;
+    ids.assign(ids_, ids_ + num_slots);
+    thresholds.assign(thresholds_, thresholds_ + num_slots);
+    strategy = strategy_of;
+    instrument = instrument_of;
+    first_order.resize(num_slots + 1);
+    int total = 0;
+    for (int i = 0; i < num_slots; ++i)
+    {
+        first_order[i] = total;
+        total += default_strategy(static_cast<AgentStrategy>(strategy[i])).two_sided ? 2 : 1;
+    }
+    first_order[num_slots] = total;
+    num_orders = total;
+    inputs.assign(num_instruments * (1 + NUM_STRATEGIES), 0.0);
+    batch.resize(num_orders);
+
+#ifdef TRADING_OFFLOAD
+    device = omp_get_default_device();
+    [[maybe_unused]] const int *d_ids = ids.data();
+    [[maybe_unused]] const double *d_thr = thresholds.data();
+    [[maybe_unused]] const unsigned char *d_strategy = strategy.data();
+    [[maybe_unused]] const int *d_instrument = instrument.data();
+    [[maybe_unused]] const int *d_first = first_order.data();
+    [[maybe_unused]] const double *d_in = inputs.data();
+    [[maybe_unused]] DeviceOrder *d_out = batch.data();
+    const int n = num_slots, num_inputs = (int)inputs.size();
+#pragma omp target enter data device(device) map(to : d_ids[0:n], d_thr[0:n], d_strategy[0:n], \
+                                                 d_instrument[0:n], d_first[0:n + 1]) \
+                                             map(alloc : d_in[0:num_inputs], d_out[0:total])
+#endif
+    mapped = true;
+}
+
+const std::vector<DeviceOrder> &AgentOffload::run(uint64_t seed, uint64_t tick, const double *prices,
+                                                  const double *references)
+{
+    std::copy(prices, prices + num_instruments, inputs.begin());
+    std::copy(references, references + NUM_STRATEGIES * num_instruments, inputs.begin() + num_instruments);
+
+    const int *d_ids = ids.data();
+    const double *d_thr = thresholds.data();
+    const unsigned char *d_strategy = strategy.data();
+    const int *d_instrument = instrument.data();
+    const int *d_first = first_order.data();
+    const double *d_in = inputs.data();
+    DeviceOrder *d_out = batch.data();
+    const int n = num_slots, ni = num_instruments;
+
+    // The arrays are present; referring to them in the region uses the
+    // device copies
+#ifdef TRADING_OFFLOAD
+    const int num_inputs = (int)inputs.size(), total = num_orders;
+#pragma omp target update device(device) to(d_in[0:num_inputs])
+#pragma omp target teams distribute parallel for device(device)
+#endif
+    for (int i = 0; i < n; ++i)
+    {
+        Philox::Block r = Philox::draw(seed, (uint32_t)d_ids[i], tick);
+        const int inst = d_instrument[i];
+        const int s = d_strategy[i];
+        const double px = d_in[inst];
+        const double ref = d_in[ni + s * ni + inst];
+        KernelQuote q;
+        switch (static_cast<AgentStrategy>(s))
+        {
+        case AgentStrategy::RANDOM_WALK:
+            q = RandomWalk<>::quote(r.v[0], r.v[1], px, ref, d_thr[i]);
+            break;
+        case AgentStrategy::MOMENTUM:
+            q = Momentum<>::quote(r.v[0], r.v[1], px, ref, d_thr[i]);
+            break;
+        case AgentStrategy::MEAN_REVERSION:
+            q = MeanReversion<>::quote(r.v[0], r.v[1], px, ref, d_thr[i]);
+            break;
+        case AgentStrategy::MARKET_MAKER:
+        default:
+            q = MarketMaker<>::quote(r.v[0], r.v[1], px, ref, d_thr[i]);
+            break;
+        }
+        DeviceOrder *o = d_out + d_first[i];
+        o[0].price = q.price;
+        o[0].agent_id = d_ids[i];
+        o[0].volume = q.volume;
+        o[0].instrument_id = inst;
+        o[0].is_buy = q.is_buy;
+        if (d_first[i + 1] - d_first[i] == 2)
+        {
+            o[1].price = q.ask_price;
+            o[1].agent_id = d_ids[i];
+            o[1].volume = q.ask_volume;
+            o[1].instrument_id = inst;
+            o[1].is_buy = 0;
+        }
+    }
+#ifdef TRADING_OFFLOAD
+#pragma omp target update device(device) from(d_out[0:total])
+#endif
+    return batch;
+}
@@ -0,0 +1,128 @@
+#include "price_history.h"
+#include <cstdio>
+
+PriceHistory::PriceHistory(double initial_price_, int bar_interval_, bool keep_trades_)
+    : initial_price(initial_price_), bar_interval(bar_interval_ > 0 ? bar_interval_ : 1),
+      keep_trades(keep_trades_)
+{
+}
+
+bool PriceHistory::configure(int bar_interval_, bool keep_trades_)
+{
+    if (bar_interval_ < 1 || !bars.empty() || !prices.empty())
+        return false;
+    bar_interval = bar_interval_;
+    keep_trades = keep_trades_;
+    return true;
+}
+
+void PriceHistory::clear(double initial_price_)
+{
+    initial_price = initial_price_;
+    bar_interval = 1;
+    keep_trades = true;
+    ticks.clear();
+    prices.clear();
+    volumes.clear();
+    bars.clear();
+}
+
+void PriceHistory::reserve(size_t trades)
+{
+    if (keep_trades)
+    {
+        ticks.reserve(ticks.size() + trades);
+        prices.reserve(prices.size() + trades);
+        volumes.reserve(volumes.size() + trades);
+    }
+}
+
+void PriceHistory::add_trade(int tick, double price, int volume)
+{
+    if (keep_trades)
+    {
+        ticks.push_back(tick);
+        prices.push_back(price);
+        volumes.push_back(volume);
+    }
+
+    int bucket = tick - tick % bar_interval;
+    if (bars.empty() || bars.back().tick != bucket)
+    {
+        OhlcBar b = {bucket, 1, volume, price, price, price, price};
+        bars.push_back(b);
+        return;
+    }
+    OhlcBar &b = bars.back();
+    b.trades++;
+    b.volume += volume;
+    if (price > b.high)
+        b.high = price;
+    if (price < b.low)
+        b.low = price;
+    b.close = price;
+}
+
+void PriceHistory::serialize(ByteWriter &out) const
+{
+    out.put(initial_price);
+    out.put(bar_interval);
+    out.put(keep_trades ? 1 : 0);
+    out.put_array(ticks.data(), ticks.size());
+    out.put_array(prices.data(), prices.size());
+    out.put_array(volumes.data(), volumes.size());
+    out.put_array(bars.data(), bars.size());
+}
+
+bool PriceHistory::deserialize(ByteReader &in)
+{
+    int keep = 0;
+    in.get(initial_price);
+    in.get(bar_interval);
+    in.get(keep);
+    size_t nt = 0, np = 0, nv = 0, nb = 0;
+    const char *t = in.get_array<int32_t>(nt);
+    const char *p = in.get_array<double>(np);
+    const char *v = in.get_array<int32_t>(nv);
+    const char *b = in.get_array<OhlcBar>(nb);
+    if (!in.ok() || bar_interval < 1 || nt != np || np != nv)
+        return false;
+    keep_trades = keep != 0;
+    ticks.assign(t, nt);
+    prices.assign(p, np);
+    volumes.assign(v, nv);
+    bars.assign(b, nb);
+    return true;
+}
+
+bool read_history_file(const std::string &filename, std::vector<HistorySeries> &series)
+{
+    series.clear();
+    std::FILE *f = std::fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    HistoryFileHeader h;
+    bool ok = std::fread(&h, sizeof(h), 1, f) == 1 && std::memcmp(h.magic, "TSBARS01", 8) == 0 &&
+              h.bar_size == (int32_t)sizeof(OhlcBar);
+    for (int r = 0; ok && r < h.num_ranks; ++r)
+    {
+        HistoryBlockHeader block;
+        ok = std::fread(&block, sizeof(block), 1, f) == 1 && block.instrument_count >= 0;
+        if (!ok)
+            break;
+        std::vector<HistoryEntry> entries(block.instrument_count);
+        ok = entries.empty() || std::fread(entries.data(), sizeof(HistoryEntry), entries.size(), f) == entries.size();
+        for (size_t e = 0; ok && e < entries.size(); ++e)
+        {
+            HistorySeries s;
+            s.rank = block.rank;
+            s.instrument_id = entries[e].instrument_id;
+            s.bar_interval = entries[e].bar_interval;
+            s.bars.resize((size_t)entries[e].bar_count);
+            ok = s.bars.empty() || std::fread(s.bars.data(), sizeof(OhlcBar), s.bars.size(), f) == s.bars.size();
+            series.push_back(std::move(s));
+        }
+    }
+    std::fclose(f);
+    return ok;
+}
@@ -0,0 +1,296 @@
+#include "replay.h"
+#include "affinity.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <omp.h>
+
+#if defined(_WIN32)
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Below this many records a tick is submitted without forking a team
+static const size_t PARALLEL_MIN_RECORDS = 1024;
+
+bool write_replay_file(const std::string &filename, const std::vector<ReplayEvent> &events)
+{
+    std::FILE *f = std::fopen(filename.c_str(), "wb");
+    if (!f)
+        return false;
+    ReplayFileHeader h;
+    std::memcpy(h.magic, "TSEVENT1", 8);
+    h.record_size = sizeof(ReplayEvent);
+    h.reserved = 0;
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+              (events.empty() || std::fwrite(events.data(), sizeof(ReplayEvent), events.size(), f) == events.size());
+    return std::fclose(f) == 0 && ok;
+}
+
+ReplayEngine::ReplayEngine(size_t prefetch_bytes_)
+    : base(nullptr), file_bytes(0), trade_format(false), data_offset(0), record_size(0),
+      record_count(0), cursor(0), first_tick(0), speed(1), agent_id(-1), submitted(0),
+      prefetch_bytes(prefetch_bytes_ > 0 ? prefetch_bytes_ : 1), prefetch_goal(0), prefetched(0),
+      stopping(false)
+{
+}
+
+ReplayEngine::~ReplayEngine()
+{
+    close();
+}
+
+bool ReplayEngine::open(const std::string &filename)
+{
+    if (base)
+        return false;
+#if defined(_WIN32)
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs)
+        return false;
+    buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    base = buffer.data();
+    file_bytes = buffer.size();
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+    base = static_cast<const char *>(map);
+    file_bytes = (size_t)st.st_size;
+#endif
+
+    // Both headers are 16 bytes: magic, record size, one spare int
+    bool ok = file_bytes >= sizeof(ReplayFileHeader);
+    if (ok && std::memcmp(base, "TSEVENT1", 8) == 0)
+    {
+        trade_format = false;
+        record_size = sizeof(ReplayEvent);
+        data_offset = sizeof(ReplayFileHeader);
+    }
+    else if (ok && std::memcmp(base, "TSTRADE1", 8) == 0)
+    {
+        trade_format = true;
+        record_size = sizeof(Trade);
+        data_offset = sizeof(ReplayFileHeader);
+    }
+    else
+        ok = false;
+    uint32_t stored_size = 0;
+    if (ok)
+        std::memcpy(&stored_size, base + 8, sizeof(stored_size));
+    if (!ok || stored_size != record_size)
+    {
+        close();
+        return false;
+    }
+
+    record_count = (file_bytes - data_offset) / record_size;
+    cursor = 0;
+    submitted = 0;
+    first_tick = record_count > 0 ? record_tick(0) : 0;
+
+    stopping = false;
+    prefetched = prefetch_goal = data_offset;
+    prefetcher = std::thread(&ReplayEngine::prefetch_loop, this);
+    request_prefetch();
+    return true;
+}
+
+void ReplayEngine::close()
+{
+    if (prefetcher.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        prefetcher.join();
+    }
+#if !defined(_WIN32)
+    if (base)
+        munmap(const_cast<char *>(base), file_bytes);
+#endif
+    buffer.clear();
+    base = nullptr;
+    file_bytes = 0;
+    record_count = 0;
+    cursor = 0;
+}
+
+void ReplayEngine::set_speed(int recorded_ticks_per_tick)
+{
+    speed = std::max(1, recorded_ticks_per_tick);
+}
+
+void ReplayEngine::request_prefetch()
+{
+    size_t goal = std::min(file_bytes, data_offset + cursor * record_size + prefetch_bytes);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        // Wake the thread only once the window has moved by half, so it
+        // works in large steps rather than one page per tick
+        if (goal <= prefetch_goal || (goal < file_bytes && goal - prefetch_goal < prefetch_bytes / 2))
+            return;
+        prefetch_goal = goal;
+    }
+    cv.notify_one();
+}
+
+void ReplayEngine::prefetch_loop()
+{
+    // Started by the pinned main thread; keep off worker 0's CPU
+    release_thread();
+#if defined(_WIN32)
+    const size_t page = 4096;
+#else
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        cv.wait(lock, [this] { return stopping || prefetch_goal > prefetched; });
+        if (stopping)
+            return;
+        size_t from = prefetched, to = prefetch_goal;
+        lock.unlock();
+
+#if !defined(_WIN32)
+        size_t aligned = from / page * page;
+        madvise(const_cast<char *>(base) + aligned, to - aligned, MADV_WILLNEED);
+#endif
+        // Touch one byte per page so the faults are taken here, not in feed()
+        volatile char sink = 0;
+        for (size_t off = from; off < to; off += page)
+            sink = sink + base[off];
+        (void)sink;
+
+        lock.lock();
+        prefetched = std::max(prefetched, to);
+    }
+}
+
+int ReplayEngine::record_tick(size_t i) const
+{
+    const char *rec = base + data_offset + i * record_size;
+    int32_t tick;
+    if (trade_format)
+        std::memcpy(&tick, rec + offsetof(Trade, timestamp), sizeof(tick));
+    else
+        std::memcpy(&tick, rec + offsetof(ReplayEvent, tick), sizeof(tick));
+    return tick;
+}
+
+int ReplayEngine::decode(size_t i, Order out[2]) const
+{
+    const char *rec = base + data_offset + i * record_size;
+    Order o;
+    o.agent_id = agent_id;
+    if (trade_format)
+    {
+        Trade t;
+        std::memcpy(&t, rec, sizeof(t));
+        o.price = t.price;
+        o.instrument_id = t.instrument_id;
+        o.volume = t.volume;
+        o.is_buy = true;
+        out[0] = o;
+        o.is_buy = false;
+        out[1] = o;
+        return 2;
+    }
+    ReplayEvent e;
+    std::memcpy(&e, rec, sizeof(e));
+    o.price = e.price;
+    o.instrument_id = e.instrument_id;
+    o.volume = e.volume;
+    o.is_buy = e.is_buy != 0;
+    out[0] = o;
+    return 1;
+}
+
+int ReplayEngine::feed(Exchange &exchange, int tick)
+{
+    if (!base || cursor >= record_count)
+        return 0;
+
+    // Records up to the end of this tick's window of recorded time
+    long long window_end = (long long)first_tick + (long long)(tick + 1) * speed;
+    size_t begin = cursor, end = cursor;
+    while (end < record_count && record_tick(end) < window_end)
+        ++end;
+    if (begin == end)
+        return 0;
+
+    // Each instrument maps to one lane and each lane to one thread, so an
+    // instrument's records are submitted in file order
+    const int lanes = exchange.get_num_lanes();
+    int count = 0;
+#pragma omp parallel num_threads(lanes) if (end - begin >= PARALLEL_MIN_RECORDS) reduction(+ : count)
+    {
+        const int t = omp_get_thread_num();
+        const int nt = omp_get_num_threads();
+        Order orders[2];
+        for (size_t i = begin; i < end; ++i)
+        {
+            int n = decode(i, orders);
+            int instrument = orders[0].instrument_id;
+            if (instrument < 0 || instrument >= exchange.get_num_instruments())
+                continue;
+            int lane = instrument % lanes;
+            if (lane % nt != t || !exchange.is_local(instrument))
+                continue;
+            for (int k = 0; k < n; ++k)
+            {
+                orders[k].timestamp = tick;
+                if (exchange.submit_order(orders[k], lane) != 0)
+                    count++;
+            }
+        }
+    }
+
+    cursor = end;
+    submitted += count;
+    request_prefetch();
+    return count;
+}
+
+void ReplayEngine::seek(int tick)
+{
+    if (!base)
+        return;
+    // Records are sorted by tick, so the first one at or past the start of
+    // the tick's window is found by bisection
+    long long window_begin = (long long)first_tick + (long long)tick * speed;
+    size_t lo = 0, hi = record_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (record_tick(mid) < window_begin)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    cursor = lo;
+    {
+        // Read ahead from the new position, not across the skipped records
+        std::lock_guard<std::mutex> lock(mtx);
+        size_t at = data_offset + cursor * record_size;
+        if (prefetch_goal < at)
+            prefetch_goal = prefetched = at;
+    }
+    request_prefetch();
+}
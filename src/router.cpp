@@ -0,0 +1,132 @@
+#include "router.h"
+#include "utils.h"
+#include <algorithm>
+
+static const int QUOTE_FIELDS = 5;
+
+OrderRouter::OrderRouter(int rank_, int size_)
+    : rank(rank_), size(size_), bytes_sent(0)
+{
+    agent_starts.assign(size, 0);
+    agent_counts.assign(size, 0);
+    outbound_orders.resize(size);
+    outbound_fills.resize(size);
+    send_counts.resize(size);
+    recv_counts.resize(size);
+    send_displs.resize(size);
+    recv_displs.resize(size);
+}
+
+std::vector<int> OrderRouter::round_robin_owners(int num_instruments, int size)
+{
+    std::vector<int> owners(num_instruments);
+    for (int i = 0; i < num_instruments; ++i)
+        owners[i] = i % size;
+    return owners;
+}
+
+void OrderRouter::register_agents(int first_agent_id, int num_agents)
+{
+    MPI_Allgather(&first_agent_id, 1, MPI_INT, agent_starts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    MPI_Allgather(&num_agents, 1, MPI_INT, agent_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+}
+
+int OrderRouter::home_rank(int agent_id) const
+{
+    for (int r = 0; r < size; ++r)
+        if (agent_id >= agent_starts[r] && agent_id < agent_starts[r] + agent_counts[r])
+            return r;
+    return -1;
+}
+
+template <typename T>
+void OrderRouter::exchange_batches(std::vector<std::vector<T>> &batches,
+                                   std::vector<T> &send, std::vector<T> &recv)
+{
+    // Records travel as raw bytes; counts and displacements are in bytes
+    // and must fit in an int
+    send.clear();
+    for (int r = 0; r < size; ++r)
+    {
+        send_displs[r] = mpi_count(send.size() * sizeof(T), "routed batch");
+        send_counts[r] = mpi_count(batches[r].size() * sizeof(T), "routed batch");
+        send.insert(send.end(), batches[r].begin(), batches[r].end());
+        batches[r].clear();
+    }
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    size_t total = 0;
+    for (int r = 0; r < size; ++r)
+    {
+        recv_displs[r] = mpi_count(total, "routed batch");
+        total += (size_t)recv_counts[r];
+    }
+    recv.resize(total / sizeof(T));
+    MPI_Alltoallv(send.data(), send_counts.data(), send_displs.data(), MPI_BYTE,
+                  recv.data(), recv_counts.data(), recv_displs.data(), MPI_BYTE, MPI_COMM_WORLD);
+    for (int r = 0; r < size; ++r)
+        if (r != rank)
+            bytes_sent += send_counts[r];
+}
+
+int OrderRouter::route_orders(Exchange &exchange)
+{
+    exchange.collect_remote_orders(outbound_orders);
+    exchange_batches(outbound_orders, send_orders, recv_orders);
+    // Received in source rank order, so booking order is deterministic
+    for (const auto &o : recv_orders)
+        exchange.inject_order(o);
+    return (int)recv_orders.size();
+}
+
+int OrderRouter::return_fills(const Exchange &exchange)
+{
+    for (int i = 0; i < exchange.get_num_instruments(); ++i)
+    {
+        if (!exchange.is_local(i))
+            continue;
+        for (const auto &t : exchange.get_instrument_trades(i))
+        {
+            int buyer = home_rank(t.buy_agent_id);
+            int seller = home_rank(t.sell_agent_id);
+            if (buyer >= 0 && buyer != rank)
+                outbound_fills[buyer].push_back(t);
+            if (seller >= 0 && seller != rank && seller != buyer)
+                outbound_fills[seller].push_back(t);
+        }
+    }
+    exchange_batches(outbound_fills, send_fills, recv_fills);
+    return (int)recv_fills.size();
+}
+
+void OrderRouter::exchange_quotes(Exchange &exchange)
+{
+    // Non-owners contribute zeros, so the sum is the owner's view
+    int n = exchange.get_num_instruments();
+    quote_local.assign(n * QUOTE_FIELDS, 0.0);
+    quote_global.resize(n * QUOTE_FIELDS);
+    for (int i = 0; i < n; ++i)
+    {
+        if (!exchange.is_local(i))
+            continue;
+        double *q = quote_local.data() + i * QUOTE_FIELDS;
+        q[0] = exchange.get_price(i);
+        q[1] = exchange.get_statistic(i, PriceStatistic::MEAN);
+        q[2] = exchange.get_statistic(i, PriceStatistic::EWMA);
+        q[3] = exchange.get_statistic(i, PriceStatistic::SMA);
+        q[4] = exchange.get_statistic(i, PriceStatistic::VWAP);
+    }
+    MPI_Allreduce(quote_local.data(), quote_global.data(), n * QUOTE_FIELDS, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    bytes_sent += (long long)(n * QUOTE_FIELDS * sizeof(double));
+
+    quotes.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        const double *q = quote_global.data() + i * QUOTE_FIELDS;
+        quotes[i].price = q[0];
+        quotes[i].mean = q[1];
+        quotes[i].ewma = q[2];
+        quotes[i].sma = q[3];
+        quotes[i].vwap = q[4];
+    }
+    exchange.set_remote_quotes(quotes);
+}
@@ -0,0 +1,143 @@
+#include "statistics.h"
+#include <cmath>
+#include <numeric>
+
+PriceStatistics::PriceStatistics(double initial_price, size_t window_, double ewma_alpha_)
+    : ewma_alpha(ewma_alpha_), window(window_ > 0 ? window_ : 1),
+      count(1), mean_price(initial_price), m2_price(0.0), ewma_price(initial_price),
+      ring_pos(0), window_sum(initial_price),
+      last_price(initial_price), return_count(0), mean_return(0.0), m2_return(0.0),
+      notional(0.0), traded_volume(0)
+{
+    // The initial price seeds every average, matching the price history
+    ring.reserve(window);
+    ring.push_back(initial_price);
+    ring_pos = ring.size() % window;
+}
+
+void PriceStatistics::add_trade(double price, int volume)
+{
+    // Welford update of mean and variance
+    count++;
+    double delta = price - mean_price;
+    mean_price += delta / count;
+    m2_price += delta * (price - mean_price);
+
+    ewma_price += ewma_alpha * (price - ewma_price);
+
+    // Windowed sum: replace the oldest price once the ring is full
+    if (ring.size() < window)
+    {
+        ring.push_back(price);
+        window_sum += price;
+    }
+    else
+    {
+        window_sum += price - ring[ring_pos];
+        ring[ring_pos] = price;
+    }
+    ring_pos = (ring_pos + 1) % window;
+    if (ring_pos == 0)
+    {
+        // Resum once per window to stop rounding error accumulating; O(1) amortized
+        window_sum = std::accumulate(ring.begin(), ring.end(), 0.0);
+    }
+
+    if (last_price > 0.0 && price > 0.0)
+    {
+        double r = std::log(price / last_price);
+        return_count++;
+        double rd = r - mean_return;
+        mean_return += rd / return_count;
+        m2_return += rd * (r - mean_return);
+    }
+    last_price = price;
+
+    notional += price * volume;
+    traded_volume += volume;
+}
+
+double PriceStatistics::sma() const
+{
+    return window_sum / ring.size();
+}
+
+double PriceStatistics::vwap() const
+{
+    if (traded_volume == 0)
+        return mean_price;
+    return notional / traded_volume;
+}
+
+double PriceStatistics::variance() const
+{
+    return m2_price / count;
+}
+
+double PriceStatistics::volatility() const
+{
+    if (return_count < 2)
+        return 0.0;
+    return std::sqrt(m2_return / (return_count - 1));
+}
+
+double PriceStatistics::get(PriceStatistic stat) const
+{
+    switch (stat)
+    {
+    case PriceStatistic::EWMA:
+        return ewma();
+    case PriceStatistic::SMA:
+        return sma();
+    case PriceStatistic::VWAP:
+        return vwap();
+    case PriceStatistic::MEAN:
+    default:
+        return mean();
+    }
+}
+
+void PriceStatistics::serialize(ByteWriter &out) const
+{
+    out.put(ewma_alpha);
+    out.put((unsigned long long)window);
+    out.put(count);
+    out.put(mean_price);
+    out.put(m2_price);
+    out.put(ewma_price);
+    out.put_vector(ring);
+    out.put((unsigned long long)ring_pos);
+    out.put(window_sum);
+    out.put(last_price);
+    out.put(return_count);
+    out.put(mean_return);
+    out.put(m2_return);
+    out.put(notional);
+    out.put(traded_volume);
+}
+
+bool PriceStatistics::deserialize(ByteReader &in)
+{
+    unsigned long long w = 0, pos = 0;
+    in.get(ewma_alpha);
+    in.get(w);
+    in.get(count);
+    in.get(mean_price);
+    in.get(m2_price);
+    in.get(ewma_price);
+    in.get_vector(ring);
+    in.get(pos);
+    in.get(window_sum);
+    in.get(last_price);
+    in.get(return_count);
+    in.get(mean_return);
+    in.get(m2_return);
+    in.get(notional);
+    in.get(traded_volume);
+    if (!in.ok() || w == 0 || ring.size() > w || pos >= w)
+        return false;
+    window = (size_t)w;
+    ring_pos = (size_t)pos;
+    ring.reserve(window);
+    return true;
+}
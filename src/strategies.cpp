@@ -0,0 +1,21 @@
+#include "strategies.h"
+
+static const StrategyInfo REGISTRY[NUM_STRATEGIES] = {
+    make_strategy<RandomWalk<>>("random_walk"),
+    make_strategy<Momentum<>>("momentum"),
+    make_strategy<MeanReversion<>>("mean_reversion"),
+    make_strategy<MarketMaker<>>("market_maker"),
+};
+
+const StrategyInfo &default_strategy(AgentStrategy id)
+{
+    return REGISTRY[static_cast<int>(id)];
+}
+
+const StrategyInfo *find_strategy(const std::string &name)
+{
+    for (const auto &info : REGISTRY)
+        if (name == info.name)
+            return &info;
+    return nullptr;
+}
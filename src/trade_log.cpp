@@ -0,0 +1,186 @@
+#include "trade_log.h"
+#include "affinity.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+TradeLogWriter::TradeLogWriter(size_t chunk_records_)
+    : file(nullptr), chunk_records(chunk_records_ > 0 ? chunk_records_ : 1), active(0),
+      pending(false), stopping(false), failed(false), written(0)
+{
+}
+
+TradeLogWriter::~TradeLogWriter()
+{
+    close();
+}
+
+bool TradeLogWriter::open(const std::string &filename, int rank, long long resume_records)
+{
+    if (file)
+        return false;
+    if (resume_records >= 0)
+    {
+        // Keep the header and the first resume_records records, drop the rest
+        std::error_code ec;
+        uintmax_t keep = sizeof(TradeLogHeader) + (uintmax_t)resume_records * sizeof(Trade);
+        uintmax_t have = std::filesystem::file_size(filename, ec);
+        if (ec || have < keep)
+            return false;
+        std::filesystem::resize_file(filename, keep, ec);
+        file = ec ? nullptr : std::fopen(filename.c_str(), "r+b");
+        if (!file)
+            return false;
+        TradeLogHeader h;
+        failed = std::fread(&h, sizeof(h), 1, file) != 1 || std::memcmp(h.magic, "TSTRADE1", 8) != 0 ||
+                 h.record_size != sizeof(Trade) || std::fseek(file, 0, SEEK_END) != 0;
+        if (failed)
+        {
+            std::fclose(file);
+            file = nullptr;
+            return false;
+        }
+    }
+    else
+    {
+        file = std::fopen(filename.c_str(), "wb");
+        if (!file)
+            return false;
+        TradeLogHeader h;
+        std::memcpy(h.magic, "TSTRADE1", 8);
+        h.record_size = sizeof(Trade);
+        h.rank = rank;
+        failed = std::fwrite(&h, sizeof(h), 1, file) != 1;
+    }
+
+    for (auto &c : chunks)
+    {
+        c.clear();
+        c.reserve(chunk_records);
+    }
+    active = 0;
+    pending = false;
+    stopping = false;
+    written = resume_records >= 0 ? resume_records : 0;
+    io = std::thread(&TradeLogWriter::io_loop, this);
+    return !failed;
+}
+
+void TradeLogWriter::io_loop()
+{
+    // Started by the pinned main thread; keep off worker 0's CPU
+    release_thread();
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        cv.wait(lock, [this] { return pending || stopping; });
+        if (pending)
+        {
+            // The inactive chunk is ours until pending is cleared
+            const std::vector<Trade> &chunk = chunks[active ^ 1];
+            lock.unlock();
+            bool ok = chunk.empty() ||
+                      std::fwrite(chunk.data(), sizeof(Trade), chunk.size(), file) == chunk.size();
+            lock.lock();
+            failed = failed || !ok;
+            pending = false;
+            cv.notify_all();
+        }
+        else if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+void TradeLogWriter::hand_off()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !pending; });
+    active ^= 1;
+    chunks[active].clear(); // already written, capacity kept
+    pending = true;
+    cv.notify_all();
+}
+
+void TradeLogWriter::append(const Trade *trades, size_t count)
+{
+    if (!file)
+        return;
+    written += (long long)count;
+    while (count > 0)
+    {
+        std::vector<Trade> &chunk = chunks[active];
+        size_t n = std::min(count, chunk_records - chunk.size());
+        chunk.insert(chunk.end(), trades, trades + n);
+        trades += n;
+        count -= n;
+        if (chunk.size() == chunk_records)
+            hand_off();
+    }
+}
+
+bool TradeLogWriter::flush()
+{
+    if (!file)
+        return false;
+    if (!chunks[active].empty())
+        hand_off();
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return !pending; });
+    failed = failed || std::fflush(file) != 0;
+    return !failed;
+}
+
+bool TradeLogWriter::close()
+{
+    if (!file)
+        return false;
+    if (!chunks[active].empty())
+        hand_off();
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this] { return !pending; });
+        stopping = true;
+        cv.notify_all();
+    }
+    io.join();
+    bool ok = !failed && std::fclose(file) == 0;
+    file = nullptr;
+    return ok;
+}
+
+bool read_trade_log(const std::string &filename, std::vector<Trade> &trades, TradeLogHeader *header)
+{
+    std::FILE *f = std::fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    TradeLogHeader h;
+    bool ok = std::fread(&h, sizeof(h), 1, f) == 1 && std::memcmp(h.magic, "TSTRADE1", 8) == 0 &&
+              h.record_size == sizeof(Trade);
+    trades.clear();
+    if (ok)
+    {
+        std::fseek(f, 0, SEEK_END);
+        long end = std::ftell(f);
+        size_t n = (size_t)(end - (long)sizeof(h)) / sizeof(Trade);
+        std::fseek(f, (long)sizeof(h), SEEK_SET);
+        trades.resize(n);
+        ok = std::fread(trades.data(), sizeof(Trade), n, f) == n;
+    }
+    std::fclose(f);
+    if (ok && header)
+        *header = h;
+    return ok;
+}
+
+void write_trades_csv(std::ostream &out, const Trade *trades, size_t count)
+{
+    out << "Timestamp,Instrument,Price,Volume,BuyAgent,SellAgent\n";
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Trade &t = trades[i];
+        out << t.timestamp << "," << t.instrument_id << "," << t.price << "," << t.volume
+            << "," << t.buy_agent_id << "," << t.sell_agent_id << "\n";
+    }
+}
@@ -1,5 +1,40 @@
 #include "utils.h"
+#include <mpi.h>
+#include <climits>
 #include <iostream>
+#include <thread>
+
+double tsc_cycles_per_ns()
+{
+    // Function-local static: calibrated once, thread-safe initialization
+    static const double cycles_per_ns = []() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t c0 = read_tsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t c1 = read_tsc();
+        double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        return ns > 0.0 ? (double)(c1 - c0) / ns : 1.0;
+#else
+        return 1.0;
+#endif
+    }();
+    return cycles_per_ns;
+}
+
+int mpi_count(size_t n, const char *what)
+{
+    if (n > (size_t)INT_MAX)
+    {
+        int rank = 0;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        std::cerr << "Rank " << rank << ": " << what << " of " << n
+                  << " exceeds the MPI count limit" << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return (int)n;
+}
 
 namespace Logger
 {
@@ -1,20 +1,1892 @@
-// Minimal MPI test harness to validate build on Windows
+// Correctness test suite for the trading simulator
 #include <mpi.h>
+#include <omp.h>
+#include <set>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include "exchange.h"
+#include "affinity.h"
+#include "statistics.h"
+#include "agent.h"
+#include "agent_engine.h"
+#include "rng.h"
+#include "instrumentation.h"
+#include "marketdata.h"
+#include "router.h"
+#include "balancer.h"
+#include "trade_log.h"
+#include "replay.h"
+#include "checkpoint.h"
+#include "comm_thread.h"
+#include "config.h"
+#include "continuous.h"
+#include "counting_allocator.h"
+
+static int tests_passed = 0;
+static int tests_failed = 0;
+static int world_rank = 0;
+
+static void report(const std::string &name, bool ok)
+{
+    if (ok)
+        tests_passed++;
+    else
+        tests_failed++;
+    if (world_rank == 0)
+        std::cout << (ok ? "[PASS] " : "[FAIL] ") << name << "\n";
+}
+
+static Order make_order(int agent_id, double price, int volume, bool is_buy, int timestamp)
+{
+    Order o;
+    o.agent_id = agent_id;
+    o.instrument_id = 0;
+    o.price = price;
+    o.volume = volume;
+    o.is_buy = is_buy;
+    o.timestamp = timestamp;
+    return o;
+}
+
+// ---------------- Matching engine -----------------
+
+static bool test_order_matching_exact()
+{
+    OrderBook ob;
+    ob.add_order(make_order(1, 100.0, 5, true, 0));
+    ob.add_order(make_order(2, 100.0, 5, false, 0));
+    std::vector<Trade> trades = ob.match_orders(0);
+    return trades.size() == 1 && trades[0].volume == 5 && trades[0].price == 100.0 &&
+           trades[0].buy_agent_id == 1 && trades[0].sell_agent_id == 2 &&
+           ob.bid_depth() == 0 && ob.ask_depth() == 0;
+}
+
+static bool test_order_matching_no_match()
+{
+    OrderBook ob;
+    ob.add_order(make_order(1, 99.0, 5, true, 0));
+    ob.add_order(make_order(2, 101.0, 5, false, 0));
+    std::vector<Trade> trades = ob.match_orders(0);
+    double bid = 0.0, ask = 0.0;
+    return trades.empty() && ob.get_best_bid(bid) && ob.get_best_ask(ask) &&
+           bid == 99.0 && ask == 101.0 && ob.get_last_price() == 100.0;
+}
+
+static bool test_partial_fill()
+{
+    OrderBook ob;
+    ob.add_order(make_order(1, 100.0, 10, true, 0));
+    ob.add_order(make_order(2, 100.0, 4, false, 0));
+    std::vector<Trade> trades = ob.match_orders(0);
+    return trades.size() == 1 && trades[0].volume == 4 &&
+           ob.bid_depth() == 1 && ob.ask_depth() == 0;
+}
+
+static bool test_price_time_priority()
+{
+    OrderBook ob;
+    ob.add_order(make_order(1, 100.0, 5, true, 0)); // same price, earlier
+    ob.add_order(make_order(2, 101.0, 5, true, 1)); // best price
+    ob.add_order(make_order(3, 100.0, 5, true, 2)); // same price, later
+    ob.add_order(make_order(9, 99.0, 12, false, 3));
+    std::vector<Trade> trades = ob.match_orders(3);
+    return trades.size() == 3 && trades[0].buy_agent_id == 2 &&
+           trades[1].buy_agent_id == 1 && trades[2].buy_agent_id == 3 &&
+           trades[2].volume == 2 && ob.bid_depth() == 1 && ob.bid_levels() == 1;
+}
+
+static bool test_resting_orders_persist()
+{
+    // Orders left unmatched one tick must still be matchable on a later tick
+    OrderBook ob;
+    ob.add_order(make_order(1, 100.0, 5, true, 0));
+    bool first_empty = ob.match_orders(0).empty();
+    ob.add_order(make_order(2, 99.5, 5, false, 1));
+    std::vector<Trade> trades = ob.match_orders(1);
+    return first_empty && trades.size() == 1 && trades[0].price == (100.0 + 99.5) * 0.5 &&
+           ob.get_last_price() == trades[0].price;
+}
+
+// ---------------- Tick prices -----------------
+
+static bool test_tick_snapping()
+{
+    // With a 0.05 tick a bid never rounds up and an ask never rounds down
+    OrderBook ob(0.05);
+    ob.add_order(make_order(1, 100.03, 5, true, 0));  // -> 100.00
+    ob.add_order(make_order(2, 100.01, 5, false, 0)); // -> 100.05
+    double bid = 0.0, ask = 0.0;
+    bool snapped = ob.get_best_bid(bid) && ob.get_best_ask(ask) &&
+                   ob.price_to_ticks(bid, true) == 2000 && ob.price_to_ticks(ask, false) == 2001;
+    return snapped && ob.match_orders(0).empty() && ob.bid_levels() == 1 && ob.ask_levels() == 1;
+}
+
+static bool test_ladder_growth()
+{
+    // Prices far outside the initial window around the mid must still be booked
+    OrderBook ob;
+    ob.add_order(make_order(1, 40.0, 1, true, 0));
+    ob.add_order(make_order(2, 250.0, 1, false, 0));
+    ob.add_order(make_order(3, 99.0, 1, true, 0));
+    double bid = 0.0, ask = 0.0;
+    bool booked = ob.get_best_bid(bid) && ob.get_best_ask(ask) && bid == 99.0 && ask == 250.0;
+    ob.add_order(make_order(4, 30.0, 2, false, 1));
+    std::vector<Trade> trades = ob.match_orders(1);
+    return booked && trades.size() == 2 && trades[0].buy_agent_id == 3 &&
+           trades[1].buy_agent_id == 1 && ob.bid_depth() == 0 && ob.ask_levels() == 1;
+}
+
+static bool test_set_tick_size()
+{
+    Exchange ex(0, 2);
+    bool ok = ex.set_tick_size(1, 0.25);
+    OrderBook ob;
+    ob.add_order(make_order(1, 100.0, 1, true, 0));
+    return ok && !ob.set_tick_size(0.5) && !ex.set_tick_size(5, 0.1) && !ex.set_tick_size(0, 0.0);
+}
+
+static bool test_historical_average()
+{
+    OrderBook ob;
+    ob.add_order(make_order(1, 102.0, 1, true, 0));
+    ob.add_order(make_order(2, 102.0, 1, false, 0));
+    ob.match_orders(0);
+    // price history is {100 (initial), 102}
+    return ob.get_historical_average() == 101.0;
+}
+
+static Order with_id(Order o, long long order_id)
+{
+    o.order_id = order_id;
+    return o;
+}
+
+static bool test_outlier_price()
+{
+    // A price far beyond the ladder's span, or one that is not finite, is
+    // rejected without disturbing the book or growing the window
+    OrderBook ob;
+    ob.add_order(with_id(make_order(1, 100.0, 5, true, 0), 1));
+    ob.add_order(with_id(make_order(2, 101.0, 5, false, 0), 2));
+    size_t before = ob.capacity_bytes();
+    bool rejected = !ob.add_order(make_order(3, 1e7, 5, false, 0)) &&
+                    !ob.add_order(make_order(4, -1e7, 5, true, 0)) &&
+                    !ob.add_order(make_order(5, NAN, 5, false, 0)) &&
+                    !ob.add_order(make_order(6, INFINITY, 5, true, 0)) &&
+                    !ob.add_order(make_order(7, 1e300, 5, false, 0));
+    bool kept = !ob.apply(make_replace(0, 1, NAN, 5, 1)) && !ob.apply(make_replace(0, 1, 1e7, 5, 1)) &&
+                ob.get_order_volume(1) == 5 && ob.bid_depth() == 1 && ob.ask_depth() == 1;
+    ob.apply(make_replace(0, 2, 100.0, 5, 1));
+    std::vector<Trade> trades = ob.match_orders(1);
+    return rejected && kept && ob.capacity_bytes() == before && trades.size() == 1 &&
+           trades[0].buy_agent_id == 1 && trades[0].sell_agent_id == 2;
+}
+
+static bool test_ladder_recentre()
+{
+    // A book whose price drifts far beyond the ladder's span keeps trading:
+    // each side's window moves to the new price once the side is empty
+    OrderBook ob;
+    bool ok = true;
+    for (int step = 0; step < 5; ++step)
+    {
+        double px = 100.0 + 6000.0 * step; // 600000 ticks per step
+        ok = ok && ob.add_order(make_order(1, px, 2, true, step)) &&
+             ob.add_order(make_order(2, px, 2, false, step));
+        std::vector<Trade> trades = ob.match_orders(step);
+        ok = ok && trades.size() == 1 && trades[0].price == px && ob.bid_depth() == 0 && ob.ask_depth() == 0;
+    }
+    // A resting order still pins its side's window
+    ok = ok && ob.add_order(make_order(3, 24100.0, 1, true, 5)) && !ob.add_order(make_order(4, 100.0, 1, true, 5)) &&
+         ob.add_order(make_order(5, 100.0, 1, false, 5));
+    return ok && ob.match_orders(5).size() == 1 && ob.get_last_price() > 10000.0;
+}
+
+static bool test_cancel_replace()
+{
+    OrderBook ob;
+    ob.add_order(with_id(make_order(1, 100.0, 5, true, 0), 11));
+    ob.add_order(with_id(make_order(2, 100.0, 5, true, 0), 12));
+    ob.add_order(with_id(make_order(3, 100.0, 5, true, 0), 13));
+    ob.add_order(with_id(make_order(4, 99.0, 5, true, 0), 14));
+    bool ok = ob.cancel_order(12) && !ob.cancel_order(12) && !ob.cancel_order(99) && ob.bid_depth() == 3 &&
+              ob.get_order_volume(12) == 0;
+
+    // Sizing down keeps priority, sizing up requeues behind it
+    ok = ok && ob.replace_order(13, 100.0, 3, 1) && ob.replace_order(11, 100.0, 8, 1);
+    ob.add_order(with_id(make_order(9, 100.0, 4, false, 2), 21));
+    std::vector<Trade> trades = ob.match_orders(2);
+    ok = ok && trades.size() == 2 && trades[0].buy_agent_id == 3 && trades[0].volume == 3 &&
+         trades[1].buy_agent_id == 1 && trades[1].volume == 1 && ob.get_order_volume(11) == 7;
+
+    // Cancelling the last order of the best level moves best down
+    double bid = 0.0;
+    ok = ok && ob.cancel_order(11) && ob.get_best_bid(bid) && bid == 99.0 && ob.bid_levels() == 1 &&
+         ob.get_cancelled_count() == 2;
+    // A new price can cross
+    ob.add_order(with_id(make_order(5, 101.0, 2, false, 3), 22));
+    ok = ok && ob.replace_order(14, 101.0, 2, 3) && ob.match_orders(3).size() == 1 && ob.bid_depth() == 0 &&
+         ob.ask_depth() == 0 && !ob.replace_order(14, 100.0, 1, 4);
+
+    // Cancel every other order across 50 levels; matching skips the gaps
+    // and fills unindex the orders they complete
+    OrderBook churn;
+    for (int k = 1; k <= 5000; ++k)
+        churn.add_order(with_id(make_order(k, 90.0 + (k % 50) * 0.01, 1, true, 0), k));
+    for (int k = 1; k <= 5000; k += 2)
+        ok = ok && churn.cancel_order(k);
+    ok = ok && churn.bid_depth() == 2500 && churn.get_order_volume(2) == 1 && churn.get_order_volume(3) == 0;
+    churn.add_order(with_id(make_order(0, 80.0, 3000, false, 1), 9999));
+    trades = churn.match_orders(1);
+    int buyers_even = 0;
+    for (const auto &t : trades)
+        buyers_even += t.buy_agent_id % 2 == 0;
+    return ok && trades.size() == 2500 && buyers_even == 2500 && churn.bid_depth() == 0 &&
+           churn.get_order_volume(5000) == 0 && churn.get_order_volume(9999) == 500;
+}
+
+static bool test_order_info_reuse()
+{
+    // Fills hand their OrderInfo slots to the next orders; trades and
+    // lookups must see the new owner, never what the slot held before
+    OrderBook ob;
+    ob.add_order(with_id(make_order(1, 100.0, 5, true, 0), 101));
+    ob.add_order(with_id(make_order(2, 100.0, 5, false, 0), 102));
+    bool ok = ob.match_orders(0).size() == 1 && ob.get_order_volume(101) == 0 && !ob.cancel_order(102);
+
+    ob.add_order(with_id(make_order(3, 100.0, 4, true, 1), 103));
+    ob.add_order(with_id(make_order(4, 99.0, 6, true, 1), 104));
+    // Both freed slots are in use again, by the new orders
+    ok = ok && ob.get_order_info(0).order_id + ob.get_order_info(1).order_id == 103 + 104 &&
+         ob.get_order_info(0).agent_id + ob.get_order_info(1).agent_id == 3 + 4;
+    ob.add_order(with_id(make_order(5, 99.0, 7, false, 1), 105));
+    std::vector<Trade> trades = ob.match_orders(1);
+    ok = ok && trades.size() == 2 && trades[0].buy_agent_id == 3 && trades[0].sell_agent_id == 5 &&
+         trades[1].buy_agent_id == 4 && trades[1].sell_agent_id == 5 && trades[1].volume == 3;
+
+    // A partly filled order keeps its slot while new orders take freed ones
+    ob.add_order(with_id(make_order(6, 99.0, 1, false, 2), 106));
+    trades = ob.match_orders(2);
+    return ok && trades.size() == 1 && trades[0].buy_agent_id == 4 && trades[0].sell_agent_id == 6 &&
+           ob.get_order_volume(104) == 2 && ob.get_order_volume(106) == 0 && ob.cancel_order(104) &&
+           ob.bid_depth() == 0 && ob.ask_depth() == 0;
+}
+
+static bool test_order_slab_reuse()
+{
+    // Fill and drain the same book repeatedly: chunks freed by fills and
+    // cancels are reused, so storage stops growing after the first round
+    OrderBook ob;
+    size_t capacity = 0;
+    bool ok = true;
+    for (int round = 0; round < 4; ++round)
+    {
+        for (int k = 0; k < 4000; ++k)
+            ob.add_order(with_id(make_order(k, 99.0 + (k % 40) * 0.01, 1, true, round), round * 4000 + k + 1));
+        for (int k = 0; k < 4000; k += 3)
+            ok = ok && ob.cancel_order(round * 4000 + k + 1);
+        ob.add_order(make_order(9, 90.0, 4000, false, round));
+        ob.match_orders(round);
+        ok = ok && ob.bid_depth() == 0 && ob.ask_depth() == 1;
+        ob.cancel_order(0); // unindexed, so the ask stays
+        if (round == 0)
+            capacity = ob.capacity_bytes();
+        ok = ok && ob.capacity_bytes() == capacity;
+        ob.reset(DEFAULT_TICK_SIZE); // bulk release between runs
+    }
+    // A copy owns its storage and matches like the original
+    ob.add_order(make_order(1, 100.0, 5, true, 0));
+    OrderBook copy = ob;
+    ob.add_order(make_order(2, 100.0, 5, false, 0));
+    copy.add_order(make_order(3, 100.0, 2, false, 0));
+    std::vector<Trade> a = ob.match_orders(0), b = copy.match_orders(0);
+    return ok && capacity > 0 && a.size() == 1 && a[0].volume == 5 && b.size() == 1 && b[0].volume == 2 &&
+           copy.bid_depth() == 1 && ob.bid_depth() == 0;
+}
+
+static bool test_time_in_force()
+{
+    // IOC: what the match leaves is cancelled
+    OrderBook ob;
+    ob.add_order(with_id(make_order(1, 100.0, 3, false, 0), 1));
+    Order ioc = with_id(make_order(2, 100.0, 5, true, 0), 2);
+    ioc.time_in_force = TimeInForce::IOC;
+    ob.add_order(ioc);
+    std::vector<Trade> trades = ob.match_orders(0);
+    bool ok = trades.size() == 1 && trades[0].volume == 3 && ob.bid_depth() == 0 && ob.get_cancelled_count() == 1;
+
+    // GTD: rests through expire_tick; one already past it never rests
+    Order gtd = with_id(make_order(3, 99.0, 5, true, 0), 3);
+    gtd.time_in_force = TimeInForce::GTD;
+    gtd.expire_tick = 2;
+    ob.add_order(gtd);
+    ok = ok && ob.expire_orders(1) == 0 && ob.expire_orders(2) == 0 && ob.bid_depth() == 1 &&
+         ob.expire_orders(3) == 1 && ob.bid_depth() == 0;
+    gtd.order_id = 4;
+    gtd.expire_tick = 1;
+    ob.add_order(gtd);
+    ok = ok && ob.bid_depth() == 0 && ob.get_expired_count() == 2;
+
+    // Expiries a wheel turn apart share a slot; a gap sweeps the wheel
+    gtd.order_id = 5;
+    gtd.expire_tick = 3 + EXPIRY_WHEEL_SLOTS;
+    ob.add_order(gtd);
+    gtd.order_id = 6;
+    gtd.expire_tick = 3;
+    ob.add_order(gtd);
+    ok = ok && ob.expire_orders(4) == 1 && ob.get_order_volume(5) == 5;
+    std::vector<char> buf;
+    ByteWriter w(buf);
+    ob.serialize(w);
+    OrderBook copy;
+    ByteReader r(buf.data(), buf.size());
+    ok = ok && copy.deserialize(r) && copy.expire_orders(4 + EXPIRY_WHEEL_SLOTS) == 1 && copy.bid_depth() == 0 &&
+         ob.get_order_volume(5) == 5 && ob.cancel_order(5);
+
+    // Through the exchange, in batch and continuous mode alike: messages
+    // act in booking order and idle books still expire
+    for (int matchers = 0; matchers <= 1; ++matchers)
+    {
+        Exchange ex(world_rank, 1, DEFAULT_TICK_SIZE, 1);
+        std::unique_ptr<ContinuousEngine> engine;
+        if (matchers > 0)
+            engine.reset(new ContinuousEngine(ex, matchers));
+        Order g = make_order(1, 99.0, 5, true, 0);
+        g.time_in_force = TimeInForce::GTD;
+        g.expire_tick = 1;
+        ex.submit_order(g, 0);
+        long long b = ex.submit_order(make_order(2, 98.0, 5, true, 0), 0);
+        long long c = ex.submit_order(make_order(3, 97.0, 5, true, 0), 0);
+        ex.submit_order(make_cancel(0, b, 0), 0);
+        ex.process_orders(0);
+        const OrderBook &book = ex.get_order_book(0);
+        ok = ok && book.bid_depth() == 2 && book.get_order_volume(b) == 0 &&
+             ex.submit_order(make_cancel(0, 0, 0), 0) == 0;
+        ex.submit_order(make_replace(0, c, 101.0, 5, 1), 0);
+        ex.submit_order(make_order(4, 101.0, 5, false, 1), 0);
+        ex.process_orders(1);
+        ok = ok && ex.get_trade_log().size() == 1 && ex.get_trade_log()[0].buy_agent_id == 3 &&
+             book.bid_depth() == 1;
+        ex.process_orders(2);
+        MarketSnapshot s;
+        ok = ok && book.bid_depth() == 0 && ex.total_expired_orders() == 1 && ex.read_snapshot(0, s) &&
+             s.bid_orders == 0;
+    }
+    return ok;
+}
+
+// ---------------- Order submission -----------------
+
+// Every thread submits a crossing ladder of orders into its own lane
+static std::vector<long long> submit_from_threads(Exchange &ex, int threads, int per_thread)
+{
+    std::vector<long long> ids(threads * per_thread);
+#pragma omp parallel num_threads(threads)
+    {
+        int t = omp_get_thread_num();
+        for (int i = 0; i < per_thread; ++i)
+        {
+            Order o = make_order(t, 99.0 + (i % 5) * 0.5, 1 + i % 3, (t + i) % 2 == 0, 0);
+            o.instrument_id = i % 2;
+            ids[t * per_thread + i] = ex.submit_order(o);
+        }
+    }
+    return ids;
+}
+
+static bool test_thread_safety()
+{
+    const int threads = 4, per_thread = 5000;
+    Exchange ex(0, 2, DEFAULT_TICK_SIZE, threads);
+    std::vector<long long> ids = submit_from_threads(ex, threads, per_thread);
+    std::set<long long> unique(ids.begin(), ids.end());
+    ex.process_orders(0);
+    return unique.size() == ids.size() && *unique.begin() > 0 && !ex.get_trade_log().empty();
+}
+
+static bool test_lane_bounds()
+{
+    // A lane the exchange was not sized for is rejected like a bad
+    // instrument, including an OpenMP team wider than the lane count
+    Exchange ex(0, 1, DEFAULT_TICK_SIZE, 2);
+    bool rejected = ex.submit_order(make_order(1, 100.0, 5, true, 0), -1) == 0 &&
+                    ex.submit_order(make_order(1, 100.0, 5, true, 0), 2) == 0;
+    int accepted = 0, team = 1;
+#pragma omp parallel num_threads(4) reduction(+ : accepted)
+    {
+#pragma omp single
+        team = omp_get_num_threads();
+        accepted += ex.submit_order(make_order(omp_get_thread_num(), 100.0, 1, false, 0)) != 0;
+    }
+    bool in_range = ex.submit_order(make_order(9, 100.0, 5, true, 0), 1) != 0;
+    ex.process_orders(0);
+    return rejected && in_range && accepted == std::min(team, 2) &&
+           ex.get_instrument_trades(0).size() == (size_t)accepted;
+}
+
+static bool same_trades(const std::vector<Trade> &ta, const std::vector<Trade> &tb)
+{
+    if (ta.size() != tb.size())
+        return false;
+    for (size_t i = 0; i < ta.size(); ++i)
+    {
+        if (ta[i].buy_agent_id != tb[i].buy_agent_id || ta[i].sell_agent_id != tb[i].sell_agent_id ||
+            ta[i].instrument_id != tb[i].instrument_id || ta[i].price != tb[i].price ||
+            ta[i].volume != tb[i].volume || ta[i].timestamp != tb[i].timestamp)
+            return false;
+    }
+    return true;
+}
+
+static bool test_deterministic_submission()
+{
+    // Same submissions must give the same IDs and trades whatever the timing
+    const int threads = 4, per_thread = 3000;
+    Exchange a(0, 2, DEFAULT_TICK_SIZE, threads);
+    Exchange b(0, 2, DEFAULT_TICK_SIZE, threads);
+    bool same_ids = submit_from_threads(a, threads, per_thread) ==
+                    submit_from_threads(b, threads, per_thread);
+    a.process_orders(0);
+    b.process_orders(0);
+    return same_ids && same_trades(a.get_trade_log(), b.get_trade_log());
+}
+
+static bool test_parallel_matching()
+{
+    // Matching instruments on one thread or many must give the same trade log
+    const int threads = 4, per_thread = 2000, instruments = 2;
+    Exchange a(0, instruments, DEFAULT_TICK_SIZE, threads);
+    Exchange b(0, instruments, DEFAULT_TICK_SIZE, threads);
+    int saved = omp_get_max_threads();
+    for (int tick = 0; tick < 3; ++tick)
+    {
+        submit_from_threads(a, threads, per_thread);
+        submit_from_threads(b, threads, per_thread);
+        omp_set_num_threads(1);
+        a.process_orders(tick);
+        omp_set_num_threads(threads);
+        b.process_orders(tick);
+    }
+    omp_set_num_threads(saved);
+    return !a.get_trade_log().empty() && same_trades(a.get_trade_log(), b.get_trade_log());
+}
+
+// ---------------- Agent pool -----------------
+
+static std::vector<Trade> run_pool(int threads, int ticks, std::vector<int> &positions)
+{
+    int saved = omp_get_max_threads();
+    omp_set_num_threads(threads);
+    Exchange ex(0, 3, DEFAULT_TICK_SIZE, threads);
+    AgentPool pool(0, 40, 3, threads);
+    for (int tick = 0; tick < ticks; ++tick)
+    {
+        pool.generate_orders(ex, tick);
+        ex.process_orders(tick);
+        pool.apply_fills(ex);
+    }
+    omp_set_num_threads(saved);
+    positions.clear();
+    for (size_t i = 0; i < pool.size(); ++i)
+        positions.push_back(pool[i].get_position());
+    return ex.get_trade_log();
+}
+
+static bool test_agent_pool_persistent()
+{
+    // Positions carry over between ticks and every fill has both sides in the pool
+    std::vector<int> positions;
+    std::vector<Trade> trades = run_pool(2, 50, positions);
+    long long net = 0, gross = 0;
+    for (int p : positions)
+    {
+        net += p;
+        gross += p < 0 ? -p : p;
+    }
+    return !trades.empty() && net == 0 && gross > 0;
+}
+
+static bool test_agent_pool_thread_count()
+{
+    // The static split keeps book arrival order in agent order for any team size
+    std::vector<int> pos1, pos4;
+    std::vector<Trade> t1 = run_pool(1, 30, pos1);
+    std::vector<Trade> t4 = run_pool(4, 30, pos4);
+    return same_trades(t1, t4) && pos1 == pos4;
+}
+
+// ---------------- Agent engine -----------------
+
+static bool test_philox_known_answer()
+{
+    // Known-answer vectors for Philox4x32-10 from the Random123 distribution
+    Philox::Block zero = Philox::generate(0, 0, 0, 0, 0, 0);
+    Philox::Block ones = Philox::generate(0xffffffffu, 0xffffffffu,
+                                          0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu);
+    return zero.v[0] == 0x6627e8d5u && zero.v[1] == 0xe169c58du &&
+           zero.v[2] == 0xbc57ac4cu && zero.v[3] == 0x9b00dbd8u &&
+           ones.v[0] == 0x408f276du && ones.v[1] == 0x41c83b0eu &&
+           ones.v[2] == 0xa20bc7c6u && ones.v[3] == 0x6d5451fdu;
+}
+
+static std::vector<Trade> run_engine(int threads, int agents, int ticks, std::vector<int> &positions,
+                                     bool place_books = false)
+{
+    int saved = omp_get_max_threads();
+    omp_set_num_threads(threads);
+    Exchange ex(0, 3, DEFAULT_TICK_SIZE, threads);
+    AgentEngine engine(0, agents, 3);
+    if (place_books)
+        ex.place_books(engine.home_threads(threads));
+    for (int tick = 0; tick < ticks; ++tick)
+    {
+        engine.generate_orders(ex, tick);
+        ex.process_orders(tick);
+        engine.apply_fills(ex);
+    }
+    omp_set_num_threads(saved);
+    positions.clear();
+    for (int i = 0; i < agents; ++i)
+        positions.push_back(engine.get_position(i));
+    return ex.get_trade_log();
+}
+
+static bool test_agent_engine_layout()
+{
+    // 12 agents over 3 instruments: one segment per (strategy, instrument)
+    AgentEngine engine(1, 12, 3);
+    const std::vector<AgentSegment> &segs = engine.get_segments();
+    bool contiguous = segs.size() == 12 && segs.front().begin == 0 && segs.back().end == 12;
+    for (size_t i = 1; i < segs.size(); ++i)
+        contiguous = contiguous && segs[i].begin == segs[i - 1].end;
+    return contiguous && segs[0].strategy == AgentStrategy::RANDOM_WALK &&
+           segs.back().strategy == AgentStrategy::MARKET_MAKER;
+}
+
+static bool test_agent_engine_thread_count()
+{
+    // Spans several kernel blocks so threads really split the population
+    std::vector<int> pos1, pos3;
+    std::vector<Trade> t1 = run_engine(1, 5000, 20, pos1);
+    std::vector<Trade> t3 = run_engine(3, 5000, 20, pos3);
+    long long net = 0;
+    for (int p : pos1)
+        net += p;
+    return !t1.empty() && same_trades(t1, t3) && pos1 == pos3 && net == 0;
+}
+
+// Market maker variant quoting two percent either side
+struct WideQuotes : MarketMakerParams {
+    static constexpr double BID_PRICE = 0.98;
+    static constexpr double ASK_PRICE = 1.02;
+};
+
+static bool test_strategy_registry()
+{
+    // Config names resolve to the built-in kernels
+    const StrategyInfo *maker = find_strategy("market_maker");
+    bool registry = maker && maker->id == AgentStrategy::MARKET_MAKER && maker->two_sided &&
+                    !find_strategy("market") && default_strategy(AgentStrategy::MOMENTUM).run == &Momentum<>::run;
+
+    // A parameter variant replaces one strategy's kernel for one engine
+    AgentEngine engine(0, std::vector<int>({0, 0, 0, 4}), 1);
+    engine.set_strategy_kernel(make_strategy<MarketMaker<WideQuotes>>("wide_maker"));
+    Exchange ex(0, 1);
+    long long orders = engine.generate_orders(ex, 0);
+    ex.process_orders(0);
+    double bid = 0.0, ask = 0.0;
+    bool quoted = ex.get_order_book(0).get_best_bid(bid) && ex.get_order_book(0).get_best_ask(ask);
+    bool wide = orders == 8 && quoted && std::fabs(bid - 98.0) < 1e-6 && std::fabs(ask - 102.0) < 1e-6 &&
+                std::string(engine.get_strategy_kernel(AgentStrategy::MARKET_MAKER).name) == "wide_maker";
+
+    // Rebuilding restores the defaults
+    engine.rebuild(0, std::vector<int>({0, 0, 0, 4}), 1);
+    return registry && wide && engine.get_strategy_kernel(AgentStrategy::MARKET_MAKER).run == maker->run;
+}
+
+static bool test_thread_placement()
+{
+    // Two ranks sharing an unbound 2-node machine split it along the nodes
+    CpuTopology topo;
+    topo.cpus = {0, 1, 2, 3, 4, 5, 6, 7};
+    topo.node_of = {0, 0, 0, 0, 1, 1, 1, 1};
+    topo.num_nodes = 2;
+    topo.online_cpus = 8;
+    ThreadPlacement second = plan_placement(topo, 2, 1, 2);
+    ThreadPlacement wrapped = plan_placement(topo, 3, 0, 4); // two CPUs, three threads
+    bool planned = second.cpu_of_thread == std::vector<int>({4, 6}) &&
+                   second.node_of_thread == std::vector<int>({1, 1}) &&
+                   wrapped.cpu_of_thread == std::vector<int>({0, 1, 0});
+
+    // 6000 agents are six kernel blocks, two per thread: each instrument's
+    // 2000 slots sit mostly in one thread's blocks
+    AgentEngine engine(0, 6000, 3);
+    bool homes = engine.home_threads(3) == std::vector<int>({0, 1, 2}) &&
+                 engine.home_threads(1) == std::vector<int>({0, 0, 0});
+
+    // Home-first matching books the same orders in the same order
+    std::vector<int> pos_dynamic, pos_placed;
+    std::vector<Trade> dynamic = run_engine(3, 6000, 10, pos_dynamic);
+    std::vector<Trade> placed = run_engine(3, 6000, 10, pos_placed, true);
+    return planned && homes && !dynamic.empty() && same_trades(dynamic, placed) && pos_dynamic == pos_placed;
+}
+
+static bool test_allocation_free_tick()
+{
+    const int threads = 2;
+    int saved = omp_get_max_threads();
+    omp_set_num_threads(threads);
+
+    // Order generation: lanes and kernel scratch keep their capacity
+    Exchange gen_ex(0, 3, DEFAULT_TICK_SIZE, threads);
+    AgentEngine engine(0, 3000, 3);
+    for (int tick = 0; tick < 20; ++tick)
+    {
+        engine.generate_orders(gen_ex, tick);
+        gen_ex.process_orders(tick);
+    }
+    long long gen_allocs = 0;
+    for (int tick = 20; tick < 40; ++tick)
+    {
+        long long start = allocation_count;
+        engine.generate_orders(gen_ex, tick);
+        gen_allocs += allocation_count - start;
+        gen_ex.process_orders(tick); // not counted: this flow grows the resting book
+    }
+
+    // Matching and market data: a flow that fully crosses every tick, so the
+    // resting book stays the same size and every buffer is reused
+    Exchange ex(0, 3, DEFAULT_TICK_SIZE, threads);
+    std::vector<double> prices;
+    long long match_allocs = 0;
+    ex.reserve_history(20000);
+    for (int tick = 0; tick < 80; ++tick)
+    {
+        long long start = allocation_count;
+#pragma omp parallel num_threads(threads)
+        {
+            int t = omp_get_thread_num();
+            for (int i = 0; i < 50; ++i)
+            {
+                Order o = make_order(t, 100.0, 1 + i % 3, t == 0, tick);
+                o.instrument_id = i % 3;
+                ex.submit_order(o);
+            }
+        }
+        ex.process_orders(tick);
+        ex.get_all_prices(prices);
+        if (tick >= 40)
+            match_allocs += allocation_count - start;
+    }
+    omp_set_num_threads(saved);
+    if (world_rank == 0 && (gen_allocs != 0 || match_allocs != 0))
+        std::cout << "       allocations: generation " << gen_allocs << ", matching " << match_allocs << "\n";
+    return gen_allocs == 0 && match_allocs == 0 && !ex.get_trade_log().empty();
+}
+
+// ---------------- Statistics -----------------
+
+static bool close_to(double a, double b)
+{
+    return std::fabs(a - b) < 1e-9;
+}
+
+static bool test_rolling_statistics()
+{
+    PriceStatistics st(100.0, 3, 0.5);
+    st.add_trade(102.0, 1);
+    st.add_trade(104.0, 3);
+    st.add_trade(106.0, 1);
+    // prices {100, 102, 104, 106}: window of 3 holds {102, 104, 106}
+    return close_to(st.mean(), 103.0) && close_to(st.sma(), 104.0) &&
+           close_to(st.ewma(), 104.25) && close_to(st.vwap(), (102.0 + 3 * 104.0 + 106.0) / 5) &&
+           close_to(st.variance(), 5.0) && st.volatility() > 0.0 &&
+           st.get(PriceStatistic::SMA) == st.sma() && st.volume() == 5;
+}
+
+static bool test_sma_long_run()
+{
+    // The windowed sum is resummed periodically and must not drift
+    PriceStatistics st(100.0, 16);
+    for (int i = 0; i < 100000; ++i)
+        st.add_trade(100.0 + 0.1 * (i % 7), 1);
+    double expected = 0.0;
+    for (int i = 100000 - 16; i < 100000; ++i)
+        expected += 100.0 + 0.1 * (i % 7);
+    return std::fabs(st.sma() - expected / 16) < 1e-9;
+}
+
+static bool test_async_price_exchange()
+{
+    // With staleness 2 the prices posted at tick t come back at tick t + 2,
+    // averaged over ranks exactly as the blocking path does
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MarketDataManager md(world_rank, size);
+    md.set_staleness(2);
+    std::vector<double> local(3), global, expected;
+    for (int tick = 0; tick < 6; ++tick)
+    {
+        for (int i = 0; i < 3; ++i)
+            local[i] = 100.0 + tick + i;
+        bool ready = md.exchange_prices(local, global);
+        if (ready != (tick >= 2))
+            return false;
+        if (ready && std::fabs(global[0] - (100.0 + tick - 2)) > 1e-9)
+            return false;
+    }
+    // Two reductions remain; drain leaves the newest (tick 5)
+    if (!md.drain(global) || std::fabs(global[2] - 107.0) > 1e-9 || md.drain(global))
+        return false;
+
+    MarketDataManager blocking(world_rank, size);
+    blocking.broadcast_prices(local, expected);
+    return blocking.get_staleness() == 0 && expected == global;
+}
+
+static int mpi_thread_level = MPI_THREAD_SINGLE;
+
+static bool test_comm_thread()
+{
+    // A dedicated thread returns the same staleness-1 averages as the
+    // inline path, one tick later, and runs other collectives on request
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    bool threaded = mpi_thread_level >= MPI_THREAD_SERIALIZED;
+    std::vector<int> volumes;
+    bool ok = true;
+    for (int pass = 0; pass < (threaded ? 2 : 1); ++pass)
+    {
+        const bool dedicated = pass == 1;
+        const int lag = dedicated ? 2 : 1;
+        CommThread comm(world_rank, size, 1, 0, dedicated);
+        std::vector<double> local(3), global;
+        for (int tick = 0; tick < 6; ++tick)
+        {
+            for (int i = 0; i < 3; ++i)
+                local[i] = 100.0 + tick + i + world_rank;
+            bool ready = comm.publish(local, volumes, global);
+            double expected = 100.0 + tick - lag + (size - 1) / 2.0;
+            ok = ok && ready == (tick >= lag) && (!ready || std::fabs(global[0] - expected) < 1e-9);
+        }
+        ok = ok && comm.drain(global) && std::fabs(global[2] - (107.0 + (size - 1) / 2.0)) < 1e-9 &&
+             !comm.drain(global);
+        int one = 1, ranks = 0;
+        comm.call([&] { MPI_Allreduce(&one, &ranks, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD); });
+        comm.synchronize();
+        ok = ok && ranks == size && comm.is_dedicated() == dedicated && comm.get_bytes_sent() == 6 * 3 * 8;
+    }
+    return ok;
+}
+
+static bool test_delta_market_data()
+{
+    // Only changed instruments are sent between snapshots, and the averages
+    // match a full reduction
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MarketDataManager md(world_rank, size);
+    md.set_snapshot_interval(4);
+    const int n = 50;
+    std::vector<double> local(n, 100.0 + world_rank), global, full;
+    std::vector<int> volumes;
+
+    if (md.publish_deltas(local, volumes, global) != n * size) // snapshot
+        return false;
+    local[7] += 1.0;
+    if (md.publish_deltas(local, volumes, global) != size)
+        return false;
+    volumes.assign(n, 0);
+    volumes[9] = 3;
+    if (md.publish_deltas(local, volumes, global) != size || md.get_rank_volume(0, 9) != 3)
+        return false;
+    volumes[9] = 0;
+    if (md.publish_deltas(local, volumes, global) != 0)
+        return false;
+    long long before = md.get_bytes_sent();
+    if (md.publish_deltas(local, volumes, global) != n * size) // periodic snapshot
+        return false;
+    if (md.get_bytes_sent() - before != (long long)(n * sizeof(PriceUpdate)))
+        return false;
+
+    md.broadcast_prices(local, full);
+    for (int i = 0; i < n; ++i)
+        if (std::fabs(global[i] - full[i]) > 1e-9)
+            return false;
+    return md.get_rank_price(0, 7) == 101.0;
+}
+
+static Order order_on(int instrument_id, Order o)
+{
+    o.instrument_id = instrument_id;
+    return o;
+}
+
+static bool test_instrument_sharding()
+{
+    // Orders for an instrument hosted elsewhere are held back from matching
+    // and handed out per owner; routed orders keep their IDs
+    Exchange ex(0, 2, DEFAULT_TICK_SIZE, 1);
+    if (ex.set_instrument_owners({0}) || !ex.set_instrument_owners({0, 1}))
+        return false;
+    ex.submit_order(order_on(1, make_order(1, 100.0, 5, true, 0)), 0);
+    ex.submit_order(order_on(1, make_order(2, 100.0, 5, false, 0)), 0);
+    if (ex.process_orders(0) != 0 || ex.get_order_book(1).bid_depth() != 0)
+        return false;
+    std::vector<std::vector<Order>> per_rank(2);
+    ex.collect_remote_orders(per_rank);
+    if (!per_rank[0].empty() || per_rank[1].size() != 2)
+        return false;
+    if (ex.inject_order(per_rank[1][0]) != 0) // not hosted here
+        return false;
+
+    Order routed = order_on(0, make_order(3, 100.0, 5, true, 0));
+    routed.order_id = 12345;
+    ex.submit_order(order_on(0, make_order(4, 100.0, 5, false, 0)), 0);
+    if (ex.inject_order(routed) != 12345 || ex.process_orders(1) != 1)
+        return false;
+    const Trade &t = ex.get_trade_log().back();
+    return t.buy_agent_id == 3 && t.sell_agent_id == 4;
+}
+
+static bool test_order_routing()
+{
+    // Every rank buys and sells one lot on every instrument; orders travel to
+    // the host and each rank gets back exactly its own agents' fills
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const int instruments = 2 * size;
+    Exchange ex(world_rank, instruments, DEFAULT_TICK_SIZE, 1);
+    ex.set_instrument_owners(OrderRouter::round_robin_owners(instruments, size));
+    OrderRouter router(world_rank, size);
+    const int buyer = world_rank * 10, seller = world_rank * 10 + 1;
+    router.register_agents(world_rank * 10, 10);
+    if (router.home_rank(seller) != world_rank || router.home_rank(size * 10) != -1)
+        return false;
+
+    for (int i = 0; i < instruments; ++i)
+    {
+        ex.submit_order(order_on(i, make_order(buyer, 100.0, 1, true, 0)), 0);
+        ex.submit_order(order_on(i, make_order(seller, 100.0, 1, false, 0)), 0);
+    }
+    int received = router.route_orders(ex);
+    if (received != 2 * (size - 1) * 2) // two hosted instruments per rank
+        return false;
+    int trades = ex.process_orders(0);
+    router.return_fills(ex);
+    router.exchange_quotes(ex);
+
+    int bought = 0, sold = 0;
+    std::vector<Trade> mine(ex.get_trade_log());
+    mine.insert(mine.end(), router.get_remote_fills().begin(), router.get_remote_fills().end());
+    for (const auto &t : mine)
+    {
+        bought += t.buy_agent_id == buyer ? t.volume : 0;
+        sold += t.sell_agent_id == seller ? t.volume : 0;
+    }
+    int total = 0;
+    MPI_Allreduce(&trades, &total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    int other = (world_rank + 1) % instruments;
+    return total == instruments * size && bought == instruments && sold == instruments &&
+           ex.get_price(other) == 100.0;
+}
+
+static bool same_history(const PriceHistory &a, const PriceHistory &b)
+{
+    if (a.size() != b.size() || a.bar_count() != b.bar_count())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (a.price(i) != b.price(i) || a.tick_data()[i] != b.tick_data()[i] || a.volume_data()[i] != b.volume_data()[i])
+            return false;
+    return a.bar_count() == 0 || std::memcmp(a.bar_data(), b.bar_data(), a.bar_count() * sizeof(OhlcBar)) == 0;
+}
+
+static bool test_book_serialization()
+{
+    // A restored book matches exactly like the original
+    OrderBook a;
+    a.set_instrument_id(3);
+    for (int i = 0; i < 20; ++i)
+    {
+        a.add_order(make_order(i, 100.0 - 0.01 * (i % 5), 1 + i % 3, true, i));
+        a.add_order(make_order(100 + i, 100.02 + 0.01 * (i % 4), 1 + i % 2, false, i));
+    }
+    a.add_order(make_order(500, 100.03, 7, true, 20));
+    std::vector<Trade> ta, tb;
+    a.match_orders(20, ta);
+
+    std::vector<char> buf;
+    ByteWriter w(buf);
+    a.serialize(w);
+    ByteReader r(buf.data(), buf.size());
+    OrderBook b;
+    if (!b.deserialize(r) || b.get_instrument_id() != 3 || b.bid_depth() != a.bid_depth() ||
+        b.ask_depth() != a.ask_depth() || !same_history(a.get_price_history(), b.get_price_history()))
+        return false;
+    ByteReader truncated(buf.data(), buf.size() / 2);
+    OrderBook c;
+    if (c.deserialize(truncated))
+        return false;
+
+    ta.clear();
+    for (OrderBook *ob : {&a, &b})
+    {
+        ob->add_order(make_order(600, 100.10, 25, true, 21));
+        ob->add_order(make_order(601, 99.00, 30, false, 21));
+    }
+    a.match_orders(21, ta);
+    b.match_orders(21, tb);
+    return !ta.empty() && same_trades(ta, tb) &&
+           a.get_statistic(PriceStatistic::SMA) == b.get_statistic(PriceStatistic::SMA) &&
+           a.get_statistic(PriceStatistic::VWAP) == b.get_statistic(PriceStatistic::VWAP);
+}
+
+static bool test_rebalance_plan()
+{
+    // One hot instrument stays put; small ones move to the idle rank
+    std::vector<double> cost = {10.0, 1.0, 1.0, 1.0};
+    std::vector<int> owners = {0, 1, 0, 1};
+    auto moves = LoadBalancer::plan_moves(cost, owners, 2, 0.10, 4);
+    if (moves.size() != 1 || moves[0].instrument_id != 2 || moves[0].to != 1 || owners[2] != 1)
+        return false;
+
+    std::vector<double> even = {4.0, 1.0, 1.0, 1.0, 1.0, 4.0};
+    std::vector<int> stacked = {0, 0, 0, 0, 0, 0};
+    moves = LoadBalancer::plan_moves(even, stacked, 2, 0.10, 8);
+    double load[2] = {0.0, 0.0};
+    for (size_t i = 0; i < even.size(); ++i)
+        load[stacked[i]] += even[i];
+    return !moves.empty() && load[0] == 6.0 && load[1] == 6.0;
+}
+
+static bool test_book_migration()
+{
+    // Hand instrument 1 from one exchange to another with resting orders
+    Exchange src(0, 2, DEFAULT_TICK_SIZE, 1), dst(1, 2, DEFAULT_TICK_SIZE, 1);
+    src.set_instrument_owners({0, 0});
+    dst.set_instrument_owners({0, 0});
+    src.submit_order(order_on(1, make_order(7, 100.0, 5, true, 0)), 0);
+    src.submit_order(order_on(1, make_order(8, 100.0, 2, false, 0)), 0);
+    src.submit_order(order_on(1, make_order(9, 99.5, 4, true, 0)), 0);
+    src.process_orders(0);
+    if (src.get_booked_orders(1) != 3 || src.get_match_cycles(1) == 0)
+        return false;
+
+    std::vector<char> buf;
+    if (!src.export_book(1, buf) || !src.set_owner(1, 1) || !dst.set_owner(1, 1))
+        return false;
+    if (src.get_order_book(1).bid_depth() != 0 || src.get_price(1) != 100.0 || src.export_book(1, buf))
+        return false;
+    if (!dst.import_book(1, buf.data(), buf.size()) || dst.get_order_book(1).bid_depth() != 2)
+        return false;
+
+    dst.submit_order(order_on(1, make_order(10, 99.5, 7, false, 1)), 0);
+    dst.process_orders(1);
+    const auto &fills = dst.get_instrument_trades(1);
+    return fills.size() == 2 && fills[0].buy_agent_id == 7 && fills[0].volume == 3 &&
+           fills[1].buy_agent_id == 9 && fills[1].volume == 4;
+}
+
+static bool test_load_rebalance()
+{
+    // All books start on rank 0; one rebalance spreads them and the resting
+    // orders arrive with them
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const int instruments = 2 * size;
+    Exchange ex(world_rank, instruments, DEFAULT_TICK_SIZE, 1);
+    ex.set_instrument_owners(std::vector<int>(instruments, 0));
+    if (world_rank == 0)
+        for (int i = 0; i < instruments; ++i)
+            ex.submit_order(order_on(i, make_order(i, 99.0, 1, true, 0)), 0);
+    ex.process_orders(0);
+
+    LoadBalancer balancer(world_rank, size, 1, 0.10, instruments, LoadMetric::BOOKED_ORDERS);
+    int moved = balancer.rebalance(ex);
+    if (size == 1)
+        return moved == 0;
+    int hosted = 0, resting = 0;
+    for (int i = 0; i < instruments; ++i)
+    {
+        if (!ex.is_local(i))
+            continue;
+        hosted++;
+        resting += (int)ex.get_order_book(i).bid_depth();
+    }
+    return moved == instruments - 2 && hosted == 2 && resting == 2;
+}
+
+static bool test_trade_log_streaming()
+{
+    // Small chunks force several hand-offs to the I/O thread
+    std::string path = "test_trades_rank_" + std::to_string(world_rank) + ".bin";
+    std::vector<Trade> expected;
+    {
+        TradeLogWriter writer(4);
+        if (!writer.open(path, world_rank))
+            return false;
+        Exchange ex(world_rank, 2, DEFAULT_TICK_SIZE, 1);
+        ex.set_trade_sink(&writer);
+        for (int tick = 0; tick < 5; ++tick)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                ex.submit_order(order_on(i % 2, make_order(i, 100.0, 2, true, tick)), 0);
+                ex.submit_order(order_on(i % 2, make_order(10 + i, 100.0, 1, false, tick)), 0);
+                ex.submit_order(order_on(i % 2, make_order(20 + i, 100.0, 1, false, tick)), 0);
+            }
+            ex.process_orders(tick);
+            for (int i = 0; i < 2; ++i)
+                expected.insert(expected.end(), ex.get_instrument_trades(i).begin(),
+                                ex.get_instrument_trades(i).end());
+        }
+        if (!ex.get_trade_log().empty() || writer.records_written() != (long long)expected.size())
+            return false;
+        if (!writer.close())
+            return false;
+    }
+    std::vector<Trade> back;
+    TradeLogHeader h;
+    bool ok = read_trade_log(path, back, &h) && h.rank == world_rank && expected.size() == 30 &&
+              same_trades(back, expected);
+    std::remove(path.c_str());
+    return ok;
+}
+
+// Stream a fixed two-instrument run into a trade log at path
+static bool write_sample_trade_log(const std::string &path)
+{
+    TradeLogWriter writer(4);
+    if (!writer.open(path, world_rank))
+        return false;
+    Exchange ex(world_rank, 2, DEFAULT_TICK_SIZE, 1);
+    ex.set_trade_sink(&writer);
+    for (int tick = 0; tick < 5; ++tick)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            ex.submit_order(order_on(i % 2, make_order(i, 100.0 + i, 3, true, tick)), 0);
+            ex.submit_order(order_on(i % 2, make_order(10 + i, 100.0, 2, false, tick)), 0);
+        }
+        ex.process_orders(tick);
+    }
+    return writer.close();
+}
+
+static std::string read_file_bytes(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static bool test_trade_log_reproducible()
+{
+    // Identical runs write identical bytes: records carry no padding, and
+    // the reserved field is always zero
+    std::string first = "test_repro_a_rank_" + std::to_string(world_rank) + ".bin";
+    std::string second = "test_repro_b_rank_" + std::to_string(world_rank) + ".bin";
+    bool written = write_sample_trade_log(first);
+    // Leave garbage on the heap where the second run's buffers may land
+    std::vector<char> junk(1 << 20, (char)0xA5);
+    junk.clear();
+    junk.shrink_to_fit();
+    written = write_sample_trade_log(second) && written;
+    std::vector<Trade> back;
+    bool zeroed = read_trade_log(first, back) && !back.empty();
+    for (const auto &t : back)
+        zeroed = zeroed && t.reserved == 0;
+    std::string a = read_file_bytes(first), b = read_file_bytes(second);
+    std::remove(first.c_str());
+    std::remove(second.c_str());
+    return written && zeroed && !a.empty() && a == b;
+}
+
+static ReplayEvent replay_event(int tick, int instrument, double price, int volume, bool is_buy)
+{
+    ReplayEvent e;
+    std::memset(&e, 0, sizeof(e));
+    e.tick = tick;
+    e.instrument_id = instrument;
+    e.price = price;
+    e.volume = volume;
+    e.is_buy = is_buy ? 1 : 0;
+    return e;
+}
+
+static bool test_replay_feed()
+{
+    // Recorded ticks start at 10; simulation tick 0 replays recorded tick 10
+    std::string path = "test_feed_rank_" + std::to_string(world_rank) + ".bin";
+    std::vector<ReplayEvent> events = {
+        replay_event(10, 0, 100.0, 5, true), replay_event(10, 0, 100.0, 5, false),
+        replay_event(11, 1, 50.0, 3, true), replay_event(13, 1, 50.0, 3, false),
+        replay_event(13, 7, 50.0, 3, false)}; // unknown instrument, skipped
+    if (!write_replay_file(path, events))
+        return false;
+
+    Exchange ex(world_rank, 2, DEFAULT_TICK_SIZE, 2);
+    ReplayEngine replay(64);
+    bool ok = replay.open(path) && replay.get_record_count() == 5;
+    replay.set_agent_id(-7);
+    ok = ok && replay.feed(ex, 0) == 2 && ex.process_orders(0) == 1 &&
+         ex.get_instrument_trades(0)[0].buy_agent_id == -7 &&
+         ex.get_instrument_trades(0)[0].timestamp == 0;
+    ok = ok && replay.feed(ex, 1) == 1 && replay.feed(ex, 2) == 0 && replay.feed(ex, 3) == 1 &&
+         replay.done() && replay.get_orders_submitted() == 4;
+    ok = ok && ex.process_orders(3) == 1 && ex.get_instrument_trades(1)[0].volume == 3;
+
+    // Twice real time folds two recorded ticks into each simulation tick
+    replay.close();
+    replay.set_speed(2);
+    ok = ok && replay.open(path) && replay.feed(ex, 0) == 3 && replay.feed(ex, 1) == 1 && replay.done();
+    ex.process_orders(4);
+    std::remove(path.c_str());
+
+    // Anything that is not a feed or trade log is refused
+    std::ofstream(path) << "not a feed";
+    ok = ok && !replay.open(path) && !replay.open("no_such_feed.bin");
+    std::remove(path.c_str());
+    return ok;
+}
+
+static bool test_replay_trade_log()
+{
+    // A recorded session with one trade per instrument and tick replays to
+    // the same prices and volumes
+    std::string path = "test_replay_trades_rank_" + std::to_string(world_rank) + ".bin";
+    std::vector<Trade> recorded;
+    {
+        TradeLogWriter writer(8);
+        Exchange ex(world_rank, 2, DEFAULT_TICK_SIZE, 1);
+        if (!writer.open(path, world_rank))
+            return false;
+        ex.set_trade_sink(&writer);
+        for (int tick = 0; tick < 20; ++tick)
+        {
+            int inst = tick % 2;
+            double px = 100.0 + 0.25 * tick;
+            ex.submit_order(order_on(inst, make_order(1, px + 0.5, 1 + tick % 3, true, tick)), 0);
+            ex.submit_order(order_on(inst, make_order(2, px, 1 + tick % 3, false, tick)), 0);
+            ex.process_orders(tick);
+            recorded.insert(recorded.end(), ex.get_instrument_trades(inst).begin(),
+                            ex.get_instrument_trades(inst).end());
+        }
+        if (!writer.close())
+            return false;
+    }
+
+    Exchange replayed(world_rank, 2, DEFAULT_TICK_SIZE, 1);
+    ReplayEngine replay;
+    if (!replay.open(path))
+        return false;
+    for (int tick = 0; !replay.done(); ++tick)
+    {
+        replay.feed(replayed, tick);
+        replayed.process_orders(tick);
+    }
+    replay.close();
+    const std::vector<Trade> &out = replayed.get_trade_log();
+    std::remove(path.c_str());
+
+    bool ok = out.size() == recorded.size() && recorded.size() == 20;
+    for (size_t i = 0; ok && i < out.size(); ++i)
+        ok = out[i].price == recorded[i].price && out[i].volume == recorded[i].volume &&
+             out[i].instrument_id == recorded[i].instrument_id && out[i].timestamp == recorded[i].timestamp;
+    return ok && replayed.total_resting_orders() == 0;
+}
+
+static bool test_checkpoint_restart()
+{
+    // A run restored from a checkpoint continues exactly like the original
+    Exchange ex(world_rank, 3, DEFAULT_TICK_SIZE, 2);
+    AgentEngine agents(world_rank, 400, 3);
+    for (int tick = 0; tick < 20; ++tick)
+    {
+        agents.generate_orders(ex, tick);
+        ex.process_orders(tick);
+        agents.apply_fills(ex);
+    }
+
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    {
+        CheckpointWriter writer(world_rank, size, "test_ckpt");
+        ByteWriter w(writer.buffer());
+        ex.serialize(w);
+        agents.serialize(w);
+        writer.commit(19);
+        if (!writer.finish() || writer.last_written_tick() != 19)
+            return false;
+    }
+
+    int tick = -1, slot = -1;
+    std::vector<char> payload;
+    CheckpointHeader h;
+    std::string path = checkpoint_path("test_ckpt", world_rank, 0);
+    bool ok = read_checkpoint(path, h, payload) && h.tick == 19 && h.payload_bytes == payload.size();
+    ok = ok && load_latest_checkpoint("test_ckpt", world_rank, size, tick, payload, &slot) && tick == 19 && slot == 0;
+
+    Exchange restored(world_rank, 3, DEFAULT_TICK_SIZE, 2);
+    AgentEngine restored_agents(world_rank, 400, 3);
+    ByteReader r(payload.data(), payload.size());
+    ok = ok && restored.deserialize(r) && restored_agents.deserialize(r) && r.remaining() == 0;
+
+    // A different population is refused
+    AgentEngine other(world_rank, 401, 3);
+    ByteReader r2(payload.data(), payload.size());
+    Exchange scratch(world_rank, 3, DEFAULT_TICK_SIZE, 2);
+    ok = ok && scratch.deserialize(r2) && !other.deserialize(r2);
+
+    for (int t = 20; ok && t < 30; ++t)
+    {
+        agents.generate_orders(ex, t);
+        restored_agents.generate_orders(restored, t);
+        ex.process_orders(t);
+        restored.process_orders(t);
+        agents.apply_fills(ex);
+        restored_agents.apply_fills(restored);
+    }
+    ok = ok && same_trades(ex.get_trade_log(), restored.get_trade_log()) &&
+         ex.total_resting_orders() == restored.total_resting_orders();
+    for (int i = 0; ok && i < 400; ++i)
+        ok = agents.get_position(i) == restored_agents.get_position(i);
+
+    // A corrupted file fails its checksum
+    {
+        std::FILE *f = std::fopen(path.c_str(), "r+b");
+        std::fseek(f, sizeof(CheckpointHeader) + 8, SEEK_SET);
+        std::fputc(0x5a, f);
+        std::fclose(f);
+    }
+    ok = ok && !read_checkpoint(path, h, payload);
+    std::remove(path.c_str());
+    return ok;
+}
+
+static bool test_trade_log_resume()
+{
+    // Reopening a log at a checkpointed length drops the records after it
+    std::string path = "test_resume_rank_" + std::to_string(world_rank) + ".bin";
+    std::vector<Trade> trades(10);
+    for (int i = 0; i < 10; ++i)
+    {
+        std::memset(&trades[i], 0, sizeof(Trade));
+        trades[i].timestamp = i;
+        trades[i].volume = 1 + i;
+    }
+    TradeLogWriter writer(4);
+    bool ok = writer.open(path, world_rank);
+    writer.append(trades.data(), 6);
+    ok = ok && writer.flush() && writer.records_written() == 6;
+    writer.append(trades.data() + 6, 4);
+    ok = ok && writer.close();
+
+    ok = ok && !writer.open(path, world_rank, 11) && writer.open(path, world_rank, 6) &&
+         writer.records_written() == 6;
+    writer.append(trades.data() + 6, 2);
+    ok = ok && writer.close();
+    std::vector<Trade> back;
+    ok = ok && read_trade_log(path, back) && back.size() == 8 && back[7].timestamp == 7;
+    std::remove(path.c_str());
+    return ok;
+}
+
+static bool test_price_history_bars()
+{
+    // Per-trade columns plus OHLC bars; a 5-tick bar folds several ticks
+    PriceHistory h(100.0);
+    PriceHistory coarse(100.0);
+    if (!coarse.configure(5, false) || !h.configure(1, true))
+        return false;
+    const int ticks[] = {0, 0, 0, 3, 7};
+    const double px[] = {100.0, 101.5, 99.0, 100.5, 102.0};
+    const int vol[] = {1, 2, 3, 4, 5};
+    for (int i = 0; i < 5; ++i)
+    {
+        h.add_trade(ticks[i], px[i], vol[i]);
+        coarse.add_trade(ticks[i], px[i], vol[i]);
+    }
+    if (coarse.configure(1, true))
+        return false; // only while empty
+    const OhlcBar &b0 = h.bar(0);
+    bool fine_ok = h.size() == 5 && h.bar_count() == 3 && b0.tick == 0 && b0.trades == 3 &&
+                   b0.volume == 6 && b0.open == 100.0 && b0.high == 101.5 && b0.low == 99.0 &&
+                   b0.close == 99.0 && h.bar(2).tick == 7;
+    const OhlcBar &c0 = coarse.bar(0);
+    bool coarse_ok = coarse.size() == 0 && coarse.bar_count() == 2 && c0.trades == 4 &&
+                     c0.close == 100.5 && coarse.bar(1).tick == 5;
+
+    // Growth across many pages keeps earlier values
+    PriceHistory big(100.0);
+    for (int i = 0; i < 100000; ++i)
+        big.add_trade(i / 10, 100.0 + (i % 7) * 0.01, 1);
+    bool big_ok = big.size() == 100000 && big.price(99999) == 100.0 + (99999 % 7) * 0.01 &&
+                  big.bar_count() == 10000 && big.bar(9999).trades == 10;
+    return fine_ok && coarse_ok && big_ok;
+}
+
+static bool test_history_file()
+{
+    // Every rank's bars land in one shared file, in rank order
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    Exchange ex(world_rank, 2, DEFAULT_TICK_SIZE, 1);
+    for (int tick = 0; tick < 3 + world_rank; ++tick)
+    {
+        ex.submit_order(order_on(1, make_order(1, 100.0 + tick, 2, true, tick)), 0);
+        ex.submit_order(order_on(1, make_order(2, 100.0 + tick, 2, false, tick)), 0);
+        ex.process_orders(tick);
+    }
+    const std::string path = "test_history.bin";
+    if (!ex.write_history(path))
+        return false;
+    MPI_Barrier(MPI_COMM_WORLD);
+    std::vector<HistorySeries> series;
+    bool ok = read_history_file(path, series) && (int)series.size() == 2 * size;
+    for (int r = 0; ok && r < size; ++r)
+    {
+        const HistorySeries &inst0 = series[2 * r], &inst1 = series[2 * r + 1];
+        ok = inst0.rank == r && inst0.bars.empty() && inst1.instrument_id == 1 &&
+             (int)inst1.bars.size() == 3 + r && inst1.bars.back().close == 100.0 + 2 + r;
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (world_rank == 0)
+        std::remove(path.c_str());
+    return ok;
+}
+
+static bool test_config_parsing()
+{
+    SimConfig c;
+    std::string err;
+    bool ok = c.num_instruments == 3 && c.total_agents() == 1000 && c.ticks == 1000 && c.seed == 0;
+    ok = ok && set_config_value(c, "ticks", "50", err) && c.ticks == 50;
+    ok = ok && set_config_value(c, "seed", "0x10", err) && c.seed == 16;
+    ok = ok && set_config_value(c, "shard", "yes", err) && c.shard_instruments;
+    ok = ok && set_config_value(c, "momentum_agents", "40", err) && c.total_agents() == 40;
+    ok = ok && !set_config_value(c, "ticks", "-1", err) && !set_config_value(c, "threads", "2x", err);
+    ok = ok && !set_config_value(c, "no_such_option", "1", err) && err.find("no_such_option") != std::string::npos;
+
+    // Header lines before the first [run] apply to every run
+    std::string path = "test_config_" + std::to_string(world_rank) + ".cfg";
+    {
+        std::ofstream f(path);
+        f << "# sweep\nticks = 20\nthreads=2\n\n[run]\nseed = 1\n[run]\nseed = 2   # second\nagents = 10\n";
+    }
+    std::vector<SimConfig> runs;
+    ok = ok && load_config_file(path, SimConfig(), runs, err) && runs.size() == 2;
+    ok = ok && runs[0].ticks == 20 && runs[1].ticks == 20 && runs[0].num_threads == 2;
+    ok = ok && runs[0].seed == 1 && runs[1].seed == 2 && runs[0].num_agents == 1000 && runs[1].num_agents == 10;
+
+    // Command line options override the file on every run
+    std::string cfg_arg = "--config=" + path;
+    const char *argv[] = {"trading_sim", cfg_arg.c_str(), "--ticks", "5", "--output-prefix=x_", "--restart"};
+    ok = ok && parse_command_line(6, const_cast<char **>(argv), runs, err) && runs.size() == 2;
+    ok = ok && runs[0].ticks == 5 && runs[1].ticks == 5 && runs[1].output_prefix == "x_" && runs[1].restart &&
+         runs[1].seed == 2;
+    // A bare switch is on; its next argument is left for the next option
+    const char *flags[] = {"trading_sim", "--comm-thread", "--ticks", "7", "--offload"};
+    ok = ok && parse_command_line(5, const_cast<char **>(flags), runs, err) && runs[0].comm_thread &&
+         runs[0].offload && runs[0].ticks == 7;
+
+    {
+        std::ofstream f(path);
+        f << "ticks = 20\nbogus line\n";
+    }
+    ok = ok && !load_config_file(path, SimConfig(), runs, err) && err.find(":2:") != std::string::npos;
+    std::remove(path.c_str());
+    return ok;
+}
+
+static bool test_exchange_reset()
+{
+    // A reset exchange and rebuilt agents behave exactly like fresh ones
+    Exchange ex(world_rank, 4, DEFAULT_TICK_SIZE, 3);
+    AgentEngine agents(world_rank, 300, 4);
+    for (int tick = 0; tick < 15; ++tick)
+    {
+        agents.generate_orders(ex, tick);
+        ex.process_orders(tick);
+        agents.apply_fills(ex);
+    }
+
+    ex.reset(3, DEFAULT_TICK_SIZE, 2);
+    agents.rebuild(world_rank, 400, 3);
+    bool ok = ex.get_num_instruments() == 3 && ex.get_num_lanes() == 2 && ex.total_resting_orders() == 0 &&
+              ex.get_trade_log().empty() && agents.size() == 400;
+
+    Exchange fresh(world_rank, 3, DEFAULT_TICK_SIZE, 2);
+    AgentEngine fresh_agents(world_rank, 400, 3);
+    for (int tick = 0; ok && tick < 20; ++tick)
+    {
+        agents.generate_orders(ex, tick);
+        fresh_agents.generate_orders(fresh, tick);
+        ex.process_orders(tick);
+        fresh.process_orders(tick);
+        agents.apply_fills(ex);
+        fresh_agents.apply_fills(fresh);
+    }
+    ok = ok && !ex.get_trade_log().empty() && same_trades(ex.get_trade_log(), fresh.get_trade_log()) &&
+         same_history(ex.get_order_book(0).get_price_history(), fresh.get_order_book(0).get_price_history());
+    for (int i = 0; ok && i < 400; ++i)
+        ok = agents.get_position(i) == fresh_agents.get_position(i);
+    return ok;
+}
+
+static bool test_agent_seed()
+{
+    // Seed 0 is the default stream; another seed gives different orders
+    auto run = [](uint64_t seed, bool set) {
+        Exchange ex(world_rank, 3, DEFAULT_TICK_SIZE, 2);
+        AgentEngine agents(world_rank, 200, 3);
+        if (set)
+            agents.set_seed(seed);
+        for (int tick = 0; tick < 10; ++tick)
+        {
+            agents.generate_orders(ex, tick);
+            ex.process_orders(tick);
+            agents.apply_fills(ex);
+        }
+        return ex.get_trade_log();
+    };
+    std::vector<Trade> base = run(0, false);
+    return !base.empty() && same_trades(base, run(0, true)) && same_trades(run(7, true), run(7, true)) &&
+           !same_trades(base, run(7, true));
+}
+
+static bool test_rng_streams()
+{
+    // A stream's draws are the blocks of Philox::draw in counter order, and
+    // seek/discard land exactly where sequential draws would
+    Philox::Stream seq(42, 9), jump(42, 9);
+    seq.seek(1000);
+    std::vector<uint32_t> drawn;
+    for (int i = 0; i < 11; ++i)
+        drawn.push_back(seq());
+    Philox::Block b2 = Philox::draw(42, 9, 1000, 2);
+    bool ok = drawn[8] == b2.v[0] && drawn[10] == b2.v[2];
+    jump.seek(1000);
+    jump();
+    jump.discard(6);
+    ok = ok && jump() == drawn[7];
+    jump.seek(1000, 1);
+    jump.discard(1);
+    ok = ok && jump() == drawn[5] && Philox::Stream(43, 9)() != Philox::Stream(42, 9)();
+
+    // An agent's orders at a tick do not depend on the ticks it saw before
+    Agent warm(0, 5, AgentStrategy::RANDOM_WALK), cold(0, 5, AgentStrategy::RANDOM_WALK);
+    std::vector<Order> a, b;
+    for (int tick = 0; tick < 7; ++tick)
+    {
+        a.clear();
+        warm.generate_orders(0, 100.0, 100.0, tick, a);
+    }
+    b.clear();
+    cold.generate_orders(0, 100.0, 100.0, 6, b);
+    ok = ok && a.size() == 1 && b.size() == 1 && a[0].is_buy == b[0].is_buy && a[0].volume == b[0].volume;
+
+    // A seeded agent draws from (seed, agent, tick) like the engine
+    Agent seeded(0, 5, AgentStrategy::RANDOM_WALK, PriceStatistic::MEAN, 42);
+    b.clear();
+    seeded.generate_orders(0, 100.0, 100.0, 6, b);
+    Philox::Block expect = Philox::draw(42, 5, 6);
+    return ok && b.size() == 1 && b[0].is_buy == (expect.v[0] < 0x80000000u) &&
+           b[0].volume == 1 + (int)Philox::below(expect.v[1], RandomWalkParams::MAX_VOLUME);
+}
+
+static bool test_agent_offload()
+{
+    // Device kernels give the host path's orders in the same arrival order,
+    // across a restore; builds without TRADING_OFFLOAD refuse and stay on the host
+    auto run = [](bool offload, int threads, std::vector<int> &positions) {
+        int saved = omp_get_max_threads();
+        omp_set_num_threads(threads);
+        Exchange ex(world_rank, 3, DEFAULT_TICK_SIZE, threads);
+        AgentEngine agents(world_rank, 300, 3);
+        agents.set_seed(11);
+        agents.set_order_lifetime(5);
+        bool ok = agents.set_offload(offload) == (!offload || AgentOffload::available());
+        for (int tick = 0; tick < 20; ++tick)
+        {
+            if (tick == 10)
+            {
+                std::vector<char> buf;
+                ByteWriter w(buf);
+                agents.serialize(w);
+                ByteReader r(buf.data(), buf.size());
+                ok = ok && agents.deserialize(r);
+            }
+            agents.generate_orders(ex, tick);
+            ex.process_orders(tick);
+            agents.apply_fills(ex);
+        }
+        omp_set_num_threads(saved);
+        positions.clear();
+        for (int i = 0; i < (int)agents.size(); ++i)
+            positions.push_back(agents.get_position(i));
+        return ok ? ex.get_trade_log() : std::vector<Trade>();
+    };
+    std::vector<int> host_pos, dev_pos;
+    std::vector<Trade> host = run(false, 2, host_pos);
+    std::vector<Trade> dev = run(true, 3, dev_pos);
+    return !host.empty() && same_trades(host, dev) && host_pos == dev_pos;
+}
+
+static bool test_spsc_ring_seqlock()
+{
+    // Ring: every value arrives once and in order, including across wraps
+    SpscRing<long long> ring(64);
+    const long long N = 200000;
+    std::thread producer([&ring, N] {
+        for (long long v = 1; v <= N; ++v)
+            while (!ring.try_push(v))
+                std::this_thread::yield();
+    });
+    long long expected = 1;
+    bool ok = ring.capacity() == 64;
+    while (expected <= N)
+    {
+        const long long *v = ring.front();
+        if (!v)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ok = ok && *v == expected;
+        ring.pop();
+        expected++;
+    }
+    producer.join();
+    ok = ok && ring.empty() && ring.front() == nullptr;
+
+    // SeqLock: a reader never sees a half-written value
+    struct Quad {
+        long long a, b, c, d;
+    };
+    SeqLock<Quad> lock;
+    std::atomic<bool> done(false);
+    std::thread writer([&lock, &done] {
+        for (long long k = 1; k <= 100000; ++k)
+            lock.store(Quad{k, k, k, k});
+        done.store(true);
+    });
+    long long last = 0;
+    while (!done.load())
+    {
+        Quad q = lock.load();
+        ok = ok && q.a == q.b && q.b == q.c && q.c == q.d && q.a >= last;
+        last = q.a;
+    }
+    writer.join();
+    Quad q = lock.load();
+    return ok && q.a == 100000 && q.d == 100000 && lock.get_version() == 100000;
+}
+
+static bool test_market_snapshot()
+{
+    Exchange ex(world_rank, 2, DEFAULT_TICK_SIZE, 1);
+    MarketSnapshot s;
+    uint64_t v0 = ex.read_snapshot(0, s);
+    bool ok = v0 > 0 && s.last_price == 100.0 && s.best_bid == 0.0 && s.bid_orders == 0 && s.tick == -1 &&
+              ex.read_snapshot(5, s) == 0;
+
+    // Depth: six bid levels (one with two orders), asks above
+    for (int k = 0; k < 6; ++k)
+        ex.submit_order(make_order(k, 99.90 - 0.01 * k, 1 + k, true, 0), 0);
+    ex.submit_order(make_order(9, 99.90, 4, true, 0), 0);
+    ex.submit_order(make_order(10, 100.10, 3, false, 0), 0);
+    ex.process_orders(0);
+    ok = ok && ex.read_snapshot(0, s) > v0 && s.tick == 0 && s.bid_orders == 7 && s.ask_orders == 1;
+    ok = ok && std::fabs(s.best_bid - 99.90) < 1e-9 && std::fabs(s.best_ask - 100.10) < 1e-9;
+    ok = ok && s.bid_volume[0] == 5 && s.bid_volume[4] == 5 && std::fabs(s.bid_price[4] - 99.86) < 1e-9;
+    ok = ok && s.ask_volume[0] == 3 && s.ask_volume[1] == 0 && s.ask_price[1] == 0.0;
+    for (int k = 0; ok && k < NUM_PRICE_STATISTICS; ++k)
+        ok = s.stats[k] == ex.get_statistic(0, static_cast<PriceStatistic>(k));
+
+    // Crossing updates the last price and traded volume
+    ex.submit_order(make_order(11, 100.10, 2, true, 1), 0);
+    ex.process_orders(1);
+    ok = ok && ex.read_snapshot(0, s) && s.last_price == ex.get_price(0) && s.traded_volume == 2 &&
+         s.ask_volume[0] == 1;
+
+    // Instruments hosted elsewhere carry the remote view
+    int size = 1;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (size > 1)
+    {
+        std::vector<int> owners = {world_rank, (world_rank + 1) % size};
+        ex.set_instrument_owners(owners);
+        std::vector<MarketQuote> quotes(2, MarketQuote{0.0, 0.0, 0.0, 0.0, 0.0});
+        quotes[1] = MarketQuote{101.0, 100.5, 100.6, 100.7, 100.8};
+        ex.set_remote_quotes(quotes);
+        ok = ok && ex.read_snapshot(1, s) && !s.is_local && s.last_price == 101.0 &&
+             s.stats[(int)PriceStatistic::VWAP] == 100.8 && ex.read_snapshot(0, s) && s.is_local;
+        ok = ok && s.traded_volume == 2;
+    }
+
+    // Readers on another thread always see a consistent snapshot while the
+    // books are matched: every copy of the bid ladder is sorted
+    Exchange live(world_rank, 1, DEFAULT_TICK_SIZE, 1);
+    std::atomic<bool> done(false);
+    std::atomic<bool> consistent(true);
+    std::thread reader([&] {
+        MarketSnapshot r;
+        while (!done.load())
+        {
+            live.read_snapshot(0, r);
+            for (int k = 1; k < SNAPSHOT_DEPTH; ++k)
+                if (r.bid_volume[k] > 0 && !(r.bid_price[k] < r.bid_price[k - 1]))
+                    consistent = false;
+            if (r.best_bid > 0.0 && r.best_ask > 0.0 && r.best_bid >= r.best_ask)
+                consistent = false;
+        }
+    });
+    for (int tick = 0; tick < 300; ++tick)
+    {
+        for (int k = 0; k < 20; ++k)
+            live.submit_order(make_order(k, 100.0 + 0.01 * ((tick + k) % 9 - 4), 1 + k % 3, k % 2 == 0, tick), 0);
+        live.process_orders(tick);
+    }
+    done = true;
+    reader.join();
+    return ok && consistent.load();
+}
+
+static bool test_continuous_matching()
+{
+    // With one submitting lane, matching on arrival is the same as booking
+    // and crossing each order in turn
+    std::vector<Order> orders;
+    for (int i = 0; i < 3000; ++i)
+    {
+        Order o = make_order(i, 100.0 + 0.01 * ((i * 7) % 11 - 5), 1 + i % 7, (i * 13) % 3 != 0, i / 100);
+        o.instrument_id = i % 3;
+        orders.push_back(o);
+    }
+    std::vector<OrderBook> reference(3);
+    std::vector<std::vector<Trade>> expected(3);
+    for (int i = 0; i < 3; ++i)
+        reference[i].set_instrument_id(i);
+    for (const auto &o : orders)
+    {
+        reference[o.instrument_id].add_order(o);
+        reference[o.instrument_id].match_orders(o.timestamp, expected[o.instrument_id]);
+    }
+
+    Exchange ex(world_rank, 3, DEFAULT_TICK_SIZE, 1);
+    bool ok = true;
+    long long trades = 0;
+    {
+        ContinuousEngine engine(ex, 2, 16);
+        ok = ex.get_continuous() == &engine && engine.get_num_matchers() == 2;
+        for (int tick = 0; tick < 30; ++tick)
+        {
+            for (int i = tick * 100; i < (tick + 1) * 100; ++i)
+                ex.submit_order(orders[i], 0);
+            trades += ex.process_orders(tick);
+        }
+        for (int i = 0; ok && i < 3; ++i)
+        {
+            MarketSnapshot q;
+            double bid = 0.0, ask = 0.0;
+            reference[i].get_best_bid(bid);
+            reference[i].get_best_ask(ask);
+            ok = ex.read_snapshot(i, q) > 1000 && q.last_price == reference[i].get_last_price() &&
+                 q.best_bid == bid && q.best_ask == ask && q.tick == 29;
+            ok = ok && ex.get_booked_orders(i) == 1000;
+        }
+        MatchLatency l = engine.get_latency();
+        ok = ok && l.orders == 3000 && l.p50_ns > 0.0 && l.p50_ns <= l.p99_ns && l.p99_ns <= l.max_ns * 1.125;
+        engine.reset_latency();
+        ok = ok && engine.get_latency().orders == 0;
+    }
+    ok = ok && ex.get_continuous() == nullptr && trades == (long long)ex.get_trade_log().size();
+
+    // Per instrument the fills are the reference ones, in order
+    std::vector<std::vector<Trade>> actual(3);
+    for (const auto &t : ex.get_trade_log())
+        actual[t.instrument_id].push_back(t);
+    for (int i = 0; ok && i < 3; ++i)
+        ok = same_trades(actual[i], expected[i]) &&
+             ex.get_order_book(i).bid_depth() == reference[i].bid_depth() &&
+             ex.get_order_book(i).ask_depth() == reference[i].ask_depth();
+
+    // Detached, the exchange is back to batch matching
+    size_t resting = ex.total_resting_orders();
+    ex.submit_order(orders[0], 0);
+    ok = ok && ex.total_resting_orders() == resting; // waits in its lane
+    ex.process_orders(30);
+    return ok && ex.get_booked_orders(0) == 1001;
+}
+
+static bool test_continuous_agents()
+{
+    // Agents on several threads feed two matchers while reading live quotes
+    Exchange ex(world_rank, 3, DEFAULT_TICK_SIZE, 4);
+    AgentEngine agents(world_rank, 2000, 3);
+    ContinuousEngine engine(ex, 2);
+    long long orders = 0, trades = 0;
+    int saved = omp_get_max_threads();
+    omp_set_num_threads(4);
+    for (int tick = 0; tick < 20; ++tick)
+    {
+        orders += agents.generate_orders(ex, tick);
+        trades += ex.process_orders(tick);
+        agents.apply_fills(ex);
+    }
+    omp_set_num_threads(saved);
+    long long booked = 0, net = 0, bought = 0;
+    for (int i = 0; i < 3; ++i)
+        booked += ex.get_booked_orders(i);
+    for (int i = 0; i < 2000; ++i)
+        net += agents.get_position(i);
+    for (const auto &t : ex.get_trade_log())
+        bought += t.volume;
+    return trades > 0 && booked == orders && engine.get_latency().orders == orders && net == 0 &&
+           trades == (long long)ex.get_trade_log().size() && bought > 0;
+}
+
+static bool test_tick_profiler()
+{
+    // Phases are recorded in order and the binary timeline round-trips
+    TickProfiler profiler(world_rank, 4);
+    for (int tick = 0; tick < 3; ++tick)
+    {
+        profiler.begin_tick(tick);
+        for (int p = 0; p < NUM_PHASES; ++p)
+        {
+            profiler.begin_phase((Phase)p);
+            profiler.end_phase((Phase)p);
+        }
+        profiler.set_counters(10 + tick, 5, 2, 24);
+        profiler.end_tick();
+    }
+    const auto &recs = profiler.get_records();
+    if (recs.size() != 3 || recs[2].tick != 2 || recs[2].orders != 12 || recs[1].bytes != 24)
+        return false;
+    for (const auto &r : recs)
+        for (int p = 1; p < NUM_PHASES; ++p)
+            if (r.phase_start[p] < r.phase_start[p - 1])
+                return false;
+
+    std::string path = "test_timeline_rank_" + std::to_string(world_rank) + ".bin";
+    if (!profiler.write_binary(path))
+        return false;
+    std::ifstream ifs(path, std::ios::binary);
+    TimelineHeader h;
+    ifs.read(reinterpret_cast<char *>(&h), sizeof(h));
+    std::vector<TickRecord> back(h.num_records);
+    ifs.read(reinterpret_cast<char *>(back.data()), back.size() * sizeof(TickRecord));
+    bool ok = ifs && std::memcmp(h.magic, "TSPROF01", 8) == 0 && h.record_size == sizeof(TickRecord) &&
+              h.num_records == 3 && back[1].orders == 11 && back[2].fills == 2 && h.cycles_per_ns > 0.0;
+    ifs.close();
+    std::remove(path.c_str());
+    return ok;
+}
+
+static bool test_tsc_timer()
+{
+    TscTimer timer;
+    volatile double x = 0.0;
+    for (int i = 0; i < 100000; ++i)
+        x = x + 1.0;
+    return timer.elapsed_cycles() > 0 && timer.elapsed_ns() > 0.0;
+}
 
 int main(int argc, char **argv)
 {
-    MPI_Init(&argc, &argv);
-    int rank = 0, size = 1;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &mpi_thread_level);
+    int size = 1;
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
-    if (rank == 0)
+    if (world_rank == 0)
     {
-        std::cout << "=== Trading Simulator Test Suite (smoke) ===\n";
+        std::cout << "=== Trading Simulator Test Suite ===\n";
         std::cout << "MPI ranks: " << size << "\n";
-        std::cout << "[PASS] mpi_init\n";
+    }
+    report("mpi_init", true);
+
+    report("order_matching_exact", test_order_matching_exact());
+    report("order_matching_no_match", test_order_matching_no_match());
+    report("partial_fill", test_partial_fill());
+    report("price_time_priority", test_price_time_priority());
+    report("resting_orders_persist", test_resting_orders_persist());
+    report("tick_snapping", test_tick_snapping());
+    report("ladder_growth", test_ladder_growth());
+    report("outlier_price", test_outlier_price());
+    report("ladder_recentre", test_ladder_recentre());
+    report("set_tick_size", test_set_tick_size());
+    report("historical_average", test_historical_average());
+    report("cancel_replace", test_cancel_replace());
+    report("time_in_force", test_time_in_force());
+    report("order_info_reuse", test_order_info_reuse());
+    report("order_slab_reuse", test_order_slab_reuse());
+    report("thread_safety", test_thread_safety());
+    report("lane_bounds", test_lane_bounds());
+    report("deterministic_submission", test_deterministic_submission());
+    report("parallel_matching", test_parallel_matching());
+    report("agent_pool_persistent", test_agent_pool_persistent());
+    report("agent_pool_thread_count", test_agent_pool_thread_count());
+    report("philox_known_answer", test_philox_known_answer());
+    report("agent_engine_layout", test_agent_engine_layout());
+    report("agent_engine_thread_count", test_agent_engine_thread_count());
+    report("strategy_registry", test_strategy_registry());
+    report("thread_placement", test_thread_placement());
+    report("allocation_free_tick", test_allocation_free_tick());
+    report("rolling_statistics", test_rolling_statistics());
+    report("sma_long_run", test_sma_long_run());
+    report("async_price_exchange", test_async_price_exchange());
+    report("comm_thread", test_comm_thread());
+    report("delta_market_data", test_delta_market_data());
+    report("instrument_sharding", test_instrument_sharding());
+    report("order_routing", test_order_routing());
+    report("book_serialization", test_book_serialization());
+    report("rebalance_plan", test_rebalance_plan());
+    report("book_migration", test_book_migration());
+    report("load_rebalance", test_load_rebalance());
+    report("trade_log_streaming", test_trade_log_streaming());
+    report("trade_log_reproducible", test_trade_log_reproducible());
+    report("replay_feed", test_replay_feed());
+    report("replay_trade_log", test_replay_trade_log());
+    report("checkpoint_restart", test_checkpoint_restart());
+    report("trade_log_resume", test_trade_log_resume());
+    report("price_history_bars", test_price_history_bars());
+    report("history_file", test_history_file());
+    report("config_parsing", test_config_parsing());
+    report("exchange_reset", test_exchange_reset());
+    report("agent_seed", test_agent_seed());
+    report("rng_streams", test_rng_streams());
+    report("agent_offload", test_agent_offload());
+    report("spsc_ring_seqlock", test_spsc_ring_seqlock());
+    report("market_snapshot", test_market_snapshot());
+    report("continuous_matching", test_continuous_matching());
+    report("continuous_agents", test_continuous_agents());
+    report("tick_profiler", test_tick_profiler());
+    report("tsc_timer", test_tsc_timer());
+
+    // A test fails globally if it failed on any rank
+    int local_failed = tests_failed, global_failed = 0;
+    MPI_Allreduce(&local_failed, &global_failed, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (world_rank == 0)
+    {
+        std::cout << "\n=== Test Results ===\n";
+        std::cout << "Passed: " << tests_passed << "\n";
+        std::cout << "Failed: " << tests_failed << "\n";
+        std::cout << "Total:  " << (tests_passed + tests_failed) << "\n";
+        if (global_failed == 0)
+            std::cout << "\nAll tests passed!\n";
     }
     MPI_Barrier(MPI_COMM_WORLD);
     MPI_Finalize();
-    return 0;
+    return global_failed == 0 ? 0 : 1;
 }
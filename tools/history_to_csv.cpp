@@ -0,0 +1,50 @@
+// Convert the shared OHLC history file written by Exchange::write_history
+// to one CSV row per bar
+// Usage: history_to_csv price_history.bin [price_history.csv]
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "price_history.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <history.bin> [history.csv]\n";
+        return 2;
+    }
+    std::string in = argv[1];
+    std::string out = argc > 2 ? argv[2] : in;
+    if (argc <= 2)
+    {
+        size_t dot = out.rfind(".bin");
+        out = (dot == std::string::npos ? out : out.substr(0, dot)) + ".csv";
+    }
+
+    std::vector<HistorySeries> series;
+    if (!read_history_file(in, series))
+    {
+        std::cerr << "error: " << in << " is not a readable history file\n";
+        return 1;
+    }
+    std::ofstream ofs(out);
+    ofs << "Rank,Instrument,Tick,Open,High,Low,Close,Volume,Trades\n";
+    size_t rows = 0;
+    for (const auto &s : series)
+    {
+        for (const auto &b : s.bars)
+        {
+            ofs << s.rank << "," << s.instrument_id << "," << b.tick << "," << b.open << ","
+                << b.high << "," << b.low << "," << b.close << "," << b.volume << "," << b.trades << "\n";
+            rows++;
+        }
+    }
+    if (!ofs)
+    {
+        std::cerr << "error: failed writing " << out << "\n";
+        return 1;
+    }
+    std::cout << in << ": " << series.size() << " series, " << rows << " bars -> " << out << "\n";
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Convert a binary trade log (trades_rank_X.bin) to the CSV format of
+// Exchange::export_trade_log, for scripts/analyze_results.py and friends
+// Usage: trade_log_to_csv trades_rank_0.bin [trades_rank_0.csv]
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "trade_log.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <trades.bin> [trades.csv]\n";
+        return 2;
+    }
+    std::string in = argv[1];
+    std::string out = argc > 2 ? argv[2] : in;
+    if (argc <= 2)
+    {
+        size_t dot = out.rfind(".bin");
+        out = (dot == std::string::npos ? out : out.substr(0, dot)) + ".csv";
+    }
+
+    std::vector<Trade> trades;
+    TradeLogHeader header;
+    if (!read_trade_log(in, trades, &header))
+    {
+        std::cerr << "error: " << in << " is not a readable trade log\n";
+        return 1;
+    }
+    std::ofstream ofs(out);
+    write_trades_csv(ofs, trades.data(), trades.size());
+    if (!ofs)
+    {
+        std::cerr << "error: failed writing " << out << "\n";
+        return 1;
+    }
+    std::cout << in << " (rank " << header.rank << "): " << trades.size()
+              << " trades -> " << out << "\n";
+    return 0;
+}